@@ -0,0 +1,158 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "AlarmScheduler.h"
+
+using namespace StmPlusPlus;
+
+#define USART_DEBUG_MODULE "ALRM: "
+
+static const time_t SECONDS_PER_DAY = 24 * 3600;
+
+/************************************************************************
+ * Class AlarmScheduler
+ ************************************************************************/
+
+constexpr time_t AlarmScheduler::NO_DEADLINE;
+
+AlarmScheduler::AlarmScheduler (const Config & _config, const Calendar & _calendar):
+    config(_config),
+    calendar(_calendar)
+{
+    for (size_t i = 0; i < Config::ALARMS_NUMBER; ++i)
+    {
+        heap[i] = {NO_DEADLINE, i};
+        position[i] = i;
+    }
+}
+
+
+void AlarmScheduler::reschedule (time_t now)
+{
+    for (size_t i = 0; i < Config::ALARMS_NUMBER; ++i)
+    {
+        update(i, now);
+    }
+    USART_DEBUG("Next alarm " << getNextAlarm() << " in " << timeUntilNextAlarm(now) << " sec");
+}
+
+
+void AlarmScheduler::update (size_t alarm, time_t now)
+{
+    size_t i = position[alarm];
+    time_t oldDeadline = heap[i].deadline;
+    heap[i].deadline = getNextOccurrence(alarm, now);
+    if (heap[i].deadline < oldDeadline)
+    {
+        siftUp(i);
+    }
+    else
+    {
+        siftDown(i);
+    }
+}
+
+
+void AlarmScheduler::onTimeChanged (time_t oldTime, time_t newTime)
+{
+    time_t diff = newTime - oldTime;
+    if (diff > MAX_CATCH_UP_TIME || diff < -MAX_CATCH_UP_TIME)
+    {
+        reschedule(newTime);
+    }
+}
+
+
+size_t AlarmScheduler::checkDeadline (time_t now)
+{
+    if (heap[0].deadline > now)
+    {
+        return Config::ALARMS_NUMBER;
+    }
+    size_t alarm = heap[0].alarm;
+    USART_DEBUG("Alarm " << alarm << " is due since " << (now - heap[0].deadline) << " sec");
+    heap[0].deadline = getNextOccurrence(alarm, now);
+    siftDown(0);
+    return alarm;
+}
+
+
+time_t AlarmScheduler::getNextOccurrence (size_t alarm, time_t now) const
+{
+    const Config::Alarm & a = config.getAlarm(alarm);
+    if (!a.isActive)
+    {
+        return NO_DEADLINE;
+    }
+    time_t today = now / SECONDS_PER_DAY;
+    time_t alarmTime = a.hour * 3600 + a.min * 60;
+    for (size_t d = 0; d <= MAX_SEARCH_DAYS; ++d)
+    {
+        time_t t = (today + d) * SECONDS_PER_DAY + alarmTime;
+        if (t > now && calendar.isAlarmDay(a, alarm, today + d))
+        {
+            return t;
+        }
+    }
+    return NO_DEADLINE;
+}
+
+
+void AlarmScheduler::swap (size_t i, size_t j)
+{
+    Entry tmp = heap[i];
+    heap[i] = heap[j];
+    heap[j] = tmp;
+    position[heap[i].alarm] = i;
+    position[heap[j].alarm] = j;
+}
+
+
+void AlarmScheduler::siftUp (size_t i)
+{
+    while (i > 0 && heap[(i - 1) / 2].deadline > heap[i].deadline)
+    {
+        swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+
+void AlarmScheduler::siftDown (size_t i)
+{
+    while (true)
+    {
+        size_t smallest = i;
+        size_t left = 2 * i + 1, right = 2 * i + 2;
+        if (left < Config::ALARMS_NUMBER && heap[left].deadline < heap[smallest].deadline)
+        {
+            smallest = left;
+        }
+        if (right < Config::ALARMS_NUMBER && heap[right].deadline < heap[smallest].deadline)
+        {
+            smallest = right;
+        }
+        if (smallest == i)
+        {
+            return;
+        }
+        swap(i, smallest);
+        i = smallest;
+    }
+}
@@ -0,0 +1,119 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef ALARMSCHEDULER_H_
+#define ALARMSCHEDULER_H_
+
+#include <limits>
+
+#include "Config.h"
+#include "Calendar.h"
+
+/**
+ * @brief Class that keeps the next occurrence of each alarm in a min-heap.
+ *
+ * The alarm that occurs first is always on top of the heap, i.e. the main loop
+ * only compares a single deadline with the current time. An alarm is never
+ * missed if the loop is stalled: it fires as soon as its deadline is reached.
+ * All times are wall-clock seconds as used by RealTimeClock.
+ */
+class AlarmScheduler
+{
+public:
+
+    static constexpr time_t NO_DEADLINE = std::numeric_limits<time_t>::max();
+
+    /**
+     * @brief Time jumps up to this value (daylight saving time, DCF correction)
+     *        keep the deadlines: alarms skipped by a forward jump fire immediately
+     *        and alarms already fired before a backward jump do not fire again.
+     */
+    static const time_t MAX_CATCH_UP_TIME = 3600;
+
+    /**
+     * @brief Exceptions of the calendar may postpone an alarm by many days.
+     */
+    static const size_t MAX_SEARCH_DAYS = 366;
+
+    AlarmScheduler (const Config & _config, const Calendar & _calendar);
+
+    /**
+     * @brief Recalculates all alarms, for example after the configuration was read.
+     */
+    void reschedule (time_t now);
+
+    /**
+     * @brief Recalculates a single alarm after it was changed.
+     */
+    void update (size_t alarm, time_t now);
+
+    /**
+     * @brief Shall be called when the clock was set.
+     */
+    void onTimeChanged (time_t oldTime, time_t newTime);
+
+    /**
+     * @brief Returns the number of the alarm whose deadline is reached and schedules
+     *        its next occurrence, or Config::ALARMS_NUMBER if no alarm is due.
+     */
+    size_t checkDeadline (time_t now);
+
+    inline time_t getNextAlarmTime () const
+    {
+        return heap[0].deadline;
+    }
+
+    inline size_t getNextAlarm () const
+    {
+        return heap[0].alarm;
+    }
+
+    /**
+     * @brief Returns the seconds until the next alarm or NO_DEADLINE if no alarm is active.
+     */
+    inline time_t timeUntilNextAlarm (time_t now) const
+    {
+        return (heap[0].deadline == NO_DEADLINE)? NO_DEADLINE : heap[0].deadline - now;
+    }
+
+    /**
+     * @brief Returns the first occurrence of the alarm after the given time.
+     */
+    time_t getNextOccurrence (size_t alarm, time_t now) const;
+
+private:
+
+    struct Entry
+    {
+        time_t deadline;
+        size_t alarm;
+    };
+
+    const Config & config;
+    const Calendar & calendar;
+    Entry heap[Config::ALARMS_NUMBER];
+    size_t position[Config::ALARMS_NUMBER]; // heap position of each alarm
+
+    void swap (size_t i, size_t j);
+    void siftUp (size_t i);
+    void siftDown (size_t i);
+};
+
+
+#endif
@@ -0,0 +1,305 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "AlarmSequence.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace StmPlusPlus;
+
+#define USART_DEBUG_MODULE "SEQ: "
+
+/************************************************************************
+ * Class AlarmSequence
+ ************************************************************************/
+
+AlarmSequence::AlarmSequence ():
+    handler(NULL),
+    program(),
+    active(false),
+    stepIndex(0),
+    iteration(0),
+    volume(0),
+    stepStartTime(0),
+    stepEndTime(0),
+    nextEventTime(INFINITY_TIME)
+{
+    // empty
+}
+
+
+void AlarmSequence::start (const Program & _program, time_ms now)
+{
+    program = _program;
+    if (program.stepsNumber == 0 || program.stepsNumber > MAX_STEPS)
+    {
+        return;
+    }
+    active = true;
+    iteration = 0;
+    enterStep(0, now);
+}
+
+
+void AlarmSequence::snooze (time_ms now)
+{
+    if (!active)
+    {
+        return;
+    }
+    for (size_t i = stepIndex + 1; i < program.stepsNumber; ++i)
+    {
+        if (program.steps[i].action == Action::SNOOZE)
+        {
+            USART_DEBUG("Snooze for " << program.steps[i].duration << " sec");
+            enterStep(i, now);
+            return;
+        }
+    }
+    // no snooze step in this iteration: continue with the first one of the next iteration
+    if (iteration + 1 < program.repeat)
+    {
+        for (size_t i = 0; i < program.stepsNumber; ++i)
+        {
+            if (program.steps[i].action == Action::SNOOZE)
+            {
+                USART_DEBUG("Snooze for " << program.steps[i].duration << " sec");
+                ++iteration;
+                enterStep(i, now);
+                return;
+            }
+        }
+    }
+    stop();
+}
+
+
+void AlarmSequence::stop ()
+{
+    if (!active)
+    {
+        return;
+    }
+    active = false;
+    nextEventTime = INFINITY_TIME;
+    USART_DEBUG("Sequence finished");
+    if (handler != NULL)
+    {
+        handler->onSequenceFinished();
+    }
+}
+
+
+bool AlarmSequence::onButtonPressed (bool dismiss, time_ms now)
+{
+    if (!active)
+    {
+        return false;
+    }
+    if (dismiss)
+    {
+        stop();
+    }
+    else if (isRinging())
+    {
+        snooze(now);
+    }
+    return true;
+}
+
+
+void AlarmSequence::periodic (time_ms now)
+{
+    if (!active || now < nextEventTime)
+    {
+        return;
+    }
+
+    if (now >= stepEndTime)
+    {
+        // steps follow each other without gaps, independently of the loop timing
+        size_t next = stepIndex + 1;
+        if (next >= program.stepsNumber)
+        {
+            if (++iteration >= program.repeat)
+            {
+                stop();
+                return;
+            }
+            next = 0;
+        }
+        enterStep(next, stepEndTime);
+        return;
+    }
+
+    // volume ramp
+    const Step & s = program.steps[stepIndex];
+    volume = s.volumeFrom + (int)(s.volumeTo - s.volumeFrom) * (int)(now - stepStartTime) / (int)(stepEndTime - stepStartTime);
+    if (handler != NULL)
+    {
+        handler->onSequenceVolume(volume);
+    }
+    scheduleNextEvent(nextEventTime);
+}
+
+
+void AlarmSequence::enterStep (size_t index, time_ms now)
+{
+    stepIndex = index;
+    const Step & s = program.steps[stepIndex];
+    stepStartTime = now;
+    stepEndTime = now + (time_ms)s.duration * 1000L;
+    volume = s.volumeFrom;
+    scheduleNextEvent(now);
+    if (handler != NULL)
+    {
+        handler->onSequenceOutput(s.action, volume);
+    }
+}
+
+
+void AlarmSequence::scheduleNextEvent (time_ms now)
+{
+    const Step & s = program.steps[stepIndex];
+    nextEventTime = stepEndTime;
+    if (s.action == Action::SOUND && s.volumeFrom != s.volumeTo && now + RAMP_INTERVAL < stepEndTime)
+    {
+        nextEventTime = now + RAMP_INTERVAL;
+    }
+}
+
+
+bool AlarmSequence::parse (const char * str, Program & p)
+{
+    Program result;
+    result.stepsNumber = 0;
+    result.repeat = 1;
+    const char * ptr = str;
+    while (*ptr != 0)
+    {
+        if (*ptr == ' ' || *ptr == ',')
+        {
+            ++ptr;
+            continue;
+        }
+        char type = *ptr++;
+        char * end;
+        if (type == 'x')
+        {
+            long n = ::strtol(ptr, &end, 10);
+            if (end == ptr || n < 1 || n > UINT8_MAX)
+            {
+                return false;
+            }
+            result.repeat = n;
+            ptr = end;
+            continue;
+        }
+        if (result.stepsNumber >= MAX_STEPS)
+        {
+            return false;
+        }
+        Step & s = result.steps[result.stepsNumber];
+        s.volumeFrom = s.volumeTo = 0;
+        if (type == 'P' || type == 'S')
+        {
+            s.action = (type == 'P')? Action::PIEZO : Action::SNOOZE;
+        }
+        else if (type == 'W')
+        {
+            s.action = Action::SOUND;
+            long from = ::strtol(ptr, &end, 10);
+            long to = from;
+            if (end == ptr)
+            {
+                from = to = 100;
+            }
+            else if (*end == '-')
+            {
+                ptr = end + 1;
+                to = ::strtol(ptr, &end, 10);
+                if (end == ptr)
+                {
+                    return false;
+                }
+            }
+            if (*end != '/' || from < 0 || from > 100 || to < 0 || to > 100)
+            {
+                return false;
+            }
+            s.volumeFrom = from;
+            s.volumeTo = to;
+            ptr = end + 1;
+        }
+        else
+        {
+            return false;
+        }
+        long duration = ::strtol(ptr, &end, 10);
+        if (end == ptr || duration < 1 || duration > UINT16_MAX)
+        {
+            return false;
+        }
+        s.duration = duration;
+        ptr = end;
+        ++result.stepsNumber;
+    }
+    if (result.stepsNumber == 0)
+    {
+        return false;
+    }
+    p = result;
+    return true;
+}
+
+
+void AlarmSequence::format (const Program & p, char * dest, size_t length)
+{
+    size_t pos = 0;
+    dest[0] = 0;
+    for (size_t i = 0; i < p.stepsNumber && pos < length; ++i)
+    {
+        const Step & s = p.steps[i];
+        const char * separator = (i == 0)? "" : " ";
+        switch (s.action)
+        {
+        case Action::PIEZO:
+            pos += ::snprintf(dest + pos, length - pos, "%sP%d", separator, s.duration);
+            break;
+        case Action::SNOOZE:
+            pos += ::snprintf(dest + pos, length - pos, "%sS%d", separator, s.duration);
+            break;
+        case Action::SOUND:
+            if (s.volumeFrom == s.volumeTo)
+            {
+                pos += ::snprintf(dest + pos, length - pos, "%sW%d/%d", separator, s.volumeFrom, s.duration);
+            }
+            else
+            {
+                pos += ::snprintf(dest + pos, length - pos, "%sW%d-%d/%d", separator, s.volumeFrom, s.volumeTo, s.duration);
+            }
+            break;
+        }
+    }
+    if (p.repeat > 1 && pos < length)
+    {
+        ::snprintf(dest + pos, length - pos, " x%d", p.repeat);
+    }
+}
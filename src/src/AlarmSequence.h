@@ -0,0 +1,148 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef ALARMSEQUENCE_H_
+#define ALARMSEQUENCE_H_
+
+#include "StmPlusPlus/StmPlusPlus.h"
+
+/**
+ * @brief Class implementing a non-blocking engine that plays an alarm sequence.
+ *
+ * A sequence consists of steps (piezo element, WAV file with a volume ramp or a
+ * silent snooze period) that are repeated a given number of times. Its text
+ * representation is a list of tokens, for example "P10 W20-80/60 S540 x3":
+ *   - P<sec>: piezo element for the given seconds
+ *   - W<from>[-<to>]/<sec>: WAV file whose volume (in percent of the configured
+ *     sound volume) rises from the first to the second value
+ *   - S<sec>: snooze, i.e. silence for the given seconds
+ *   - x<n>: the whole sequence is played n times
+ *
+ * The engine only acts when the next deadline (end of step or next volume
+ * change) is reached.
+ */
+class AlarmSequence
+{
+public:
+
+    static const size_t MAX_STEPS = 6;
+    static const StmPlusPlus::duration_ms RAMP_INTERVAL = 500;
+
+    enum class Action : uint8_t
+    {
+        PIEZO = 0,
+        SOUND = 1,
+        SNOOZE = 2
+    };
+
+    struct Step
+    {
+        Action action;
+        uint8_t volumeFrom;
+        uint8_t volumeTo;
+        uint16_t duration; // in seconds
+    };
+
+    struct Program
+    {
+        Step steps[MAX_STEPS];
+        uint8_t stepsNumber;
+        uint8_t repeat;
+    };
+
+    /**
+     * @brief Interface that is called when the output shall change.
+     */
+    class EventHandler
+    {
+    public:
+
+        /**
+         * @brief A new step starts: the previous output shall be stopped and the
+         *        given one started. SNOOZE means silence.
+         */
+        virtual void onSequenceOutput (Action action, uint8_t volume) =0;
+        virtual void onSequenceVolume (uint8_t volume) =0;
+        virtual void onSequenceFinished () =0;
+    };
+
+    AlarmSequence ();
+
+    inline void setHandler (EventHandler * _handler)
+    {
+        handler = _handler;
+    }
+
+    inline bool isActive () const
+    {
+        return active;
+    }
+
+    /**
+     * @brief The sequence is active and not in a snooze step.
+     */
+    inline bool isRinging () const
+    {
+        return active && program.steps[stepIndex].action != Action::SNOOZE;
+    }
+
+    inline StmPlusPlus::time_ms getNextEventTime () const
+    {
+        return nextEventTime;
+    }
+
+    void start (const Program & _program, StmPlusPlus::time_ms now);
+
+    /**
+     * @brief Continues with the next snooze step or stops the sequence if there
+     *        is no snooze step left.
+     */
+    void snooze (StmPlusPlus::time_ms now);
+
+    void stop ();
+
+    /**
+     * @brief Handles a button press while the sequence is active, also in a
+     *        snooze step: dismiss stops the sequence, any other button snoozes
+     *        it while it rings.
+     *
+     * @return False if the sequence is not active, i.e. the button is not consumed.
+     */
+    bool onButtonPressed (bool dismiss, StmPlusPlus::time_ms now);
+
+    void periodic (StmPlusPlus::time_ms now);
+
+    static bool parse (const char * str, Program & p);
+    static void format (const Program & p, char * dest, size_t length);
+
+private:
+
+    EventHandler * handler;
+    Program program;
+    bool active;
+    size_t stepIndex, iteration;
+    uint8_t volume;
+    StmPlusPlus::time_ms stepStartTime, stepEndTime, nextEventTime;
+
+    void enterStep (size_t index, StmPlusPlus::time_ms now);
+    void scheduleNextEvent (StmPlusPlus::time_ms now);
+};
+
+
+#endif
@@ -0,0 +1,366 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstdio>
+
+#include "Calendar.h"
+
+using namespace StmPlusPlus;
+
+#define USART_DEBUG_MODULE "CAL: "
+
+/************************************************************************
+ * Common functions
+ ************************************************************************/
+
+/**
+ * @brief Converts a date into the number of days since 01.01.1970.
+ */
+static int32_t daysFromCivil (int32_t y, int32_t m, int32_t d)
+{
+    y -= m <= 2;
+    const int32_t era = (y >= 0 ? y : y - 399) / 400;
+    const int32_t yoe = y - era * 400;
+    const int32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+
+/**
+ * @brief Parses a date like "2026-12-25" and moves the pointer behind it.
+ */
+static bool parseDate (const char * & ptr, uint16_t & day)
+{
+    int y, m, d, len = 0;
+    if (::sscanf(ptr, "%4d-%2d-%2d%n", &y, &m, &d, &len) != 3 || len == 0 ||
+        y < 1970 || y > 2099 || m < 1 || m > 12 || d < 1 || d > 31)
+    {
+        return false;
+    }
+    ptr += len;
+    day = daysFromCivil(y, m, d);
+    return true;
+}
+
+
+/************************************************************************
+ * Class Calendar
+ ************************************************************************/
+
+Calendar::Calendar (Devices::SdCard & _sdCard, const char * _sourceName, const char * _indexName):
+    sdCard(_sdCard),
+    sourceName(_sourceName),
+    indexName(_indexName),
+    fileDate(0),
+    fileTime(0),
+    fileSize(0),
+    entriesNumber(0)
+{
+    // empty
+}
+
+
+const Calendar::Entry * Calendar::find (uint16_t day) const
+{
+    Entry key;
+    key.day = day;
+    const Entry * e = std::lower_bound(entries, entries + entriesNumber, key);
+    return (e != entries + entriesNumber && e->day == day)? e : NULL;
+}
+
+
+bool Calendar::isAlarmDay (const Config::Alarm & a, size_t alarm, uint16_t day) const
+{
+    const Entry * e = find(day);
+    const uint8_t bit = 1 << alarm;
+    if (e != NULL && (e->extra & bit))
+    {
+        return true;
+    }
+    if (!a.days[(day + 4) % 7]) // 01.01.1970 was Thursday
+    {
+        return false;
+    }
+    if (a.weeks != Config::WEEKS_ALL && (getIsoWeek(day) % 2 == 1) != (a.weeks == Config::WEEKS_ODD))
+    {
+        return false;
+    }
+    return e == NULL || !((e->skip & bit) || (e->holiday && !a.onHolidays));
+}
+
+
+/**
+ * @brief The ISO week is the week of the year that contains its Thursday.
+ */
+uint16_t Calendar::getIsoWeek (uint16_t day)
+{
+    const int32_t weekDay = (day + 3) % 7; // days since Monday
+    time_t thursday = (time_t)(day - weekDay + 3) * 24 * 3600;
+    return ::gmtime(&thursday)->tm_yday / 7 + 1;
+}
+
+
+bool Calendar::synchronize ()
+{
+    FRESULT res = FR_NOT_READY;
+    if (sdCard.start(6) && sdCard.mountFatFs())
+    {
+        FILINFO info;
+        res = f_stat(sourceName, &info);
+        if (res == FR_NO_FILE)
+        {
+            USART_DEBUG("Calendar file " << sourceName << " not found");
+            entriesNumber = 0;
+            fileDate = fileTime = 0;
+            fileSize = 0;
+            res = FR_OK;
+        }
+        else if (res == FR_OK && (info.fdate != fileDate || info.ftime != fileTime || info.fsize != fileSize))
+        {
+            if (readIndex(info))
+            {
+                USART_DEBUG("Calendar index loaded: " << entriesNumber << " day(s)");
+            }
+            else if ((res = compile(info)) == FR_OK)
+            {
+                USART_DEBUG("Calendar compiled: " << entriesNumber << " day(s)");
+                res = writeIndex();
+            }
+            else
+            {
+                USART_DEBUG("Can not read calendar: " << res);
+                entriesNumber = 0;
+                fileDate = fileTime = 0;
+                fileSize = 0;
+            }
+        }
+        else if (res == FR_OK)
+        {
+            USART_DEBUG("Calendar is up to date");
+        }
+    }
+
+    sdCard.stop();
+    return res == FR_OK;
+}
+
+
+bool Calendar::readIndex (const FILINFO & info)
+{
+    if (f_open(&file, indexName, FA_READ) != FR_OK)
+    {
+        return false;
+    }
+    IndexHeader h;
+    UINT bytesRead = 0;
+    bool valid = f_read(&file, &h, sizeof(h), &bytesRead) == FR_OK && bytesRead == sizeof(h) &&
+        h.magic == INDEX_MAGIC && h.version == INDEX_VERSION && h.entriesNumber <= MAX_ENTRIES &&
+        h.fileDate == info.fdate && h.fileTime == info.ftime && h.fileSize == info.fsize;
+    if (valid)
+    {
+        const UINT size = h.entriesNumber * sizeof(Entry);
+        valid = f_read(&file, entries, size, &bytesRead) == FR_OK && bytesRead == size &&
+            Crc32::calculate(entries, size) == h.crc;
+    }
+    f_close(&file);
+    if (!valid)
+    {
+        USART_DEBUG("Calendar index " << indexName << " is outdated");
+        entriesNumber = 0;
+        return false;
+    }
+    entriesNumber = h.entriesNumber;
+    fileDate = h.fileDate;
+    fileTime = h.fileTime;
+    fileSize = h.fileSize;
+    return true;
+}
+
+
+FRESULT Calendar::writeIndex ()
+{
+    FRESULT code = f_open(&file, indexName, FA_WRITE | FA_CREATE_ALWAYS);
+    if (code != FR_OK)
+    {
+        return code;
+    }
+    const UINT size = entriesNumber * sizeof(Entry);
+    IndexHeader h;
+    h.magic = INDEX_MAGIC;
+    h.version = INDEX_VERSION;
+    h.entriesNumber = entriesNumber;
+    h.fileDate = fileDate;
+    h.fileTime = fileTime;
+    h.fileSize = fileSize;
+    h.crc = Crc32::calculate(entries, size);
+    UINT bytesWritten = 0;
+    code = f_write(&file, &h, sizeof(h), &bytesWritten);
+    if (code == FR_OK && size > 0)
+    {
+        code = f_write(&file, entries, size, &bytesWritten);
+    }
+    f_close(&file);
+    return code;
+}
+
+
+FRESULT Calendar::compile (const FILINFO & info)
+{
+    FRESULT code = f_open(&file, sourceName, FA_READ);
+    if (code != FR_OK)
+    {
+        return code;
+    }
+
+    entriesNumber = 0;
+    TextFileReader in(file);
+    char * line;
+    while ((line = in.readLine()) != NULL)
+    {
+        if (!parseLine(line))
+        {
+            USART_DEBUG("Invalid calendar rule: " << line);
+        }
+    }
+    f_close(&file);
+    compact();
+
+    fileDate = info.fdate;
+    fileTime = info.ftime;
+    fileSize = info.fsize;
+    return in.getResult();
+}
+
+
+/**
+ * @brief Parses a holiday line "date[..date]" or an alarm exception line
+ *        "number +date[..date]" or "number -date[..date]".
+ */
+bool Calendar::parseLine (char * line)
+{
+    const char * ptr = line;
+    while (::isspace(*ptr))
+    {
+        ++ptr;
+    }
+    if (*ptr == 0 || *ptr == '#')
+    {
+        return true;
+    }
+
+    int alarm = -1;
+    char type = 'H';
+    char * end;
+    long n = ::strtol(ptr, &end, 10);
+    if (end != ptr && ::isspace(*end))
+    {
+        // the alarm number is followed by a space, a year by '-'
+        while (::isspace(*end))
+        {
+            ++end;
+        }
+        if (n < 1 || n > (long)Config::ALARMS_NUMBER || (*end != '+' && *end != '-'))
+        {
+            return false;
+        }
+        alarm = n - 1;
+        type = *end;
+        ptr = end + 1;
+    }
+
+    uint16_t first, last;
+    if (!parseDate(ptr, first))
+    {
+        return false;
+    }
+    last = first;
+    if (ptr[0] == '.' && ptr[1] == '.')
+    {
+        ptr += 2;
+        if (!parseDate(ptr, last))
+        {
+            return false;
+        }
+    }
+    while (::isspace(*ptr))
+    {
+        ++ptr;
+    }
+    if (*ptr != 0 && *ptr != '#')
+    {
+        return false;
+    }
+    return addDays(first, last, alarm, type);
+}
+
+
+bool Calendar::addDays (uint16_t first, uint16_t last, int alarm, char type)
+{
+    if (last < first || (size_t)(last - first) >= MAX_RANGE_DAYS)
+    {
+        return false;
+    }
+    for (uint32_t day = first; day <= last; ++day)
+    {
+        if (entriesNumber == MAX_ENTRIES)
+        {
+            compact();
+            if (entriesNumber == MAX_ENTRIES)
+            {
+                USART_DEBUG("Calendar is full");
+                return false;
+            }
+        }
+        Entry & e = entries[entriesNumber++];
+        e.day = day;
+        e.holiday = (type == 'H');
+        e.skip = (type == '-')? (1 << alarm) : 0;
+        e.extra = (type == '+')? (1 << alarm) : 0;
+        e.reserved = 0;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Sorts the entries and merges the rules of equal days.
+ */
+void Calendar::compact ()
+{
+    std::sort(entries, entries + entriesNumber);
+    size_t n = 0;
+    for (size_t i = 0; i < entriesNumber; ++i)
+    {
+        if (n > 0 && entries[n - 1].day == entries[i].day)
+        {
+            entries[n - 1].holiday |= entries[i].holiday;
+            entries[n - 1].skip |= entries[i].skip;
+            entries[n - 1].extra |= entries[i].extra;
+        }
+        else
+        {
+            entries[n++] = entries[i];
+        }
+    }
+    entriesNumber = n;
+}
@@ -0,0 +1,129 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef CALENDAR_H_
+#define CALENDAR_H_
+
+#include "Config.h"
+
+/**
+ * @brief Class providing public holidays and alarm exceptions.
+ *
+ * The rules are given by a text file on the SD card, for example:
+ *
+ *     # public holidays: a date or a range of dates
+ *     2026-12-25
+ *     2026-12-24..2026-12-26
+ *     # alarm exceptions: alarm number, then '-' (alarm does not fire) or
+ *     # '+' (alarm fires additionally) and a date or a range of dates
+ *     1 -2026-11-02
+ *     2 +2026-11-07..2026-11-08
+ *
+ * The file is compiled into an index of days sorted by day number, i.e. a
+ * lookup is a binary search. The index is cached on the card together with
+ * the date, time and size of the text file and only rebuilt when they change.
+ */
+class Calendar
+{
+public:
+
+    static const size_t MAX_ENTRIES = 256;
+    static const size_t MAX_RANGE_DAYS = 62;
+    static const uint32_t INDEX_MAGIC = 0x48494458; // "HIDX"
+    static const uint16_t INDEX_VERSION = 1;
+
+    static_assert(Config::ALARMS_NUMBER <= 8, "Alarm masks do not fit into a byte");
+
+    /**
+     * @brief Rules of a single day. Day numbers are days since 01.01.1970.
+     */
+    struct Entry
+    {
+        uint16_t day;
+        uint8_t holiday;
+        uint8_t skip;  // alarms that do not fire on this day, one bit per alarm
+        uint8_t extra; // alarms that additionally fire on this day
+        uint8_t reserved;
+
+        inline bool operator < (const Entry & e) const
+        {
+            return day < e.day;
+        }
+    };
+
+    /**
+     * @brief Header of the cached index file, followed by the entries.
+     */
+    struct IndexHeader
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t entriesNumber;
+        uint16_t fileDate;
+        uint16_t fileTime;
+        uint32_t fileSize;
+        uint32_t crc; // of the entries
+    };
+
+    Calendar (StmPlusPlus::Devices::SdCard & _sdCard, const char * _sourceName, const char * _indexName);
+
+    inline size_t getEntriesNumber () const
+    {
+        return entriesNumber;
+    }
+
+    /**
+     * @brief Returns the rules of the given day or NULL if there are none.
+     */
+    const Entry * find (uint16_t day) const;
+
+    /**
+     * @brief Decides whether the given alarm fires on the given day.
+     */
+    bool isAlarmDay (const Config::Alarm & a, size_t alarm, uint16_t day) const;
+
+    /**
+     * @brief Loads the index from the cache file or rebuilds it if the rule
+     *        file was changed. The card shall be powered up before.
+     */
+    bool synchronize ();
+
+    static uint16_t getIsoWeek (uint16_t day);
+
+private:
+
+    StmPlusPlus::Devices::SdCard & sdCard;
+    const char * sourceName;
+    const char * indexName;
+    FIL file;
+    uint16_t fileDate, fileTime;
+    uint32_t fileSize;
+    Entry entries[MAX_ENTRIES];
+    size_t entriesNumber;
+
+    bool readIndex (const FILINFO & info);
+    FRESULT writeIndex ();
+    FRESULT compile (const FILINFO & info);
+    bool parseLine (char * line);
+    bool addDays (uint16_t first, uint16_t last, int alarm, char type);
+    void compact ();
+};
+
+
+#endif
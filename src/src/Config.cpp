@@ -17,7 +17,10 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  ******************************************************************************/
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstddef>
+#include <cstdio>
 #include <cctype>
 
 #include <Config.h>
@@ -26,30 +29,33 @@ using namespace StmPlusPlus;
 
 #define USART_DEBUG_MODULE "CONF: "
 
+/************************************************************************
+ * Common functions
+ ************************************************************************/
+
+static char * trim (char * str)
+{
+    while (::isspace(*str))
+    {
+        ++str;
+    }
+    char * end = str + ::strlen(str);
+    while (end > str && ::isspace(*(end - 1)))
+    {
+        --end;
+    }
+    *end = 0;
+    return str;
+}
+
+
 /************************************************************************
  * Class ConfigurationParametes
  ************************************************************************/
 
-const char * CfgParameter::strings[] = {
-    "ALARM1_ACTIVE",
-    "ALARM1_HM",
-    "ALARM1_DAYS",
-    "ALARM1_SOUND",
-    "ALARM2_ACTIVE",
-    "ALARM2_HM",
-    "ALARM2_DAYS",
-    "ALARM2_SOUND",
-    "ALARM3_ACTIVE",
-    "ALARM3_HM",
-    "ALARM3_DAYS",
-    "ALARM3_SOUND",
-    "BRIGH_MANUAL",
-    "BRIGH_MANVAL",
-    "SOUND_VOLUME",
-    "INVALID_PARAMETER"
-};
+constexpr const char * CfgParameter::strings[];
 
-ConvertClass<CfgParameter::Type, CfgParameter::size, CfgParameter::strings>
+ConvertClass<CfgParameter::Type, CfgParameter::size, CfgParameter::strings, CfgParameter::HASH_TABLE_SIZE>
 CfgParameter::Convert;
 
 AsStringClass<CfgParameter::Type, CfgParameter::size, CfgParameter::strings>
@@ -57,117 +63,315 @@ CfgParameter::AsString;
 
 
 /************************************************************************
- * Class Config::Brightness
+ * Schema
  ************************************************************************/
 
-void Config::Brightness::write (FIL* fp, CfgParameter::Type n1, CfgParameter::Type n2) const
+const Config::Field Config::schema[CfgParameter::size] = {
+    // object          type                  offset                           min  max              step
+    { KEY_ALARM,        FieldType::BOOL,      offsetof(Alarm, isActive),       0,   1,               1 }, // ALARM_ACTIVE
+    { KEY_ALARM,        FieldType::HOUR_MIN,  offsetof(Alarm, hour),           0,   2359,            1 }, // ALARM_HM
+    { KEY_ALARM,        FieldType::WEEK_DAYS, offsetof(Alarm, days),           0,   1,               1 }, // ALARM_DAYS
+    { KEY_ALARM,        FieldType::STRING,    offsetof(Alarm, sound),          1,   MAX_LINE_LENGTH, 0 }, // ALARM_SOUND
+    { KEY_ALARM,        FieldType::SEQUENCE,  offsetof(Alarm, sequence),       0,   0,               0 }, // ALARM_SEQ
+    { KEY_ALARM,        FieldType::UINT8,     offsetof(Alarm, weeks),          0,   WEEKS_EVEN,      1 }, // ALARM_WEEKS
+    { KEY_ALARM,        FieldType::BOOL,      offsetof(Alarm, onHolidays),     0,   1,               1 }, // ALARM_HOLIDAYS
+    { KEY_BRIGHTNESS,   FieldType::BOOL,      offsetof(Brightness, isManual),  0,   1,               1 }, // BRIGH_MANUAL
+    { KEY_BRIGHTNESS,   FieldType::UINT8,     offsetof(Brightness, manValue),  0,   100,             1 }, // BRIGH_MANVAL
+    { KEY_BRIGHTNESS,   FieldType::UINT8,     offsetof(Brightness, sunrise),   0,   30,              1 }, // BRIGH_SUNRISE
+    { KEY_DCF,          FieldType::BOOL,      offsetof(Dcf, capture),          0,   1,               1 }, // DCF_CAPTURE
+    { KEY_DCF,          FieldType::BOOL,      offsetof(Dcf, edges),            0,   1,               1 }, // DCF_EDGES
+    { KEY_SOUND_VOLUME, FieldType::UINT32,    0,                               0,   100,             1 }  // SOUND_VOLUME
+};
+
+/**
+ * @brief Replaces the number inside a key like "ALARM2_HM" by the placeholder
+ *        and returns this number, or 0 if the key does not contain a number.
+ */
+static size_t extractKeyNumber (char * key)
 {
-    f_printf(fp, "%s %c %d\n", CfgParameter::AsString(n1), SEPARATOR, isManual);
-    f_printf(fp, "%s %c %d\n", CfgParameter::AsString(n2), SEPARATOR, manValue);
+    char * digits = key;
+    while (*digits != 0 && !::isdigit(*digits))
+    {
+        ++digits;
+    }
+    if (*digits == 0)
+    {
+        return 0;
+    }
+    char * end = digits;
+    size_t number = 0;
+    while (::isdigit(*end))
+    {
+        number = 10 * number + (*end - '0');
+        ++end;
+    }
+    *digits = CfgParameter::NUMBER_PLACEHOLDER;
+    ::memmove(digits + 1, end, ::strlen(end) + 1);
+    return number;
 }
 
 
-void Config::Brightness::read (CfgParameter::Type par, const char * value)
+/**
+ * @brief Converts a decimal number and checks its range.
+ */
+static bool parseNumber (const char * value, int32_t min, int32_t max, int32_t & result)
 {
-    size_t len = ::strlen(value);
-    if (par == CfgParameter::BRIGH_MANUAL && len > 0)
+    char * end;
+    long n = ::strtol(value, &end, 10);
+    if (end == value || *end != 0 || n < min || n > max)
     {
-        isManual = ::atoi(value);
+        return false;
     }
-    else if (par == CfgParameter::BRIGH_MANVAL && len > 0)
+    result = n;
+    return true;
+}
+
+
+/************************************************************************
+ * Class Config
+ ************************************************************************/
+
+// rising sound for a minute, then full volume for four minutes; snooze for nine minutes
+static const char * DEFAULT_SEQUENCE = "W50-100/60 W100/240 S540 x3";
+
+Config::Config (Devices::SdCard & _sdCard, BackupSram & _backupSram, FlashStore & _flashStore, const char * _fileName):
+    fileName(_fileName),
+    sdCard(_sdCard),
+    backupSram(_backupSram),
+    flashStore(_flashStore),
+    fileDate(0),
+    fileTime(0),
+    fileSize(0),
+    isChanged(false),
+    pendingKeys(0),
+    changeTime(0)
+{
+    // working days, starting at 7:00 in steps of 30 minutes
+    for (size_t i = 0; i < ALARMS_NUMBER; ++i)
     {
-        manValue = ::atoi(value);
+        int minutes = 7 * 60 + 30 * i;
+        alarms[i] = {i < 2, (int8_t)((minutes / 60) % 24), (int8_t)(minutes % 60), {false, true, true, true, true, true, false}};
+        alarms[i].weeks = WEEKS_ALL;
+        alarms[i].onHolidays = false;
+        ::snprintf(alarms[i].sound, sizeof(alarms[i].sound), "alarm%d.wav", (int)(i + 1));
+        AlarmSequence::parse(DEFAULT_SEQUENCE, alarms[i].sequence);
     }
+
+    brightness = {true,  20, 0};
+    soundVolume = 25;
+    dcf = {false, false};
+    DcfScheduler::setDefaults(dcfStatistics);
 }
 
 
-void Config::Brightness::dump () const
+bool Config::restoreSnapshot ()
 {
-    USART_DEBUG("  Brightness: manual=" << isManual << ", manual value=" << manValue);
+    const Snapshot * s = static_cast<const Snapshot *>(backupSram.getData());
+    if (s->magic != Snapshot::MAGIC || s->version != Snapshot::VERSION || s->length != sizeof(Snapshot))
+    {
+        USART_DEBUG("Backup SRAM does not contain a configuration snapshot");
+        return false;
+    }
+    if (Crc32::calculate(s, offsetof(Snapshot, crc)) != s->crc)
+    {
+        USART_DEBUG("Configuration snapshot is corrupted");
+        return false;
+    }
+
+    fileDate = s->fileDate;
+    fileTime = s->fileTime;
+    fileSize = s->fileSize;
+    isChanged = s->isChanged;
+    pendingKeys = s->pendingKeys;
+    changeTime = HAL_GetTick();
+    ::memcpy(alarms, s->alarms, sizeof(alarms));
+    brightness = s->brightness;
+    soundVolume = s->soundVolume;
+    dcf = s->dcf;
+    dcfStatistics = s->dcfStatistics;
+    USART_DEBUG("Configuration restored from backup SRAM:");
+    dump();
+    return true;
 }
 
 
-/************************************************************************
- * Class Config::Alarm
- ************************************************************************/
+void Config::restoreFromFlash ()
+{
+    flashStore.readAll(*this);
+    USART_DEBUG("Configuration restored from flash:");
+    dump();
+    storeSnapshot();
+}
+
 
-void Config::Alarm::write (FIL* fp, CfgParameter::Type n1, CfgParameter::Type n2, CfgParameter::Type n3, CfgParameter::Type n4) const
+void Config::onRecord (uint16_t key, const void * data, size_t length)
 {
-    f_printf(fp, "%s %c %d\n",       CfgParameter::AsString(n1), SEPARATOR, isActive);
-    f_printf(fp, "%s %c %02d%02d\n", CfgParameter::AsString(n2), SEPARATOR, hour, min);
-    f_printf(fp, "%s %c ",           CfgParameter::AsString(n3), SEPARATOR);
-    for (auto & d : days)
+    if (key == KEY_FILE_STATE && length == sizeof(FileState))
+    {
+        FileState state;
+        ::memcpy(&state, data, length);
+        fileDate = state.fileDate;
+        fileTime = state.fileTime;
+        fileSize = state.fileSize;
+        isChanged = state.isChanged;
+    }
+    else if (key == KEY_BRIGHTNESS && length == sizeof(Brightness))
+    {
+        ::memcpy(&brightness, data, length);
+    }
+    else if (key == KEY_SOUND_VOLUME && length == sizeof(soundVolume))
+    {
+        ::memcpy(&soundVolume, data, length);
+    }
+    else if (key == KEY_DCF && length == sizeof(Dcf))
     {
-        f_printf(fp, "%d", d);
+        ::memcpy(&dcf, data, length);
+    }
+    else if (key >= KEY_ALARM && key < KEY_ALARM + ALARMS_NUMBER && length == ALARM_SETTINGS_SIZE)
+    {
+        ::memcpy(&alarms[key - KEY_ALARM], data, length);
+    }
+    else if (key >= KEY_ALARM_SOUND && key < KEY_ALARM_SOUND + ALARMS_NUMBER && length <= MAX_LINE_LENGTH + 1)
+    {
+        char * sound = alarms[key - KEY_ALARM_SOUND].sound;
+        ::memcpy(sound, data, length);
+        sound[std::min(length, (size_t)MAX_LINE_LENGTH)] = 0;
+    }
+    else if (key >= KEY_ALARM_SEQUENCE && key < KEY_ALARM_SEQUENCE + ALARMS_NUMBER && length == sizeof(AlarmSequence::Program))
+    {
+        ::memcpy(&alarms[key - KEY_ALARM_SEQUENCE].sequence, data, length);
     }
-    f_printf(fp, "\n");
-    f_printf(fp, "%s %c %s\n", CfgParameter::AsString(n4), SEPARATOR, sound);
 }
 
 
-void Config::Alarm::read (CfgParameter::Type par, const char * value)
+void Config::setChanged (uint16_t key)
 {
-    size_t len = ::strlen(value);
-    if (CfgParameter::isAlarmActivePar(par) && len > 0)
+    if (!isChanged)
     {
-        isActive = ::atoi(value);
+        isChanged = true;
+        pendingKeys |= 1UL << KEY_FILE_STATE;
     }
-    else if (CfgParameter::isAlarmHmPar(par) && len >= 4)
+    pendingKeys |= 1UL << key;
+    changeTime = HAL_GetTick();
+    // the backup SRAM costs nothing: a reset shall not lose the change
+    storeSnapshot();
+}
+
+
+void Config::commit ()
+{
+    if (pendingKeys == 0)
     {
-        char tmp[3] = {0,0,0};
-        ::memcpy(tmp, value + 0, 2);
-        hour = ::atoi(tmp);
-        ::memcpy(tmp, value + 2, 2);
-        min = ::atoi(tmp);
+        return;
     }
-    else if (CfgParameter::isAlarmDaysPar(par) && len >= sizeof(days))
+    for (uint16_t key = 0; key < 32; ++key)
     {
-        char tmp[2] = {0,0};
-        for (size_t i = 0; i < sizeof(days); ++i)
+        if (pendingKeys & (1UL << key))
         {
-            tmp[0] = *(value + i);
-            days[i] = ::atoi(tmp);
+            storeRecord(key);
         }
     }
-    else if (CfgParameter::isAlarmSoundPar(par) && len > 0)
+    pendingKeys = 0;
+    storeSnapshot();
+}
+
+
+void Config::periodic ()
+{
+    if (pendingKeys != 0 && HAL_GetTick() - changeTime >= COMMIT_DELAY)
     {
-        ::strncpy(sound, value, MAX_LINE_LENGTH);
+        commit();
     }
 }
 
 
-void Config::Alarm::dump (const char * name) const
+void Config::storeRecord (uint16_t key)
 {
-    USART_DEBUG("  " << name
-        << ": active=" << isActive
-        << ", hour=" << hour
-        << ", min=" << min
-        << ", days=" << days[0] << days[1] << days[2] << days[3] << days[4] << days[5] << days[6]
-        << ", sound=" << sound);
+    HAL_StatusTypeDef status = HAL_ERROR;
+    if (key == KEY_FILE_STATE)
+    {
+        FileState state;
+        ::memset(&state, 0, sizeof(FileState));
+        state.fileDate = fileDate;
+        state.fileTime = fileTime;
+        state.fileSize = fileSize;
+        state.isChanged = isChanged;
+        status = flashStore.write(key, &state, sizeof(FileState));
+    }
+    else if (key == KEY_BRIGHTNESS)
+    {
+        status = flashStore.write(key, &brightness, sizeof(Brightness));
+    }
+    else if (key == KEY_SOUND_VOLUME)
+    {
+        status = flashStore.write(key, &soundVolume, sizeof(soundVolume));
+    }
+    else if (key == KEY_DCF)
+    {
+        status = flashStore.write(key, &dcf, sizeof(Dcf));
+    }
+    else if (key >= KEY_ALARM && key < KEY_ALARM + ALARMS_NUMBER)
+    {
+        status = flashStore.write(key, &alarms[key - KEY_ALARM], ALARM_SETTINGS_SIZE);
+    }
+    else if (key >= KEY_ALARM_SOUND && key < KEY_ALARM_SOUND + ALARMS_NUMBER)
+    {
+        const char * sound = alarms[key - KEY_ALARM_SOUND].sound;
+        status = flashStore.write(key, sound, ::strlen(sound) + 1);
+    }
+    else if (key >= KEY_ALARM_SEQUENCE && key < KEY_ALARM_SEQUENCE + ALARMS_NUMBER)
+    {
+        status = flashStore.write(key, &alarms[key - KEY_ALARM_SEQUENCE].sequence, sizeof(AlarmSequence::Program));
+    }
+    if (status != HAL_OK)
+    {
+        USART_DEBUG("Can not store record " << key << " into flash: " << status);
+    }
 }
 
 
-/************************************************************************
- * Class Config
- ************************************************************************/
-
-Config::Config (IOPin & _pinSdPower, Devices::SdCard & _sdCard, const char * _fileName):
-    fileName(_fileName),
-    pinSdPower(_pinSdPower),
-    sdCard(_sdCard),
-    isChanged(false)
+void Config::storeAll ()
 {
-    alarms[0] = {true,  7, 00, {false, true, true, true, true, true, false}};
-    ::strncpy(alarms[0].sound, "alarm1.wav", MAX_LINE_LENGTH);
+    storeRecord(KEY_FILE_STATE);
+    storeRecord(KEY_BRIGHTNESS);
+    storeRecord(KEY_SOUND_VOLUME);
+    storeRecord(KEY_DCF);
+    for (size_t i = 0; i < ALARMS_NUMBER; ++i)
+    {
+        storeRecord(KEY_ALARM + i);
+        storeRecord(KEY_ALARM_SOUND + i);
+        storeRecord(KEY_ALARM_SEQUENCE + i);
+    }
+    pendingKeys = 0;
+    storeSnapshot();
+}
+
 
-    alarms[1] = {true,  7, 30, {false, true, true, true, true, true, false}};
-    ::strncpy(alarms[1].sound, "alarm2.wav", MAX_LINE_LENGTH);
+void Config::setDcfStatistics (const DcfScheduler::Statistics & st)
+{
+    dcfStatistics = st;
+    storeSnapshot();
+}
 
-    alarms[2] = {false, 8, 00, {false, true, true, true, true, true, false}};
-    ::strncpy(alarms[2].sound, "alarm3.wav", MAX_LINE_LENGTH);
 
-    brightness = {true,  20};
-    soundVolume = 25;
+void Config::storeSnapshot ()
+{
+    Snapshot * s = static_cast<Snapshot *>(backupSram.getData());
+    ::memset(s, 0, sizeof(Snapshot));
+    s->magic = Snapshot::MAGIC;
+    s->version = Snapshot::VERSION;
+    s->length = sizeof(Snapshot);
+    s->fileDate = fileDate;
+    s->fileTime = fileTime;
+    s->fileSize = fileSize;
+    s->isChanged = isChanged;
+    s->pendingKeys = pendingKeys;
+    ::memcpy(s->alarms, alarms, sizeof(alarms));
+    s->brightness = brightness;
+    s->soundVolume = soundVolume;
+    s->dcf = dcf;
+    s->dcfStatistics = dcfStatistics;
+    s->crc = Crc32::calculate(s, offsetof(Snapshot, crc));
 }
 
 
@@ -184,81 +388,61 @@ bool Config::isAlarmActive () const
 }
 
 
-size_t Config::getAlarmOccured (const ::tm & dayTime) const
-{
-    for (size_t i = 0; i < ALARMS_NUMBER; ++i)
-    {
-        const Alarm & a = alarms[i];
-        if (a.isActive &&
-            a.days[dayTime.tm_wday] &&
-            a.hour == dayTime.tm_hour &&
-            a.min == dayTime.tm_min &&
-            dayTime.tm_sec < 5)
-        {
-            return i;
-        }
-    }
-    return ALARMS_NUMBER;
-}
-
-
 bool Config::writeConfiguration ()
 {
     USART_DEBUG("Writing configuration to file: " << fileName);
 
-    sdCard.clearPort();
-    pinSdPower.setHigh();
-    HAL_Delay(250);
-
+    FRESULT res = FR_NOT_READY;
     if (sdCard.start(6) && sdCard.mountFatFs())
     {
-        FRESULT res = writeFile(fileName);
-        if (res != FR_OK)
-        {
-            USART_DEBUG("Can not write configuration: " << res);
-        }
-        else
-        {
-            USART_DEBUG("Configuration file successfully written");
-            isChanged = false;
-        }
+        res = writeFile(fileName);
     }
 
     sdCard.stop();
-    pinSdPower.setLow();
-    return true;
+    return res == FR_OK;
 }
 
 
-bool Config::readConfiguration ()
+bool Config::synchronize ()
 {
-    USART_DEBUG("Reading configuration from file: " << fileName);
-
-    sdCard.clearPort();
-    pinSdPower.setHigh();
-    HAL_Delay(250);
+    USART_DEBUG("Synchronizing configuration with file: " << fileName);
 
+    FRESULT res = FR_NOT_READY;
     if (sdCard.start(6) && sdCard.mountFatFs())
     {
-        FRESULT res = readFile(fileName);
-        if (res != FR_OK)
+        FILINFO info;
+        res = f_stat(fileName, &info);
+        if (res == FR_OK && (info.fdate != fileDate || info.ftime != fileTime || info.fsize != fileSize))
+        {
+            // the file was modified outside: it has priority over local changes
+            res = readFile(fileName);
+            if (res == FR_OK)
+            {
+                USART_DEBUG("Configuration file successfully imported:");
+                dump();
+                fileDate = info.fdate;
+                fileTime = info.ftime;
+                fileSize = info.fsize;
+                isChanged = false;
+                storeAll();
+            }
+            else
+            {
+                USART_DEBUG("Can not read configuration: " << res);
+            }
+        }
+        else if (res == FR_NO_FILE || isChanged)
         {
-            USART_DEBUG("Can not read configuration: " << res);
+            res = writeFile(fileName);
         }
         else
         {
-            USART_DEBUG("Configuration file successfully parsed:");
-            alarms[0].dump("Alarm1");
-            alarms[1].dump("Alarm2");
-            alarms[2].dump("Alarm3");
-            brightness.dump();
-            isChanged = false;
+            USART_DEBUG("Configuration file is up to date");
         }
     }
 
     sdCard.stop();
-    pinSdPower.setLow();
-    return true;
+    return res == FR_OK;
 }
 
 
@@ -270,14 +454,48 @@ FRESULT Config::writeFile (const char * fileName)
         return code;
     }
 
-    // Alarms
-    alarms[0].write(&cfgFile, CfgParameter::ALARM1_ACTIVE, CfgParameter::ALARM1_HM, CfgParameter::ALARM1_DAYS, CfgParameter::ALARM1_SOUND);
-    alarms[1].write(&cfgFile, CfgParameter::ALARM2_ACTIVE, CfgParameter::ALARM2_HM, CfgParameter::ALARM2_DAYS, CfgParameter::ALARM2_SOUND);
-    alarms[2].write(&cfgFile, CfgParameter::ALARM3_ACTIVE, CfgParameter::ALARM3_HM, CfgParameter::ALARM3_DAYS, CfgParameter::ALARM3_SOUND);
-    brightness.write(&cfgFile, CfgParameter::BRIGH_MANUAL, CfgParameter::BRIGH_MANVAL);
-    f_printf(&cfgFile, "%s %c %d\n", CfgParameter::AsString(CfgParameter::SOUND_VOLUME), SEPARATOR, soundVolume);
+    TextFileWriter out(cfgFile);
+    char key[MAX_LINE_LENGTH + 1], value[MAX_VALUE_LENGTH + 1];
+    for (size_t n = 0; n < ALARMS_NUMBER; ++n)
+    {
+        for (size_t i = 0; i < CfgParameter::size; ++i)
+        {
+            if (schema[i].object == KEY_ALARM)
+            {
+                formatField((CfgParameter::Type)i, n, key, value);
+                out.printf("%s %c %s\n", key, SEPARATOR, value);
+            }
+        }
+    }
+    for (size_t i = 0; i < CfgParameter::size; ++i)
+    {
+        if (schema[i].object != KEY_ALARM)
+        {
+            formatField((CfgParameter::Type)i, 0, key, value);
+            out.printf("%s %c %s\n", key, SEPARATOR, value);
+        }
+    }
+    code = out.flush();
+    USART_DEBUG("Configuration written using " << out.getWriteCalls() << " write operation(s)");
     f_close(&cfgFile);
-    return FR_OK;
+
+    // remember the stamp of the exported file in order to detect outside modifications
+    FILINFO info;
+    if (code == FR_OK && (code = f_stat(fileName, &info)) == FR_OK)
+    {
+        USART_DEBUG("Configuration file successfully written");
+        fileDate = info.fdate;
+        fileTime = info.ftime;
+        fileSize = info.fsize;
+        isChanged = false;
+        storeRecord(KEY_FILE_STATE);
+        storeSnapshot();
+    }
+    else
+    {
+        USART_DEBUG("Can not write configuration: " << code);
+    }
+    return code;
 }
 
 
@@ -289,74 +507,210 @@ FRESULT Config::readFile (const char * fileName)
         return code;
     }
 
-    char buff[MAX_LINE_LENGTH + 1];
-    char name[MAX_LINE_LENGTH + 1];
-    char value[MAX_LINE_LENGTH + 1];
-
-    while (f_gets(buff, MAX_LINE_LENGTH, &cfgFile) != 0)
+    TextFileReader in(cfgFile);
+    char * line;
+    while ((line = in.readLine()) != NULL)
     {
-        ::memset(name, 0, sizeof(name));
-        ::memset(value, 0, sizeof(value));
-        char * ptr = &name[0];
-        for (auto & c : buff)
+        // split the line in-place into trimmed name and value
+        char * value = ::strchr(line, SEPARATOR);
+        if (value == NULL)
         {
-            if (c == 0)
-            {
-                break;
-            }
-            if (::isspace(c))
-            {
-                continue;
-            }
-            if (c == SEPARATOR)
-            {
-                ptr = &value[0];
-                continue;
-            }
-            *ptr = c;
-            ++ptr;
+            continue;
         }
+        *value++ = 0;
+        char * name = trim(line);
+        value = trim(value);
         if (name[0] == 0 || value[0] == 0)
         {
             continue;
         }
 
+        // alarm keys are looked up by their pattern, i.e. the costs do
+        // not depend on the number of alarms
+        size_t number = extractKeyNumber(name);
         CfgParameter::Type par;
-        if (!CfgParameter::Convert(name, par))
+        if (!CfgParameter::Convert(name, par) ||
+            (schema[par].object == KEY_ALARM) != (number > 0) || number > ALARMS_NUMBER)
         {
-            USART_DEBUG("Parameter " << name << " is not known");
+            USART_DEBUG("Parameter " << name << " (" << number << ") is not known");
             continue;
         }
-
-        switch (par)
+        if (!parseField(par, (number > 0)? number - 1 : 0, value))
         {
-        case CfgParameter::ALARM1_ACTIVE:
-        case CfgParameter::ALARM1_HM:
-        case CfgParameter::ALARM1_DAYS:
-        case CfgParameter::ALARM1_SOUND:
-            alarms[0].read(par, value);
-            break;
-        case CfgParameter::ALARM2_ACTIVE:
-        case CfgParameter::ALARM2_HM:
-        case CfgParameter::ALARM2_DAYS:
-        case CfgParameter::ALARM2_SOUND:
-            alarms[1].read(par, value);
-            break;
-        case CfgParameter::ALARM3_ACTIVE:
-        case CfgParameter::ALARM3_HM:
-        case CfgParameter::ALARM3_DAYS:
-        case CfgParameter::ALARM3_SOUND:
-            alarms[2].read(par, value);
-            break;
-        case CfgParameter::BRIGH_MANUAL:
-        case CfgParameter::BRIGH_MANVAL:
-            brightness.read(par, value);
-            break;
-        case CfgParameter::SOUND_VOLUME:
-            soundVolume = ::atoi(value);
-            break;
+            USART_DEBUG("Value " << value << " of parameter " << name << " (" << number << ") is not valid");
         }
     }
+    USART_DEBUG("Configuration read using " << in.getReadCalls() << " read operation(s)");
     f_close(&cfgFile);
-    return FR_OK;
+    return in.getResult();
+}
+
+
+void Config::dump () const
+{
+    char key[MAX_LINE_LENGTH + 1], value[MAX_VALUE_LENGTH + 1];
+    for (size_t n = 0; n < ALARMS_NUMBER; ++n)
+    {
+        for (size_t i = 0; i < CfgParameter::size; ++i)
+        {
+            if (schema[i].object == KEY_ALARM)
+            {
+                formatField((CfgParameter::Type)i, n, key, value);
+                USART_DEBUG("  " << key << " = " << value);
+            }
+        }
+    }
+    for (size_t i = 0; i < CfgParameter::size; ++i)
+    {
+        if (schema[i].object != KEY_ALARM)
+        {
+            formatField((CfgParameter::Type)i, 0, key, value);
+            USART_DEBUG("  " << key << " = " << value);
+        }
+    }
+}
+
+
+uint8_t * Config::getObject (StoreKey object, size_t number)
+{
+    switch (object)
+    {
+    case KEY_ALARM:
+        return reinterpret_cast<uint8_t *>(&alarms[number]);
+    case KEY_BRIGHTNESS:
+        return reinterpret_cast<uint8_t *>(&brightness);
+    case KEY_SOUND_VOLUME:
+        return reinterpret_cast<uint8_t *>(&soundVolume);
+    case KEY_DCF:
+        return reinterpret_cast<uint8_t *>(&dcf);
+    default:
+        return NULL;
+    }
+}
+
+
+/**
+ * @brief Fills the key and the value image of the given parameter. Both
+ *        buffers shall have at least MAX_LINE_LENGTH + 1 and MAX_VALUE_LENGTH + 1
+ *        bytes respectively.
+ */
+void Config::formatField (CfgParameter::Type par, size_t number, char * key, char * value) const
+{
+    const Field & f = schema[par];
+
+    // key: the placeholder is replaced by the alarm number
+    const char * pattern = CfgParameter::AsString(par);
+    const char * placeholder = ::strchr(pattern, CfgParameter::NUMBER_PLACEHOLDER);
+    if (placeholder != NULL)
+    {
+        ::snprintf(key, MAX_LINE_LENGTH + 1, "%.*s%d%s",
+            (int)(placeholder - pattern), pattern, (int)(number + 1), placeholder + 1);
+    }
+    else
+    {
+        ::strncpy(key, pattern, MAX_LINE_LENGTH);
+        key[MAX_LINE_LENGTH] = 0;
+    }
+
+    const uint8_t * data = getObject(f.object, number) + f.offset;
+    switch (f.type)
+    {
+    case FieldType::BOOL:
+        ::snprintf(value, MAX_VALUE_LENGTH + 1, "%d", *reinterpret_cast<const bool *>(data));
+        break;
+    case FieldType::UINT8:
+        ::snprintf(value, MAX_VALUE_LENGTH + 1, "%d", *data);
+        break;
+    case FieldType::UINT32:
+        ::snprintf(value, MAX_VALUE_LENGTH + 1, "%d", (int)*reinterpret_cast<const uint32_t *>(data));
+        break;
+    case FieldType::HOUR_MIN:
+        ::snprintf(value, MAX_VALUE_LENGTH + 1, "%02d%02d", (int8_t)data[0], (int8_t)data[1]);
+        break;
+    case FieldType::WEEK_DAYS:
+        for (size_t i = 0; i < 7; ++i)
+        {
+            value[i] = data[i]? '1' : '0';
+        }
+        value[7] = 0;
+        break;
+    case FieldType::STRING:
+        ::strncpy(value, reinterpret_cast<const char *>(data), MAX_LINE_LENGTH);
+        value[MAX_LINE_LENGTH] = 0;
+        break;
+    case FieldType::SEQUENCE:
+        AlarmSequence::format(*reinterpret_cast<const AlarmSequence::Program *>(data), value, MAX_VALUE_LENGTH + 1);
+        break;
+    }
+}
+
+
+/**
+ * @brief Converts the value image of the given parameter.
+ *
+ * @return False if the image is not valid. In this case, the value is not changed.
+ */
+bool Config::parseField (CfgParameter::Type par, size_t number, const char * value)
+{
+    const Field & f = schema[par];
+    uint8_t * data = getObject(f.object, number) + f.offset;
+    int32_t n;
+    switch (f.type)
+    {
+    case FieldType::BOOL:
+        if (!parseNumber(value, f.min, f.max, n))
+        {
+            return false;
+        }
+        *reinterpret_cast<bool *>(data) = n;
+        return true;
+    case FieldType::UINT8:
+        if (!parseNumber(value, f.min, f.max, n))
+        {
+            return false;
+        }
+        *data = n;
+        return true;
+    case FieldType::UINT32:
+        if (!parseNumber(value, f.min, f.max, n))
+        {
+            return false;
+        }
+        *reinterpret_cast<uint32_t *>(data) = n;
+        return true;
+    case FieldType::HOUR_MIN:
+        {
+            int32_t hm;
+            if (::strlen(value) != 4 || !parseNumber(value, f.min, f.max, hm) || hm % 100 > 59)
+            {
+                return false;
+            }
+            data[0] = hm / 100;
+            data[1] = hm % 100;
+            return true;
+        }
+    case FieldType::WEEK_DAYS:
+        if (::strlen(value) != 7 || ::strspn(value, "01") != 7)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < 7; ++i)
+        {
+            data[i] = value[i] == '1';
+        }
+        return true;
+    case FieldType::STRING:
+        {
+            size_t len = ::strlen(value);
+            if (len < (size_t)f.min || len > (size_t)f.max)
+            {
+                return false;
+            }
+            ::memcpy(data, value, len + 1);
+            return true;
+        }
+    case FieldType::SEQUENCE:
+        return AlarmSequence::parse(value, *reinterpret_cast<AlarmSequence::Program *>(data));
+    }
+    return false;
 }
@@ -20,17 +20,81 @@
 #ifndef CONFIG_H_
 #define CONFIG_H_
 
+#include <cstddef>
 #include <cstring>
 
 #include "StmPlusPlus/Devices/SdCard.h"
+#include "StmPlusPlus/TextFile.h"
+#include "StmPlusPlus/FlashStore.h"
+#include "AlarmSequence.h"
+#include "DcfScheduler.h"
+
+/**
+ * @brief FNV-1a hash of a zero-terminated string, usable at compile time.
+ */
+constexpr uint32_t hashString (const char * str, uint32_t hash = 2166136261U)
+{
+    return (*str == 0)? hash : hashString(str + 1, (hash ^ (uint8_t)*str) * 16777619U);
+}
+
+
+/**
+ * @brief Helpers that build a perfect hash table over a string array at compile time.
+ *
+ * Each slot of the table contains the index of the only string whose hash maps
+ * to this slot, or the number of strings if the slot is free.
+ */
+template <size_t... I> struct IndexSequence {};
+template <size_t N, size_t... I> struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+template <size_t... I> struct MakeIndexSequence<0, I...> : IndexSequence<I...> {};
+
+template <size_t tableSize> struct HashTable
+{
+    uint8_t slots[tableSize];
+};
+
+template <size_t size, const char * const strings[], size_t tableSize>
+constexpr size_t findHashSlotIndex (size_t slot, size_t i = 0)
+{
+    return (i == size)? size :
+        (hashString(strings[i]) % tableSize == slot)? i : findHashSlotIndex<size, strings, tableSize>(slot, i + 1);
+}
+
+template <size_t size, const char * const strings[], size_t tableSize>
+constexpr size_t countHashSlotUsage (size_t slot, size_t i = 0)
+{
+    return (i == size)? 0 :
+        (hashString(strings[i]) % tableSize == slot) + countHashSlotUsage<size, strings, tableSize>(slot, i + 1);
+}
+
+template <size_t size, const char * const strings[], size_t tableSize>
+constexpr bool isHashTablePerfect (size_t slot = 0)
+{
+    return (slot == tableSize) ||
+        (countHashSlotUsage<size, strings, tableSize>(slot) <= 1 && isHashTablePerfect<size, strings, tableSize>(slot + 1));
+}
+
+template <size_t size, const char * const strings[], size_t tableSize, size_t... S>
+constexpr HashTable<tableSize> makeHashTable (IndexSequence<S...>)
+{
+    return HashTable<tableSize> {{ static_cast<uint8_t>(findHashSlotIndex<size, strings, tableSize>(S))... }};
+}
+
 
 /**
  * @brief Template class providing operator () for converting a string argument
  *        to a value of type type T
+ *
+ * The lookup uses a perfect hash table built at compile time, i.e. it does not
+ * depend on the number of strings.
  */
-template <typename T, size_t size, const char * strings[] > class ConvertClass
+template <typename T, size_t size, const char * const strings[], size_t tableSize> class ConvertClass
 {
 public:
+
+    static_assert(size < UINT8_MAX, "Too many strings for the hash table");
+    static_assert(isHashTablePerfect<size, strings, tableSize>(), "Hash collision: change the hash table size");
+
     /**
      * @brief Converts a string to an enumeration literal.
      *
@@ -38,34 +102,40 @@ public:
      */
     bool operator() (const char * image, T& value) const
     {
-        for (size_t i = 0; i < size; ++i)
+        size_t i = table.slots[hashString(image) % tableSize];
+        if (i < size && ::strcmp(image, strings[i]) == 0)
         {
-            if (::strcmp(image, strings[i]) == 0)
-            {
-                // everything's OK:
-                value = static_cast<T>(i);
-                return true;
-            }
+            // everything's OK:
+            value = static_cast<T>(i);
+            return true;
         }
 
         // not found:
         value = static_cast<T>(0);
         return false;
     }
+
+private:
+
+    static constexpr HashTable<tableSize> table =
+        makeHashTable<size, strings, tableSize>(MakeIndexSequence<tableSize>());
 }; // end ConvertClass
 
+template <typename T, size_t size, const char * const strings[], size_t tableSize>
+constexpr HashTable<tableSize> ConvertClass<T, size, strings, tableSize>::table;
+
 
 /**
  * @brief Template class providing operator () for converting type T argument
  *        to a string
  */
-template <typename T, size_t size, const char * strings[] > class AsStringClass
+template <typename T, size_t size, const char * const strings[] > class AsStringClass
 {
 public:
     /**
      * @brief Returns identifier for given enumeration value.
      */
-    const char * & operator() (const T & val) const
+    const char * operator() (const T & val) const
     {
         if (val >= 0 && val < size)
         {
@@ -81,6 +151,10 @@ public:
 
 /**
  * @brief A class providing the enumeration for configuration parameters
+ *
+ * Alarm parameters are key patterns: the placeholder 'n' stands for the
+ * alarm number, i.e. "ALARMn_HM" describes the keys "ALARM1_HM", "ALARM2_HM"
+ * and so on.
  */
 class CfgParameter
 {
@@ -89,87 +163,101 @@ public:
      * @brief Set of valid enumeration values
      */
     enum Type {
-        ALARM1_ACTIVE = 0,
-        ALARM1_HM     = 1,
-        ALARM1_DAYS   = 2,
-        ALARM1_SOUND  = 3,
-        ALARM2_ACTIVE = 4,
-        ALARM2_HM     = 5,
-        ALARM2_DAYS   = 6,
-        ALARM2_SOUND  = 7,
-        ALARM3_ACTIVE = 8,
-        ALARM3_HM     = 9,
-        ALARM3_DAYS   = 10,
-        ALARM3_SOUND  = 11,
-        BRIGH_MANUAL  = 12,
-        BRIGH_MANVAL  = 13,
-        SOUND_VOLUME  = 14
+        ALARM_ACTIVE  = 0,
+        ALARM_HM      = 1,
+        ALARM_DAYS    = 2,
+        ALARM_SOUND   = 3,
+        ALARM_SEQ     = 4,
+        ALARM_WEEKS   = 5,
+        ALARM_HOLIDAYS = 6,
+        BRIGH_MANUAL  = 7,
+        BRIGH_MANVAL  = 8,
+        BRIGH_SUNRISE = 9,
+        DCF_CAPTURE   = 10,
+        DCF_EDGES     = 11,
+        SOUND_VOLUME  = 12
     };
 
     /**
      * @brief Number of enumeration values
      */
     enum {
-        size = 15
+        size = 13
     };
 
+    /**
+     * @brief Placeholder for the alarm number in the key patterns
+     */
+    static const char NUMBER_PLACEHOLDER = 'n';
+
+    /**
+     * @brief Size of the perfect hash table used by Convert()
+     */
+    static const size_t HASH_TABLE_SIZE = 37;
+
     /**
      * @brief String representations of all enumeration values
      */
-    static const char * strings[];
+    static constexpr const char * strings[size + 1] = {
+        "ALARMn_ACTIVE",
+        "ALARMn_HM",
+        "ALARMn_DAYS",
+        "ALARMn_SOUND",
+        "ALARMn_SEQ",
+        "ALARMn_WEEKS",
+        "ALARMn_HOLIDAYS",
+        "BRIGH_MANUAL",
+        "BRIGH_MANVAL",
+        "BRIGH_SUNRISE",
+        "DCF_CAPTURE",
+        "DCF_EDGES",
+        "SOUND_VOLUME",
+        "INVALID_PARAMETER"
+    };
 
     /**
      * @brief the Convert() method
      */
-    static ConvertClass<Type, size, strings> Convert;
+    static ConvertClass<Type, size, strings, HASH_TABLE_SIZE> Convert;
 
     /**
      * @brief the AsString() method
      */
     static AsStringClass<Type, size, strings> AsString;
-
-    static bool isAlarmActivePar (Type t)
-    {
-        return t == ALARM1_ACTIVE || t == ALARM2_ACTIVE || t == ALARM3_ACTIVE;
-    }
-
-    static bool isAlarmHmPar (Type t)
-    {
-        return t == ALARM1_HM || t == ALARM2_HM || t == ALARM3_HM;
-    }
-
-    static bool isAlarmDaysPar (Type t)
-    {
-        return t == ALARM1_DAYS || t == ALARM2_DAYS || t == ALARM3_DAYS;
-    }
-
-    static bool isAlarmSoundPar (Type t)
-    {
-        return t == ALARM1_SOUND || t == ALARM2_SOUND || t == ALARM3_SOUND;
-    }
 };
 
 
 /**
  * @brief A class providing the configuration
  */
-class Config
+class Config : public StmPlusPlus::FlashStore::RecordHandler
 {
 public:
 
     static const char SEPARATOR = '=';
     static const size_t MAX_LINE_LENGTH = 32;
+    static const size_t MAX_VALUE_LENGTH = 64;
     static const size_t ALARMS_NUMBER = 3;
 
+    /**
+     * @brief Time (in milliseconds) without further changes after which the
+     *        changes of the setters are committed.
+     */
+    static const uint32_t COMMIT_DELAY = 10000;
+
     class Brightness
     {
     public:
         bool isManual;
         uint8_t manValue;
+        uint8_t sunrise; // duration of the sunrise before an alarm in minutes, 0 if off
+    };
 
-        void write (FIL* fp, CfgParameter::Type n1, CfgParameter::Type n2) const;
-        void read (CfgParameter::Type par, const char * value);
-        void dump () const;
+    class Dcf
+    {
+    public:
+        bool capture; // raw samples are recorded into the capture file
+        bool edges;   // edges are timestamped by input capture instead of sampling
     };
 
     class Alarm
@@ -179,14 +267,118 @@ public:
         int8_t hour;
         int8_t min;
         bool days[7];
+        uint8_t weeks;   // see Weeks
+        bool onHolidays; // the alarm also fires on public holidays
         char sound[MAX_LINE_LENGTH + 1];
+        AlarmSequence::Program sequence;
+    };
+
+    enum Weeks
+    {
+        WEEKS_ALL = 0,
+        WEEKS_ODD = 1, // odd ISO weeks only
+        WEEKS_EVEN = 2 // even ISO weeks only
+    };
+
+    /**
+     * @brief Keys of the records in the flash store. Each record contains a
+     *        small object. An alarm is split into its settings (the fields in
+     *        front of the sound), its sound and its sequence, so that a setter
+     *        persists only a few bytes.
+     */
+    enum StoreKey
+    {
+        KEY_FILE_STATE = 0,
+        KEY_BRIGHTNESS = 1,
+        KEY_SOUND_VOLUME = 2,
+        KEY_DCF = 3,
+        KEY_ALARM = 16,
+        KEY_ALARM_SOUND = 20,
+        KEY_ALARM_SEQUENCE = 24
+    };
+
+    static const size_t ALARM_SETTINGS_SIZE = offsetof(Alarm, sound);
+
+    enum class FieldType
+    {
+        BOOL,       // "0" or "1"
+        UINT8,      // decimal number within [min, max]
+        UINT32,     // decimal number within [min, max]
+        HOUR_MIN,   // "HHMM", two int8_t values (hour and minute)
+        WEEK_DAYS,  // "0111110", seven bool values starting from Sunday
+        STRING,     // zero-terminated string of at most max characters
+        SEQUENCE    // "W20-80/60 S540 x3", see AlarmSequence::parse
+    };
+
+    /**
+     * @brief Descriptor of a configuration parameter: the object that contains
+     *        the value, the value type, its offset inside the object, its range
+     *        and the increment used by the setting screens. The key pattern is
+     *        given by CfgParameter::AsString().
+     *
+     * The range of a HOUR_MIN value is given as HHMM and its step in minutes.
+     * The range of a WEEK_DAYS value applies to each day.
+     */
+    struct Field
+    {
+        StoreKey object;
+        FieldType type;
+        uint8_t offset;
+        int32_t min, max, step;
+    };
+
+    /**
+     * @brief Schema of the configuration, indexed by CfgParameter::Type
+     */
+    static const Field schema[CfgParameter::size];
+
+    /**
+     * @brief Binary image of the configuration kept in the backup SRAM.
+     *
+     * The version shall be incremented each time the layout changes: an image
+     * with an unknown version is ignored.
+     */
+    struct Snapshot
+    {
+        static const uint32_t MAGIC = 0x44434647; // "DCFG"
+        static const uint16_t VERSION = 8;
+
+        uint32_t magic;
+        uint16_t version;
+        uint16_t length;
+
+        // Date, time and size of the configuration file at the last import/export
+        uint16_t fileDate;
+        uint16_t fileTime;
+        uint32_t fileSize;
+
+        // Changes are not yet exported into the configuration file
+        bool isChanged;
+
+        // Keys of the flash records that are not yet committed
+        uint32_t pendingKeys;
+
+        Alarm alarms[ALARMS_NUMBER];
+        Brightness brightness;
+        uint32_t soundVolume;
+        Dcf dcf;
+
+        // Learned reception statistics, not part of the configuration file
+        DcfScheduler::Statistics dcfStatistics;
 
-        void write (FIL* fp, CfgParameter::Type n1, CfgParameter::Type n2, CfgParameter::Type n3, CfgParameter::Type n4) const;
-        void read (CfgParameter::Type par, const char * value);
-        void dump (const char * name) const;
+        uint32_t crc;
     };
 
-    Config (StmPlusPlus::IOPin & _pinSdPower, StmPlusPlus::Devices::SdCard & _sdCard, const char * _fileName);
+    static_assert(sizeof(Snapshot) <= StmPlusPlus::BackupSram::SIZE, "Snapshot does not fit into the backup SRAM");
+
+    static_assert(KEY_ALARM + ALARMS_NUMBER <= KEY_ALARM_SOUND && KEY_ALARM_SOUND + ALARMS_NUMBER <= KEY_ALARM_SEQUENCE,
+                  "Too many alarms for the key ranges");
+    static_assert(KEY_ALARM_SEQUENCE + ALARMS_NUMBER <= StmPlusPlus::FlashStore::MAX_KEYS, "Too many alarms for the flash store");
+    static_assert(KEY_ALARM_SEQUENCE + ALARMS_NUMBER <= 32, "Too many keys for the mask of pending changes");
+    static_assert(sizeof(AlarmSequence::Program) <= StmPlusPlus::FlashStore::MAX_LENGTH, "Sequence does not fit into a flash record");
+
+    Config (StmPlusPlus::Devices::SdCard & _sdCard, StmPlusPlus::BackupSram & _backupSram,
+            StmPlusPlus::FlashStore & _flashStore, const char * _fileName);
 
     inline const Brightness & getBrightness () const
     {
@@ -196,13 +388,13 @@ public:
     inline void setBrightnessManual (bool m)
     {
         brightness.isManual = m;
-        isChanged = true;
+        setChanged(KEY_BRIGHTNESS);
     }
 
     inline void setBrightnessManValue (uint8_t m)
     {
         brightness.manValue = m;
-        isChanged = true;
+        setChanged(KEY_BRIGHTNESS);
     }
 
     inline const Alarm & getAlarm (size_t number) const
@@ -213,25 +405,25 @@ public:
     inline void setAlarmActive (size_t number, bool m)
     {
         alarms[number].isActive = m;
-        isChanged = true;
+        setChanged(KEY_ALARM + number);
     }
 
     inline void setAlarmHour (size_t number, int8_t m)
     {
         alarms[number].hour = m;
-        isChanged = true;
+        setChanged(KEY_ALARM + number);
     }
 
     inline void setAlarmMin (size_t number, int8_t m)
     {
         alarms[number].min = m;
-        isChanged = true;
+        setChanged(KEY_ALARM + number);
     }
 
     inline void setAlarmDay (size_t number, size_t day, int8_t m)
     {
         alarms[number].days[day] = m;
-        isChanged = true;
+        setChanged(KEY_ALARM + number);
     }
 
     uint32_t getSoundVolume() const
@@ -239,35 +431,133 @@ public:
         return soundVolume;
     }
 
-    inline void flush ()
+    inline const Dcf & getDcf () const
     {
-        if (isChanged)
-        {
-            writeConfiguration();
-        }
+        return dcf;
     }
 
+    inline const DcfScheduler::Statistics & getDcfStatistics () const
+    {
+        return dcfStatistics;
+    }
+
+    /**
+     * @brief Keeps the statistics of the DCF scheduler in the backup SRAM. They
+     *        are no configuration, i.e. neither the flash store nor the file is written.
+     */
+    void setDcfStatistics (const DcfScheduler::Statistics & s);
+
+    inline bool hasChanges () const
+    {
+        return isChanged;
+    }
+
+    /**
+     * @brief Returns true if changes of the setters are not yet committed.
+     */
+    inline bool hasPendingChanges () const
+    {
+        return pendingKeys != 0;
+    }
+
+    /**
+     * @brief Writes the objects changed by the setters into the flash store. The
+     *        setters update the backup SRAM at once but only collect the changes
+     *        for the flash, i.e. a series of button presses results in a single
+     *        record per object.
+     */
+    void commit ();
+
+    /**
+     * @brief Commits the changes COMMIT_DELAY after the last one. Shall be called
+     *        from the main loop.
+     */
+    void periodic ();
+
+    /**
+     * @brief Loads the configuration from the backup SRAM. Changes that were not
+     *        yet committed into the flash store are committed COMMIT_DELAY later.
+     *
+     * @return False if the backup SRAM does not contain a valid snapshot.
+     *         In this case, the default configuration is used.
+     */
+    bool restoreSnapshot ();
+
+    /**
+     * @brief Loads the configuration from the flash store. Used if the
+     *        backup SRAM lost its content.
+     */
+    void restoreFromFlash ();
+
+    virtual void onRecord (uint16_t key, const void * data, size_t length);
+
     bool isAlarmActive () const;
-    size_t getAlarmOccured (const ::tm & dayTime) const;
+
+    /**
+     * @brief Exports the configuration into the configuration file.
+     *
+     * The card shall be powered up (see SdCard::powerOn) before.
+     */
     bool writeConfiguration ();
-    bool readConfiguration ();
+
+    /**
+     * @brief Reconciles the configuration with the configuration file.
+     *
+     * The file is only parsed if it was modified outside since the last
+     * import/export. Otherwise, pending changes are exported if any.
+     * The card shall be powered up (see SdCard::powerOn) before.
+     */
+    bool synchronize ();
 
 private:
 
     // File handling
     const char * fileName;
     FIL cfgFile;
-    StmPlusPlus::IOPin & pinSdPower;
     StmPlusPlus::Devices::SdCard & sdCard;
+    StmPlusPlus::BackupSram & backupSram;
+    StmPlusPlus::FlashStore & flashStore;
+    uint16_t fileDate, fileTime;
+    uint32_t fileSize;
 
     // Data containers
     bool isChanged;
+    uint32_t pendingKeys;
+    uint32_t changeTime;
     Alarm alarms[ALARMS_NUMBER];
     Brightness brightness;
     uint32_t soundVolume;
+    Dcf dcf;
+    DcfScheduler::Statistics dcfStatistics;
+
+    /**
+     * @brief State of the configuration file as stored in the flash store
+     */
+    struct FileState
+    {
+        uint16_t fileDate;
+        uint16_t fileTime;
+        uint32_t fileSize;
+        bool isChanged;
+    };
 
+    void setChanged (uint16_t key);
+    void storeSnapshot ();
+    void storeRecord (uint16_t key);
+    void storeAll ();
     FRESULT writeFile (const char * fileName);
     FRESULT readFile (const char * fileName);
+    void dump () const;
+
+    uint8_t * getObject (StoreKey object, size_t number);
+
+    inline const uint8_t * getObject (StoreKey object, size_t number) const
+    {
+        return const_cast<Config *>(this)->getObject(object, number);
+    }
+
+    void formatField (CfgParameter::Type par, size_t number, char * key, char * value) const;
+    bool parseField (CfgParameter::Type par, size_t number, const char * value);
 };
 
 
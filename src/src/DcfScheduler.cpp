@@ -0,0 +1,125 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "DcfScheduler.h"
+
+#include <algorithm>
+
+using namespace StmPlusPlus;
+
+#define USART_DEBUG_MODULE "DCFS: "
+
+/************************************************************************
+ * Class DcfScheduler
+ ************************************************************************/
+
+DcfScheduler::DcfScheduler (const DriftEstimator & _driftEstimator):
+    driftEstimator(_driftEstimator),
+    nextCheckTime(0),
+    windowActive(false),
+    windowHour(0),
+    windowStart(0),
+    windowBudget(0),
+    onTime(0)
+{
+    setDefaults(stats);
+}
+
+
+void DcfScheduler::setDefaults (Statistics & s)
+{
+    for (size_t h = 0; h < HOURS_NUMBER; ++h)
+    {
+        s.hours[h].successRate = (h < 6 || h >= 22)? NIGHT_RATE : DAY_RATE;
+        s.hours[h].duration = DEFAULT_DURATION;
+    }
+}
+
+
+bool DcfScheduler::isWindowDue (time_t now)
+{
+    // the check time is also recalculated if the clock was set back
+    if (windowActive || (now < nextCheckTime && nextCheckTime <= now + HOUR))
+    {
+        return false;
+    }
+    nextCheckTime = (now / HOUR + 1) * HOUR;
+
+    // number of hours before the predicted error exceeds the limit
+    size_t hoursLeft = 0;
+    while (hoursLeft <= HOURS_NUMBER && driftEstimator.getPredictedError(now + hoursLeft * HOUR) <= MAX_ERROR)
+    {
+        ++hoursLeft;
+    }
+    if (hoursLeft > HOURS_NUMBER)
+    {
+        return false;
+    }
+
+    // wait for a better hour if it comes in time
+    const size_t hour = getHour(now);
+    for (size_t i = 1; i < hoursLeft; ++i)
+    {
+        if (stats.hours[(hour + i) % HOURS_NUMBER].successRate > stats.hours[hour].successRate)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void DcfScheduler::onWindowStarted (time_t now)
+{
+    windowActive = true;
+    windowHour = getHour(now);
+    nextCheckTime = (now / HOUR + 1) * HOUR;
+    windowStart = now;
+    if (driftEstimator.getPredictedError(now) > MAX_ERROR)
+    {
+        windowBudget = MAX_BUDGET;
+    }
+    else
+    {
+        windowBudget = std::max(MIN_BUDGET, std::min(MAX_BUDGET, (time_t)(3 * stats.hours[windowHour].duration)));
+    }
+    USART_DEBUG("Window started, hour = " << windowHour << ", budget = " << windowBudget << " sec");
+}
+
+
+void DcfScheduler::onWindowFinished (time_t duration, bool success)
+{
+    if (!windowActive)
+    {
+        return;
+    }
+    windowActive = false;
+    onTime += duration;
+
+    // moving averages with the weight of 1/4
+    HourStat & s = stats.hours[windowHour];
+    const int target = success? 255 : 0;
+    s.successRate = (uint8_t)((3 * (int)s.successRate + target + 2) / 4);
+    if (success)
+    {
+        s.duration = (uint16_t)((3 * (time_t)s.duration + std::min(duration, MAX_BUDGET) + 2) / 4);
+    }
+    USART_DEBUG("Window finished, hour = " << windowHour << ", success = " << success
+                << ", rate = " << (int)s.successRate << ", duration = " << s.duration);
+}
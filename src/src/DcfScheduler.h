@@ -0,0 +1,137 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef DCFSCHEDULER_H_
+#define DCFSCHEDULER_H_
+
+#include "DriftEstimator.h"
+
+/**
+ * @brief Class that decides when the DCF receiver is switched on.
+ *
+ * The reception windows start at full hours. For each hour of the day, the
+ * scheduler keeps a moving average of the success rate and the duration of the
+ * acquisition. A window is skipped if the predicted error of the RTC stays within
+ * MAX_ERROR for the next day, since the same hour comes again before the error
+ * is too large. Otherwise, the window starts if no hour with a better success
+ * rate remains before the predicted error exceeds MAX_ERROR. Each window is
+ * limited by a budget derived from the mean duration at its hour. All times are
+ * wall-clock seconds as used by RealTimeClock.
+ */
+class DcfScheduler
+{
+public:
+
+    static const size_t HOURS_NUMBER = 24;
+    static const time_t HOUR = 3600;
+    static const StmPlusPlus::duration_ms MAX_ERROR = 500;
+    static const time_t MIN_BUDGET = 600;
+    static const time_t MAX_BUDGET = 1800;
+    static const time_t DEFAULT_DURATION = 300;
+
+    /**
+     * @brief Initial success rate of day and night hours. The long wave
+     *        propagation is usually better at night.
+     */
+    static const uint8_t DAY_RATE = 128;
+    static const uint8_t NIGHT_RATE = 160;
+
+    struct HourStat
+    {
+        uint8_t successRate; // 0..255
+        uint16_t duration; // mean duration of successful windows, in seconds
+    };
+
+    /**
+     * @brief Learned statistics of all hours, kept in the backup SRAM by Config.
+     */
+    struct Statistics
+    {
+        HourStat hours[HOURS_NUMBER];
+    };
+
+    DcfScheduler (const DriftEstimator & _driftEstimator);
+
+    /**
+     * @brief Fills the statistics with the initial values of day and night hours.
+     */
+    static void setDefaults (Statistics & s);
+
+    inline const Statistics & getStatistics () const
+    {
+        return stats;
+    }
+
+    inline void setStatistics (const Statistics & s)
+    {
+        stats = s;
+    }
+
+    inline bool isWindowActive () const
+    {
+        return windowActive;
+    }
+
+    /**
+     * @brief Returns true if a window shall be started now. Shall be called at
+     *        least once per minute while no window is active.
+     */
+    bool isWindowDue (time_t now);
+
+    /**
+     * @brief Opens a window, its budget depends on the hour and the predicted error.
+     */
+    void onWindowStarted (time_t now);
+
+    inline bool isBudgetExhausted (time_t now) const
+    {
+        return windowActive && now >= windowStart + windowBudget;
+    }
+
+    /**
+     * @brief Closes the window and updates the statistics of its hour.
+     */
+    void onWindowFinished (time_t duration, bool success);
+
+    /**
+     * @brief Returns the total receiver on-time of all finished windows in seconds.
+     */
+    inline time_t getOnTime () const
+    {
+        return onTime;
+    }
+
+private:
+
+    const DriftEstimator & driftEstimator;
+    Statistics stats;
+    time_t nextCheckTime;
+    bool windowActive;
+    size_t windowHour;
+    time_t windowStart, windowBudget;
+    time_t onTime;
+
+    static inline size_t getHour (time_t t)
+    {
+        return (size_t)((t / HOUR) % HOURS_NUMBER);
+    }
+};
+
+
+#endif
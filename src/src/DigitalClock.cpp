@@ -35,7 +35,7 @@ DigitalClock::DigitalClock ():
     // HMI
     pinHmiPower(IOPort::C, GPIO_PIN_3, GPIO_MODE_OUTPUT_PP, GPIO_PULLDOWN, GPIO_SPEED_HIGH, true, false),
     eventLedToggle(rtc, 500, 1),
-    eventSecToggle(rtc, 1000),
+    displayedTime(0),
     spiHmi(Spi::SPI_2,
         /*sckPort =  */ IOPort::B, GPIO_PIN_13,
         /*misoPort = */ IOPort::B, GPIO_PIN_14,
@@ -54,15 +54,23 @@ DigitalClock::DigitalClock ():
     // DAC
     pinHmiBrightnessCs(IOPort::B, GPIO_PIN_11, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP, GPIO_SPEED_HIGH, true, true),
     hmiBrightness(spiHmi, pinHmiBrightnessCs, Devices::Dac_MCP49x1::Resolution::BIT_12, 2500, 3000),
+    sunrise(hmiBrightness),
+    sunriseAlarmTime(0),
     adcBrightness(IOPort::A, GPIO_PIN_0, AnalogToDigitConverter::DeviceName::ADC_2, ADC_CHANNEL_0, MAIN_VOLTAGE),
 
     // DCF
     pinDcfInput(IOPort::A, GPIO_PIN_3, GPIO_MODE_INPUT, GPIO_NOPULL),
     pinDcfPower(IOPort::A, GPIO_PIN_2, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP),
     dcf(rtc, pinDcfInput, pinDcfPower, Timer::TIM_4, TIM4_IRQn),
+    dcfEdges(pinDcfInput, GPIO_AF2_TIM5, Timer::TIM_5, TIM5_IRQn, TIM_CHANNEL_4),
+    dcfRecorder(rtc),
     dcfState(DcfState::NONE),
     dcfReceiverStartTime(0),
     dcfTimeReceived(false),
+    dcfSummerTime(false),
+    dcfStepPending(false),
+    dcfStepError(0),
+    dcfScheduler(driftEstimator),
 
     // SD card
     pinSdPower(IOPort::A, GPIO_PIN_10, GPIO_MODE_OUTPUT_PP, GPIO_PULLDOWN, GPIO_SPEED_HIGH, true, false),
@@ -79,11 +87,15 @@ DigitalClock::DigitalClock ():
             /* speed    = */ GPIO_SPEED_FREQ_VERY_HIGH,
             /* pin      = */ GPIO_PIN_2,
             /* callInit = */ false),
-    sdCard(pinSdDetect, portSd1, portSd2),
-    sdCardInserted(false),
+    sdCard(pinSdDetect, pinSdPower, portSd1, portSd2),
+    sdJobs(0),
+    sdLogFirst(0),
+    sdLogCount(0),
 
     // Configuration
-    config(pinSdPower, sdCard, "conf.txt"),
+    flashStore({FLASH_SECTOR_10, 0x080C0000, 0x20000}, {FLASH_SECTOR_11, 0x080E0000, 0x20000}),
+    config(sdCard, backupSram, flashStore, "conf.txt"),
+    calendar(sdCard, "holidays.txt", "holidays.bin"),
 
     // Sound
     pinAmpPower(IOPort::B, GPIO_PIN_0, GPIO_MODE_OUTPUT_PP, GPIO_PULLDOWN, GPIO_SPEED_HIGH, true, false),
@@ -97,6 +109,11 @@ DigitalClock::DigitalClock ():
     pinRightChannel(IOPort::C, GPIO_PIN_5, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP),
     pinWavSample(IOPort::A, GPIO_PIN_11, GPIO_MODE_OUTPUT_PP, GPIO_PULLDOWN),
     wavStreamer(sdCard, spiWav, pinLeftChannel, pinRightChannel, Timer::TIM_3, TIM3_IRQn),
+    wavAlarmNumber(0),
+    wavAlarmTime(0),
+    wavTriggered(false),
+    wavLatencyPending(false),
+    ampPowerTime(0),
 
     // Piezo element
     piezoAlarm(IOPort::C, GPIO_PIN_2, rtc),
@@ -117,9 +134,10 @@ DigitalClock::DigitalClock ():
     returnToHome(rtc, 30000, 1),
 
     // Alarms
-    alarmSetting1(0, config),
-    alarmSetting2(1, config),
-    alarmSetting3(2, config),
+    alarmSetting(config),
+    alarmScheduler(config, calendar),
+    alarmSequence(),
+    activeAlarm(0),
 
     // Temperature
     adcTemperature(IOPort::A, GPIO_PIN_1, AnalogToDigitConverter::DeviceName::ADC_1, ADC_CHANNEL_1, MAIN_VOLTAGE),
@@ -154,13 +172,10 @@ DigitalClock::DigitalClock ():
     screens[SCR_HOME] = &homeScreen;
     screens[SCR_TIME_SETTING] = &timeSetting;
     screens[SCR_BRIGHTNESS] = &brightnessSetting;
-    screens[SCR_ALARM1] = &alarmSetting1;
-    screens[SCR_ALARM2] = &alarmSetting2;
-    screens[SCR_ALARM3] = &alarmSetting3;
-
-    alarms[0] = &alarmSetting1;
-    alarms[1] = &alarmSetting2;
-    alarms[2] = &alarmSetting3;
+    for (size_t i = 0; i < Config::ALARMS_NUMBER; ++i)
+    {
+        screens[SCR_ALARM + i] = &alarmSetting;
+    }
 
     dayTime.tm_sec  = 0;
     dayTime.tm_min  = 0;
@@ -178,6 +193,22 @@ void DigitalClock::run ()
     USART_DEBUG("Oscillator frequency: " << System::getExternalOscillatorFreq()
         << ", MCU frequency: " << System::getMcuFreq());
 
+    // the snapshot makes the configuration valid before the SD card is accessed,
+    // the flash store is only used if the backup SRAM lost its content
+    bool flashValid = flashStore.start() == HAL_OK;
+    if (backupSram.start() != HAL_OK || !config.restoreSnapshot())
+    {
+        if (flashValid)
+        {
+            config.restoreFromFlash();
+        }
+        else
+        {
+            USART_DEBUG("Using default configuration");
+        }
+    }
+    dcfScheduler.setStatistics(config.getDcfStatistics());
+
     pinHmiPower.setHigh();
     HAL_Delay(100);
 
@@ -196,11 +227,12 @@ void DigitalClock::run ()
     sdCard.initInstance();
     wavStreamer.setTestPin(&pinWavSample);
     wavStreamer.setHandler(this);
+    alarmSequence.setHandler(this);
 
-    sdCardInserted = sdCard.isCardInserted();
-    if (sdCardInserted)
+    sdCard.startDetection(EXTI15_10_IRQn, irqPrioSd, this);
+    if (sdCard.isCardInserted())
     {
-        config.readConfiguration();
+        requestSdJob(SD_JOB_SYNC_CONFIG);
     }
 
     adcTemperature.start();
@@ -208,10 +240,10 @@ void DigitalClock::run ()
 
     rtcToDayTime();
     setTime();
-    rtc.start(8*2047 + 7, RTC_WAKEUPCLOCK_RTCCLK_DIV2, irqPrioRtc, NULL);
+    rtc.start(8*2047 + 7, RTC_WAKEUPCLOCK_RTCCLK_DIV2, irqPrioRtc, this);
+    alarmScheduler.reschedule(rtc.getTimeSec());
 
-    dcfReceiverStartTime = 0;
-    dcf.start(irqPrioDcf, this);
+    startDcfReceiver();
 
     piezoAlarm.start(1);
 
@@ -224,32 +256,79 @@ void DigitalClock::run ()
 
 void DigitalClock::periodic ()
 {
+    sdCard.periodic();
     wavStreamer.periodic();
+    processSdJobs();
     dcf.periodic();
+    if (!(sdJobs & SD_JOB_WRITE_CAPTURE) && sdCard.isCardInserted() &&
+        (dcfRecorder.isFlushRequired() || (!dcf.isActive() && dcfRecorder.getReadyBlocks() > 0)))
+    {
+        requestSdJob(SD_JOB_WRITE_CAPTURE);
+    }
     piezoAlarm.periodic();
+    alarmSequence.periodic(rtc.getMonotonicMillisec());
+    sunrise.periodic(rtc.getTimeMillisec());
     for (auto & b : buttons)
     {
         b->periodic();
     }
-    if (eventSecToggle.isOccured())
+    time_t now = rtc.getTimeSec();
+    size_t alarmNumber = alarmScheduler.checkDeadline(now);
+    if (alarmNumber < Config::ALARMS_NUMBER)
+    {
+        startAlarm(alarmNumber);
+    }
+    if (alarmScheduler.timeUntilNextAlarm(now) <= ALARM_PREWARM_TIME &&
+        wavAlarmTime != alarmScheduler.getNextAlarmTime())
+    {
+        // only a sequence that starts with the sound can be pre-warmed
+        const AlarmSequence::Step & first = config.getAlarm(alarmScheduler.getNextAlarm()).sequence.steps[0];
+        if (first.action == AlarmSequence::Action::SOUND)
+        {
+            setAlarmVolume(first.volumeFrom);
+            prepareAlarm(alarmScheduler.getNextAlarm(), alarmScheduler.getNextAlarmTime());
+        }
+        else
+        {
+            wavAlarmTime = alarmScheduler.getNextAlarmTime();
+        }
+    }
+    updateSunrise(now);
+    triggerAlarmSound();
+    config.periodic();
+    // the erase stalls the CPU, so it is done while nobody waits for the clock
+    if (!flashStore.isSpareErased() && isIdle(now))
     {
+        flashStore.eraseSpare();
+    }
+    if (wavLatencyPending && wavStreamer.isPlaying())
+    {
+        wavLatencyPending = false;
+        time_ms startTime = rtc.getTimeMillisec() - (HAL_GetTick() - wavStreamer.getStartTick());
+        char logLine[64];
+        ::snprintf(logLine, sizeof(logLine), "Alarm %d: start latency = %d ms",
+                (int)(wavAlarmNumber + 1), (int)((duration_ms)startTime - (duration_ms)wavAlarmTime * 1000L));
+        USART_DEBUG(logLine);
+        writeLogToSd(logLine);
+    }
+    // the display follows the seconds of the wall clock
+    if (now != displayedTime)
+    {
+        displayedTime = now;
         eventLedToggle.resetTime();
         activeElementToggle.resetTime();
-        updateSdCardState();
         updateLoggingState();
         measureTemperature();
         updateBrightness();
         updateLcd(true);
         updateSsd();
-        size_t alarmNumber = config.getAlarmOccured(dayTime);
-        if (alarmNumber < Config::ALARMS_NUMBER)
+        if (!dcf.isActive() && dcfScheduler.isWindowDue(now))
         {
-            startAlarm(alarmNumber);
+            startDcfReceiver();
         }
-        if (dayTime.tm_hour == 3 && dayTime.tm_min == 0 && !dcf.isActive())
+        else if (dcf.isActive() && dcfScheduler.isBudgetExhausted(now))
         {
-            dcfReceiverStartTime = rtc.getTimeSec();
-            dcf.start(irqPrioDcf, this);
+            stopDcfReceiver();
         }
     }
     else if (eventLedToggle.isOccured())
@@ -274,34 +353,41 @@ void DigitalClock::periodic ()
 }
 
 
-void DigitalClock::resetEventTime ()
+bool DigitalClock::isIdle (time_t now)
 {
-    for (auto & b : buttons)
-    {
-        b->resetTime();
-    }
-    eventSecToggle.resetTime();
-    eventLedToggle.resetTime();
-    activeElementToggle.resetTime();
+    return activeScreen == SCR_HOME && !config.hasPendingChanges() && sdJobs == 0 &&
+           !dcf.isActive() && !alarmSequence.isRinging() && !sunrise.isActive() &&
+           alarmScheduler.timeUntilNextAlarm(now) > FLASH_ERASE_MARGIN;
 }
 
 
-void DigitalClock::setScreen (ScreenType scr)
+void DigitalClock::setScreen (size_t scr)
 {
+    // the changes made on the screen being left are persisted at once
+    config.commit();
     activeScreen = scr;
+    if (activeScreen >= SCR_ALARM)
+    {
+        alarmSetting.setNumber(activeScreen - SCR_ALARM);
+    }
     screens[activeScreen]->setFirst();
     activeElementVisible = activeScreen != SCR_HOME;
     lcd.clear();
     updateLcd(false);
-    if (activeScreen == SCR_HOME)
+    if (activeScreen == SCR_HOME && config.hasChanges())
     {
-        config.flush();
+        requestSdJob(SD_JOB_WRITE_CONFIG);
     }
 }
 
 
 void DigitalClock::updateBrightness ()
 {
+    if (sunrise.isActive())
+    {
+        // the sunrise owns the display light
+        return;
+    }
     if (config.getBrightness().isManual)
     {
         hmiBrightness.putValue(config.getBrightness().manValue);
@@ -351,6 +437,7 @@ void DigitalClock::modifyActiveElement (int s)
         case SCR_TIME_SETTING:
         {
             timeSetting.modifyValue(dayTime, s);
+            driftEstimator.interrupt();
             setTime();
             updateSsd();
             break;
@@ -361,14 +448,9 @@ void DigitalClock::modifyActiveElement (int s)
             updateBrightness();
             break;
         }
-        case SCR_ALARM1:
-            alarmSetting1.modifyValue(s);
-            break;
-        case SCR_ALARM2:
-            alarmSetting2.modifyValue(s);
-            break;
-        case SCR_ALARM3:
-            alarmSetting3.modifyValue(s);
+        default:
+            alarmSetting.modifyValue(s);
+            alarmScheduler.update(alarmSetting.getNumber(), rtc.getTimeSec());
             break;
     }
     activeElementVisible = true;
@@ -382,10 +464,23 @@ bool DigitalClock::isAlarmActive () const
 }
 
 
-void DigitalClock::setTime ()
+/**
+ * @brief Sets the RTC to the day time. The timers run on the monotonic time and
+ *        are not affected.
+ */
+void DigitalClock::setTime (int32_t elapsedMs, bool slew)
 {
-    rtc.setTimeSec(::mktime(&dayTime));
-    resetEventTime();
+    time_t oldTime = rtc.getTimeSec();
+    time_t newTime = ::mktime(&dayTime);
+    if (slew)
+    {
+        rtc.slewTimeSec(newTime, elapsedMs);
+    }
+    else
+    {
+        rtc.setTimeSec(newTime, elapsedMs);
+    }
+    alarmScheduler.onTimeChanged(oldTime, rtc.getTimeSec());
 }
 
 
@@ -421,75 +516,409 @@ void DigitalClock::updateLoggingState ()
 }
 
 
-void DigitalClock::updateSdCardState ()
+/**
+ * @brief Starts the sunrise ahead of the next alarm and finishes it when the
+ *        alarm is over or the alarm was moved.
+ */
+void DigitalClock::updateSunrise (time_t now)
 {
-    if (!sdCardInserted && sdCard.isCardInserted())
+    time_t duration = 60 * (time_t)config.getBrightness().sunrise;
+    if (sunrise.isActive())
     {
-        config.readConfiguration();
+        bool alarmMoved = now < sunriseAlarmTime && alarmScheduler.getNextAlarmTime() != sunriseAlarmTime;
+        bool alarmOver = now >= sunriseAlarmTime && !alarmSequence.isActive();
+        if (alarmMoved || alarmOver)
+        {
+            sunrise.stop();
+            updateBrightness();
+        }
+        return;
+    }
+    if (duration > 0 && alarmScheduler.timeUntilNextAlarm(now) <= duration &&
+        sunriseAlarmTime != alarmScheduler.getNextAlarmTime())
+    {
+        sunriseAlarmTime = alarmScheduler.getNextAlarmTime();
+        time_ms endTime = (time_ms)sunriseAlarmTime * 1000L;
+        sunrise.start(endTime - (time_ms)duration * 1000L, endTime);
     }
-    sdCardInserted = sdCard.isCardInserted();
 }
 
 
 void DigitalClock::startAlarm (size_t n)
 {
-    if (wavStreamer.isActive() || piezoAlarm.isActive())
+    // a snoozed alarm is not replaced either: it would ring again later
+    if (alarmSequence.isActive())
+    {
+        USART_DEBUG("Alarm " << n << " skipped, alarm " << activeAlarm << " is active");
+        return;
+    }
+    USART_DEBUG("Starting alarm " << n);
+    activeAlarm = n;
+    alarmSequence.start(config.getAlarm(n).sequence, rtc.getMonotonicMillisec());
+}
+
+
+void DigitalClock::startAlarmSound (size_t n)
+{
+    if (wavStreamer.isPlaying())
     {
+        // consecutive sound steps continue the same stream
         return;
     }
-    wavStreamer.setVolume((float)config.getSoundVolume()/100.0);
-    bool wavStarted = wavStreamer.start(
-            irqPrioWav, WavStreamer::SourceType::SD_CARD, config.getAlarm(n).sound);
-    if (!wavStarted)
+    if (wavAlarmNumber == n && (wavStreamer.isArmed() || (sdJobs & SD_JOB_PLAY_ALARM)))
     {
-        piezoAlarm.start(15);
+        // pre-warmed: the stream is triggered on the alarm second
+        return;
     }
+    prepareAlarm(n, rtc.getTimeSec());
 }
 
 
-bool DigitalClock::writeLogToSd (const char * logStr)
+void DigitalClock::stopAlarmSound ()
 {
+    wavLatencyPending = false;
+    if (sdJobs & SD_JOB_PLAY_ALARM)
+    {
+        sdJobs &= ~SD_JOB_PLAY_ALARM;
+        pinAmpMute.setLow();
+        pinAmpPower.setLow();
+        if (sdJobs == 0)
+        {
+            sdCard.powerOff();
+        }
+    }
+    if (wavStreamer.isActive())
+    {
+        wavStreamer.stop();
+    }
+}
+
+
+/**
+ * @brief Sets the stream volume in percent of the configured sound volume.
+ */
+void DigitalClock::setAlarmVolume (uint8_t percent)
+{
+    wavStreamer.setVolume((float)config.getSoundVolume() * percent / 10000.0);
+}
+
+
+/**
+ * @brief Powers the card and the muted amplifier and prepares the stream so
+ *        that it can be triggered exactly at the given time.
+ */
+void DigitalClock::prepareAlarm (size_t n, time_t alarmTime)
+{
+    wavAlarmTime = alarmTime;
+    if (wavStreamer.isPlaying() || piezoAlarm.isActive())
+    {
+        return;
+    }
     if (!sdCard.isCardInserted())
     {
-        return false;
+        if (isAlarmTimeReached())
+        {
+            USART_DEBUG("SD Card is not inserted");
+            piezoAlarm.start(0);
+        }
+        return;
+    }
+    if (wavStreamer.isActive())
+    {
+        wavStreamer.stop();
+    }
+    // The amplifier is powered in parallel with the card, the stream itself
+    // is prepared from processSdJobs() when both are ready
+    USART_DEBUG("Preparing alarm " << n << " in " << (alarmTime - rtc.getTimeSec()) << " sec");
+    wavAlarmNumber = n;
+    wavTriggered = false;
+    wavLatencyPending = true;
+    pinAmpMute.setLow();
+    pinAmpPower.setHigh();
+    ampPowerTime = HAL_GetTick();
+    requestSdJob(SD_JOB_PLAY_ALARM);
+}
+
+
+/**
+ * @brief The alarm time is compared with the corrected time in milliseconds:
+ *        the seconds of the wakeup timer differ from it by the drift offset.
+ */
+bool DigitalClock::isAlarmTimeReached () const
+{
+    return rtc.getTimeMillisec() >= (time_ms)wavAlarmTime * 1000L;
+}
+
+
+/**
+ * @brief Unmutes the amplifier and triggers the prepared stream when its time
+ *        is reached. Called from the main loop and from the RTC interrupt: the
+ *        flag is swapped atomically, i.e. only the first caller triggers.
+ */
+void DigitalClock::triggerAlarmSound ()
+{
+    if (wavStreamer.isArmed() && isAlarmTimeReached() && !wavTriggered.exchange(true))
+    {
+        pinAmpMute.setHigh();
+        wavStreamer.trigger();
     }
+}
 
-    sdCard.clearPort();
-    pinSdPower.setHigh();
-    HAL_Delay(250);
 
-    FIL logFile;
-    if (sdCard.openAppend(6, &logFile, LOG_FILE_NAME) == FR_OK)
+void DigitalClock::onRtcWakeUp ()
+{
+    triggerAlarmSound();
+}
+
+
+void DigitalClock::onSequenceOutput (AlarmSequence::Action action, uint8_t volume)
+{
+    piezoAlarm.stop();
+    switch (action)
     {
-        f_printf(&logFile, "%02d.%02d.%04d %02d:%02d:%02d: %s\n",
-                dayTime.tm_mday, dayTime.tm_mon + 1, dayTime.tm_year + FIRST_CALENDAR_YEAR,
-                dayTime.tm_hour, dayTime.tm_min, dayTime.tm_sec,
-                logStr);
-        f_close(&logFile);
+    case AlarmSequence::Action::PIEZO:
+        stopAlarmSound();
+        piezoAlarm.start(0);
+        break;
+    case AlarmSequence::Action::SOUND:
+        setAlarmVolume(volume);
+        startAlarmSound(activeAlarm);
+        break;
+    case AlarmSequence::Action::SNOOZE:
+        stopAlarmSound();
+        break;
     }
+}
+
+
+void DigitalClock::onSequenceVolume (uint8_t volume)
+{
+    setAlarmVolume(volume);
+}
+
+
+void DigitalClock::onSequenceFinished ()
+{
+    piezoAlarm.stop();
+    stopAlarmSound();
+}
+
+
+void DigitalClock::startDcfReceiver ()
+{
+    dcf.setRecorder(config.getDcf().capture? &dcfRecorder : NULL);
+    dcf.setEdgeCapture(config.getDcf().edges? &dcfEdges : NULL);
+    dcf.start(irqPrioDcf, this);
+    dcfReceiverStartTime = rtc.getTimeSec();
+    dcfScheduler.onWindowStarted(dcfReceiverStartTime);
+}
 
+
+/**
+ * @brief Stops the receiver when the budget of the window is exhausted.
+ */
+void DigitalClock::stopDcfReceiver ()
+{
+    dcf.stop();
+    const time_t dur = rtc.getTimeSec() - dcfReceiverStartTime;
+    dcfScheduler.onWindowFinished(dur, false);
+    config.setDcfStatistics(dcfScheduler.getStatistics());
+    dcfState = dcfTimeReceived? DcfState::READY : DcfState::NONE;
+
+    char logLine[64];
+    ::sprintf(logLine, "DCF window expired, DURATION = %ld", dur);
+    writeLogToSd(logLine);
+}
+
+
+/**
+ * @brief Appends the ready blocks of raw DCF samples to the capture file. The blocks
+ *        have the sector size, i.e. they are written without a cache. Blocks that
+ *        can not be written are dropped.
+ */
+void DigitalClock::writeDcfCapture ()
+{
+    FIL captureFile;
+    FRESULT code = sdCard.openAppend(6, &captureFile, DCF_CAPTURE_FILE_NAME);
+    if (code == FR_OK)
+    {
+        // the ready blocks consist of at most two parts since the ring may wrap
+        size_t blocks = 0;
+        const uint8_t * data = dcfRecorder.getReadyData(blocks);
+        while (code == FR_OK && blocks > 0)
+        {
+            UINT length = blocks * Devices::DcfSampleRecorder::BLOCK_SIZE, written = 0;
+            code = f_write(&captureFile, data, length, &written);
+            if (code == FR_OK && written != length)
+            {
+                code = FR_DENIED; // the volume is full
+            }
+            dcfRecorder.release(blocks);
+            data = dcfRecorder.getReadyData(blocks);
+        }
+        f_close(&captureFile);
+    }
+    if (code != FR_OK)
+    {
+        USART_DEBUG("Can not write DCF capture: " << code);
+        dcfRecorder.release(dcfRecorder.getReadyBlocks());
+    }
     sdCard.stop();
-    pinSdPower.setLow();
+}
+
+
+bool DigitalClock::writeLogToSd (const char * logStr)
+{
+    if (!sdCard.isCardInserted())
+    {
+        return false;
+    }
+    if (sdLogCount == SD_LOG_LINES)
+    {
+        USART_DEBUG("SD log buffer is full, the oldest line is dropped");
+        sdLogFirst = (sdLogFirst + 1) % SD_LOG_LINES;
+        --sdLogCount;
+    }
+    char * sdLogLine = sdLogLines[(sdLogFirst + sdLogCount) % SD_LOG_LINES];
+    ++sdLogCount;
+    ::snprintf(sdLogLine, SD_LOG_LENGTH, "%02d.%02d.%04d %02d:%02d:%02d: %s\n",
+            dayTime.tm_mday, dayTime.tm_mon + 1, dayTime.tm_year + FIRST_CALENDAR_YEAR,
+            dayTime.tm_hour, dayTime.tm_min, dayTime.tm_sec,
+            logStr);
+    requestSdJob(SD_JOB_WRITE_LOG);
     return true;
 }
 
 
-void DigitalClock::onButtonPressed (const Devices::Button * b, uint32_t numOccured)
+void DigitalClock::requestSdJob (SdJob job)
 {
-    if (wavStreamer.isActive())
+    sdJobs |= job;
+    sdCard.powerOn();
+}
+
+
+void DigitalClock::processSdJobs ()
+{
+    // the card is owned by the streamer while it plays
+    if (sdJobs == 0 || wavStreamer.isActive())
     {
-        wavStreamer.stop();
+        return;
     }
-    if (piezoAlarm.isActive())
+    if (!sdCard.isCardInserted())
     {
-        piezoAlarm.stop();
+        cancelSdJobs();
+        return;
+    }
+
+    switch (sdCard.getPowerState())
+    {
+    case Devices::SdCard::PowerState::OFF:
+        sdCard.powerOn();
+        return;
+    case Devices::SdCard::PowerState::RAMP_UP:
+    case Devices::SdCard::PowerState::PROBE:
+        return;
+    case Devices::SdCard::PowerState::FAILED:
+        cancelSdJobs();
+        return;
+    case Devices::SdCard::PowerState::READY:
+        break;
+    }
+
+    if (sdJobs & SD_JOB_SYNC_CONFIG)
+    {
+        config.synchronize();
+        calendar.synchronize();
+        alarmScheduler.reschedule(rtc.getTimeSec());
+    }
+    if (sdJobs & SD_JOB_WRITE_CONFIG)
+    {
+        config.writeConfiguration();
+    }
+    if (sdJobs & SD_JOB_WRITE_LOG)
+    {
+        FIL logFile;
+        if (sdCard.openAppend(6, &logFile, LOG_FILE_NAME) == FR_OK)
+        {
+            for (size_t i = 0; i < sdLogCount; ++i)
+            {
+                f_puts(sdLogLines[(sdLogFirst + i) % SD_LOG_LINES], &logFile);
+            }
+            f_close(&logFile);
+        }
+        sdCard.stop();
+        sdLogFirst = 0;
+        sdLogCount = 0;
+    }
+    if (sdJobs & SD_JOB_WRITE_CAPTURE)
+    {
+        writeDcfCapture();
+    }
+    sdJobs &= SD_JOB_PLAY_ALARM;
+
+    if (sdJobs & SD_JOB_PLAY_ALARM)
+    {
+        if (HAL_GetTick() - ampPowerTime < AMP_POWER_UP_DELAY)
+        {
+            return;
+        }
+        sdJobs = 0;
+        bool wavPrepared = wavStreamer.prepare(
+                irqPrioWav, WavStreamer::SourceType::SD_CARD, config.getAlarm(wavAlarmNumber).sound);
+        if (!wavPrepared && isAlarmTimeReached())
+        {
+            // the piezo element beeps until the sequence step ends
+            piezoAlarm.start(0);
+        }
+        return;
+    }
+
+    sdCard.powerOff();
+}
+
+
+void DigitalClock::cancelSdJobs ()
+{
+    USART_DEBUG("SD Card is not available, pending jobs are dropped: " << (int)sdJobs);
+    if (sdJobs & SD_JOB_PLAY_ALARM)
+    {
+        pinAmpMute.setLow();
+        pinAmpPower.setLow();
+        // a pre-warmed alarm falls back to the piezo element at its deadline
+        if (isAlarmTimeReached())
+        {
+            piezoAlarm.start(0);
+        }
+    }
+    if (sdJobs & SD_JOB_WRITE_CAPTURE)
+    {
+        dcfRecorder.release(dcfRecorder.getReadyBlocks());
+    }
+    sdJobs = 0;
+    sdLogFirst = 0;
+    sdLogCount = 0;
+    sdCard.powerOff();
+}
+
+
+void DigitalClock::onButtonPressed (const Devices::Button * b, uint32_t numOccured)
+{
+    // while the alarm is active (also snoozed), the mode button dismisses it and
+    // all other buttons snooze it; repeated events of a held button are ignored
+    if (alarmSequence.isActive())
+    {
+        if (numOccured == 0)
+        {
+            alarmSequence.onButtonPressed(b == &bMode, rtc.getMonotonicMillisec());
+        }
+        returnToHome.resetTime();
+        return;
     }
 
     if (b == &bMode)
     {
         USART_DEBUG("mode button pressed: " << numOccured);
-        activeScreen = (activeScreen == (ScreenType)(SCR_NUMBER - 1))? SCR_HOME : (ScreenType)((int)activeScreen + 1);
-        setScreen(activeScreen);
+        setScreen((activeScreen == SCR_NUMBER - 1)? SCR_HOME : activeScreen + 1);
     }
     else if (b == &bActiveElement)
     {
@@ -503,24 +932,19 @@ void DigitalClock::onButtonPressed (const Devices::Button * b, uint32_t numOccur
     {
         USART_DEBUG("plus button pressed: " << numOccured);
         modifyActiveElement(1);
-        if (activeScreen == ScreenType::SCR_ALARM1 ||
-            activeScreen == ScreenType::SCR_ALARM2 ||
-            activeScreen == ScreenType::SCR_ALARM3)
+        if (activeScreen >= SCR_ALARM &&
+            alarmSetting.getActiveElement() == AlarmSetting::AS_ACTIVE &&
+            numOccured > 0)
         {
-            size_t alarmNr = (size_t)activeScreen - (size_t)ScreenType::SCR_ALARM1;
-            if (alarmNr < ALARM_NUMBER &&
-                alarms[alarmNr]->getActiveElement() == AlarmSetting::AS_ACTIVE &&
-                numOccured > 0)
-            {
-                setScreen(SCR_HOME);
-                startAlarm(alarmNr);
-            }
+            size_t alarmNr = alarmSetting.getNumber();
+            setScreen(SCR_HOME);
+            startAlarm(alarmNr);
         }
     }
     else if (b == &bMinus)
     {
         USART_DEBUG("minus button pressed: " << numOccured);
-        if (activeScreen == ScreenType::SCR_HOME)
+        if (activeScreen == SCR_HOME)
         {
             uint8_t n = lcd.getLinesNumber() == 1? 2 : 1;
             lcd.clear();
@@ -536,9 +960,13 @@ void DigitalClock::onButtonPressed (const Devices::Button * b, uint32_t numOccur
 }
 
 
-void DigitalClock::onDcfBit (int16_t secondNr, size_t errorNr, bool bit)
+void DigitalClock::onDcfBit (int16_t secondNr, size_t errorNr, bool bit, uint8_t confidence)
 {
-    if (secondNr >= 0 && errorNr == 0)
+    if (secondNr >= 0 && errorNr == 0 && confidence < DCF_WEAK_CONFIDENCE)
+    {
+        dcfState = DcfState::BIT_WEAK;
+    }
+    else if (secondNr >= 0 && errorNr == 0)
     {
         dcfState = bit? DcfState::BIT_PLUS : DcfState::BIT_MINUS;
     }
@@ -546,51 +974,88 @@ void DigitalClock::onDcfBit (int16_t secondNr, size_t errorNr, bool bit)
     {
         dcfState = DcfState::ERROR;
     }
-    /*
-    Do not update LCD here since this procedure is called from an interrupt
-    */
+    // called from the main loop, the LCD is updated with the next second
 }
 
 
 void DigitalClock::onDcfTimeReceived (const ::tm & dt, const char * /*dayTimeStr*/)
 {
+    // the time refers to the minute mark that was timestamped by the sampling ISR,
+    // i.e. the latency of the main loop does not enter the error of the RTC
+    const time_ms markTime = dcf.getMarkTime();
+    const duration_ms elapsedMs = (duration_ms)(rtc.getMonotonicMillisec() - markTime);
+    const bool summerTime = dcf.getFlags().summerTime;
+    ::tm newDt = dt;
+    const time_t dcfTime = ::mktime(&newDt);
+    const duration_ms errorMs = (duration_ms)rtc.getTimeMillisec() - (duration_ms)dcfTime * 1000L - elapsedMs;
+
     dcfState = DcfState::READY;
     dcf.stop();
+    time_t dur = rtc.getTimeSec() - dcfReceiverStartTime;
+    dcfScheduler.onWindowFinished(dur, true);
+    config.setDcfStatistics(dcfScheduler.getStatistics());
     lcd.clear();
 
+    // a change of the time zone steps the clock by an hour
+    duration_ms stepMs = errorMs;
+    if (dcfTimeReceived && summerTime != dcfSummerTime)
+    {
+        stepMs -= summerTime? -DCF_ZONE_SHIFT : DCF_ZONE_SHIFT;
+    }
+    const bool regular = dcfTimeReceived && ::llabs(stepMs) < DCF_MAX_STEP;
+
     // log the DCF time
-    time_t diff = INFINITY_SEC;
     {
-        char logLine[512];
-        ::tm newDt = dt;
-        time_t diff = ::mktime(&dayTime) - ::mktime(&newDt);
-        time_t dur = rtc.getTimeSec() - dcfReceiverStartTime;
-        ::sprintf(logLine, "DCF time = %02d:%02d:%02d, PREV-NEW = %ld, DURATION = %ld", dt.tm_hour, dt.tm_min, dt.tm_sec, diff, dur);
+        char logLine[128];
+        ::sprintf(logLine, "DCF time = %02d:%02d:%02d %s, PREV-NEW = %ld, DURATION = %ld", dt.tm_hour, dt.tm_min, dt.tm_sec,
+                  summerTime? "CEST" : "CET", (long)(errorMs / 1000L), dur);
         writeLogToSd(logLine);
     }
 
-    if (!dcfTimeReceived || ::labs(diff) < 10)
+    // a step is taken at the first reception or if it is confirmed by the next one
+    if (!regular && dcfTimeReceived &&
+        !(dcfStepPending && ::llabs(stepMs - dcfStepError) < DCF_MAX_STEP))
     {
-        dayTime = dt;
-        setTime();
-        dcfTimeReceived = true;
+        writeLogToSd("DCF time rejected, waiting for confirmation");
+        dcfStepPending = true;
+        dcfStepError = stepMs;
+        return;
     }
+    dcfStepPending = false;
+
+    const int32_t appliedPpb = rtc.getCorrection();
+    dayTime = dt;
+    // the logging above may take a while on the SD card
+    setTime((int32_t)(rtc.getMonotonicMillisec() - markTime), regular);
+    dcfTimeReceived = true;
+    dcfSummerTime = summerTime;
+
+    if (regular)
+    {
+        driftEstimator.addFix(dcfTime, (int32_t)stepMs, appliedPpb);
+    }
+    else
+    {
+        driftEstimator.interrupt();
+        driftEstimator.addFix(dcfTime, 0, appliedPpb);
+    }
+    rtc.setCorrection(driftEstimator.getCorrection());
+    char logLine[128];
+    ::sprintf(logLine, "DCF fix: RTC-DCF = %ld ms, correction = %ld ppb", (long)stepMs, (long)rtc.getCorrection());
+    writeLogToSd(logLine);
 }
 
 
 bool DigitalClock::onStartSteaming (WavStreamer::SourceType s)
 {
-    if (s == WavStreamer::SourceType::SD_CARD && !sdCard.isCardInserted())
+    if (s == WavStreamer::SourceType::SD_CARD &&
+        sdCard.getPowerState() != Devices::SdCard::PowerState::READY)
     {
-        USART_DEBUG("SD Card is not inserted");
+        USART_DEBUG("SD Card is not ready");
         return false;
     }
-    pinAmpMute.setLow();
-    sdCard.clearPort();
-    pinSdPower.setHigh();
+    // the amplifier stays muted until the stream is triggered
     pinAmpPower.setHigh();
-    HAL_Delay(250);
-    pinAmpMute.setHigh();
     return true;
 }
 
@@ -598,6 +1063,25 @@ bool DigitalClock::onStartSteaming (WavStreamer::SourceType s)
 void DigitalClock::onFinishSteaming ()
 {
     pinAmpMute.setLow();
-    pinSdPower.setLow();
+    sdCard.powerOff();
     pinAmpPower.setLow();
 }
+
+
+void DigitalClock::onCardInserted ()
+{
+    requestSdJob(SD_JOB_SYNC_CONFIG);
+}
+
+
+void DigitalClock::onCardRemoved ()
+{
+    if (wavStreamer.isActive())
+    {
+        wavStreamer.stop();
+    }
+    if (sdJobs != 0)
+    {
+        cancelSdJobs();
+    }
+}
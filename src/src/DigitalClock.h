@@ -20,6 +20,8 @@
 #ifndef DIGITALCLOCK_H_
 #define DIGITALCLOCK_H_
 
+#include <atomic>
+
 #include "StmPlusPlus/Devices/Ssd.h"
 #include "StmPlusPlus/Devices/Button.h"
 #include "StmPlusPlus/Devices/Lcd_DOGM162.h"
@@ -30,6 +32,11 @@
 #include "StmPlusPlus/PiezoAlarm.h"
 
 #include "Screens.h"
+#include "AlarmScheduler.h"
+#include "AlarmSequence.h"
+#include "SunriseLight.h"
+#include "DriftEstimator.h"
+#include "DcfScheduler.h"
 
 using namespace StmPlusPlus;
 
@@ -37,27 +44,66 @@ class DigitalClock : public
     Devices::Button::EventHandler,
     WavStreamer::EventHandler,
     Devices::DcfReceiver::EventHandler,
+    Devices::SdCard::EventHandler,
+    RealTimeClock::EventHandler,
+    AlarmSequence::EventHandler,
     DisplayDataProvider
 {
 public:
 
     const float MAIN_VOLTAGE = 3.3;
     static const size_t BUTTONS_NUMBER = 4;
-    static const size_t SCR_NUMBER = 6;
-    static const size_t ALARM_NUMBER = 3;
     static const size_t TEMPERATURE_TRIALS = 10;
     const char * LOG_FILE_NAME = "dc.log";
+    const char * DCF_CAPTURE_FILE_NAME = "dcf.cap";
+    static const uint32_t AMP_POWER_UP_DELAY = 250;
+    static const time_t ALARM_PREWARM_TIME = 5;
+    static const uint8_t DCF_WEAK_CONFIDENCE = 50;
+
+    /**
+     * @brief The spare flash sector is not erased if an alarm is due within this
+     *        time (in seconds), since the erase stalls the CPU.
+     */
+    static const time_t FLASH_ERASE_MARGIN = 60;
+
+    /**
+     * @brief A received time that differs from the clock by more than this value
+     *        (besides a time zone change) is only taken if the next reception
+     *        confirms the difference.
+     */
+    static const StmPlusPlus::duration_ms DCF_MAX_STEP = 10000;
+    static const StmPlusPlus::duration_ms DCF_ZONE_SHIFT = 3600000;
+
+    /**
+     * @brief Log lines are buffered until the SD card is powered up. If more lines
+     *        arrive in the meantime, the oldest ones are dropped.
+     */
+    static const size_t SD_LOG_LINES = 8;
+    static const size_t SD_LOG_LENGTH = 128;
+
+    /**
+     * @brief Operations that need a powered SD card. They are collected as a bit mask
+     *        and executed from the main loop as soon as the card finished its power-up.
+     */
+    enum SdJob
+    {
+        SD_JOB_SYNC_CONFIG = 0x01,
+        SD_JOB_WRITE_CONFIG = 0x02,
+        SD_JOB_WRITE_LOG = 0x04,
+        SD_JOB_PLAY_ALARM = 0x08,
+        SD_JOB_WRITE_CAPTURE = 0x10
+    };
 
     enum ScreenType
     {
         SCR_HOME = 0,           // home screen
         SCR_TIME_SETTING = 1,   // time setting screen
         SCR_BRIGHTNESS = 2,     // brightness setting screen
-        SCR_ALARM1 = 3,         // alarm setting screen
-        SCR_ALARM2 = 4,         // alarm setting screen
-        SCR_ALARM3 = 5          // alarm setting screen
+        SCR_ALARM = 3           // setting screen of the first alarm, followed by all other alarms
     };
 
+    static const size_t SCR_NUMBER = SCR_ALARM + Config::ALARMS_NUMBER;
+
     DigitalClock ();
 
     virtual ~DigitalClock () { /* empty */ }
@@ -82,6 +128,11 @@ public:
         dcf.onSample();
     }
 
+    inline void onTim5Interrupt ()
+    {
+        dcfEdges.onCapture();
+    }
+
     inline const ::tm & getDayTime () const
     {
         return dayTime;
@@ -119,25 +170,43 @@ public:
 protected:
 
     void periodic ();
-    void resetEventTime ();
-    void setScreen (ScreenType scr);
+    void setScreen (size_t scr);
+    bool isIdle (time_t now);
     void updateBrightness ();
+    void updateSunrise (time_t now);
     void updateLcd (bool changeActiveElement);
     void updateSsd ();
     void modifyActiveElement (int s);
     bool isAlarmActive () const;
-    void setTime ();
+    void setTime (int32_t elapsedMs = 0, bool slew = false);
     void measureTemperature ();
     void updateLoggingState ();
-    void updateSdCardState ();
     void startAlarm (size_t n);
+    void startAlarmSound (size_t n);
+    void stopAlarmSound ();
+    void setAlarmVolume (uint8_t percent);
+    void prepareAlarm (size_t n, time_t alarmTime);
+    bool isAlarmTimeReached () const;
+    void triggerAlarmSound ();
+    void startDcfReceiver ();
+    void stopDcfReceiver ();
+    void writeDcfCapture ();
     bool writeLogToSd (const char *);
+    void requestSdJob (SdJob job);
+    void processSdJobs ();
+    void cancelSdJobs ();
 
     virtual void onButtonPressed (const Devices::Button * b, uint32_t numOccured);
-    virtual void onDcfBit (int16_t secondNr, size_t errorNr, bool bit);
+    virtual void onDcfBit (int16_t secondNr, size_t errorNr, bool bit, uint8_t confidence);
     virtual void onDcfTimeReceived (const ::tm & dt, const char * dayTimeStr);
     virtual bool onStartSteaming (WavStreamer::SourceType s);
     virtual void onFinishSteaming ();
+    virtual void onCardInserted ();
+    virtual void onCardRemoved ();
+    virtual void onRtcWakeUp ();
+    virtual void onSequenceOutput (AlarmSequence::Action action, uint8_t volume);
+    virtual void onSequenceVolume (uint8_t volume);
+    virtual void onSequenceFinished ();
 
 private:
 
@@ -150,7 +219,8 @@ private:
 
     // HMI
     IOPin pinHmiPower;
-    PeriodicalEvent eventLedToggle, eventSecToggle;
+    PeriodicalEvent eventLedToggle;
+    time_t displayedTime;
     Spi spiHmi;
 
     // SSD
@@ -166,23 +236,37 @@ private:
     // DAC
     IOPin pinHmiBrightnessCs;
     Devices::Dac_MCP49x1 hmiBrightness;
+    SunriseLight sunrise;
+    time_t sunriseAlarmTime;
     AnalogToDigitConverter adcBrightness;
 
     // DCF77
     IOPin pinDcfInput, pinDcfPower;
     Devices::DcfReceiver dcf;
+    Devices::DcfEdgeCapture dcfEdges;
+    Devices::DcfSampleRecorder dcfRecorder;
     volatile DcfState dcfState;
     time_t dcfReceiverStartTime;
     bool dcfTimeReceived;
+    bool dcfSummerTime;
+    bool dcfStepPending;
+    StmPlusPlus::duration_ms dcfStepError;
+    DriftEstimator driftEstimator;
+    DcfScheduler dcfScheduler;
 
     // SD card
     IOPin pinSdPower, pinSdDetect;
     IOPort portSd1, portSd2;
     Devices::SdCard sdCard;
-    bool sdCardInserted;
+    uint32_t sdJobs;
+    char sdLogLines[SD_LOG_LINES][SD_LOG_LENGTH];
+    size_t sdLogFirst, sdLogCount;
 
     // Configuration
+    BackupSram backupSram;
+    FlashStore flashStore;
     Config config;
+    Calendar calendar;
 
     // Sound
     IOPin pinAmpPower, pinAmpMute;
@@ -191,6 +275,11 @@ private:
     IOPin pinRightChannel;
     IOPin pinWavSample;
     WavStreamer wavStreamer;
+    size_t wavAlarmNumber;
+    volatile time_t wavAlarmTime;
+    std::atomic<bool> wavTriggered; // set by the first caller of triggerAlarmSound, main loop or interrupt
+    bool wavLatencyPending;
+    uint32_t ampPowerTime;
 
     // Piezo element
     PiezoAlarm piezoAlarm;
@@ -204,13 +293,15 @@ private:
     TimeSetting timeSetting;
     BrightnessSetting brightnessSetting;
     Screen * screens[SCR_NUMBER];
-    ScreenType activeScreen;
+    size_t activeScreen;
     bool activeElementVisible;
     PeriodicalEvent activeElementToggle, returnToHome;
 
     // Alarms
-    const AlarmSetting * alarms[ALARM_NUMBER];
-    AlarmSetting alarmSetting1, alarmSetting2, alarmSetting3;
+    AlarmSetting alarmSetting;
+    AlarmScheduler alarmScheduler;
+    AlarmSequence alarmSequence;
+    size_t activeAlarm;
 
     // Date and time
     ::tm dayTime;
@@ -0,0 +1,150 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "DriftEstimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace StmPlusPlus;
+
+#define USART_DEBUG_MODULE "DRIFT: "
+
+/************************************************************************
+ * Class DriftEstimator
+ ************************************************************************/
+
+DriftEstimator::DriftEstimator ():
+    fixesNumber(0),
+    valid(false),
+    correction(0),
+    slopeError(0.0)
+{
+    // empty
+}
+
+
+void DriftEstimator::interrupt ()
+{
+    fixesNumber = 0;
+}
+
+
+bool DriftEstimator::addFix (time_t time, int32_t errorMs, int32_t appliedPpb)
+{
+    if (fixesNumber > 0)
+    {
+        const time_t lastTime = times[fixesNumber - 1];
+        const double interval = (double)time - (double)lastTime;
+        const double tolerance = valid ? slopeError * 1.0e6 + WANDER : MAX_DRIFT;
+        if (interval <= 0.0 || ::fabs(errorMs) > MAX_RESIDUAL + tolerance * interval / 1.0e6)
+        {
+            USART_DEBUG("Fix rejected: error = " << errorMs << " ms, interval = " << (int32_t)interval << " sec");
+            fixesNumber = 0;
+        }
+        else
+        {
+            if (fixesNumber == MAX_FIXES)
+            {
+                for (size_t i = 1; i < MAX_FIXES; ++i)
+                {
+                    times[i - 1] = times[i];
+                    phases[i - 1] = phases[i];
+                }
+                --fixesNumber;
+            }
+            // remove the part compensated by the correction from the measured error
+            times[fixesNumber] = time;
+            phases[fixesNumber] = phases[fixesNumber - 1] + errorMs - (double)appliedPpb * interval / 1.0e6;
+            ++fixesNumber;
+            fit();
+            return true;
+        }
+    }
+
+    // start a new chain
+    times[0] = time;
+    phases[0] = 0.0;
+    fixesNumber = 1;
+    return false;
+}
+
+
+duration_ms DriftEstimator::getPredictedError (time_t time) const
+{
+    if (fixesNumber == 0)
+    {
+        return UNKNOWN_ERROR;
+    }
+    const double interval = std::max(0.0, (double)time - (double)times[fixesNumber - 1]);
+    const double drift = valid ? slopeError * 1.0e6 + WANDER : DEFAULT_DRIFT;
+    return FIX_ERROR + (duration_ms)(drift * interval / 1.0e6);
+}
+
+
+/**
+ * @brief Least squares fit of the phase over the time. The correction is only
+ *        updated if the chain spans enough time.
+ */
+void DriftEstimator::fit ()
+{
+    if (fixesNumber < 2 || times[fixesNumber - 1] - times[0] < MIN_SPAN)
+    {
+        return;
+    }
+
+    const double n = fixesNumber;
+    double meanT = 0.0, meanP = 0.0;
+    for (size_t i = 0; i < fixesNumber; ++i)
+    {
+        meanT += (double)(times[i] - times[0]);
+        meanP += phases[i];
+    }
+    meanT /= n;
+    meanP /= n;
+
+    double sxx = 0.0, sxy = 0.0;
+    for (size_t i = 0; i < fixesNumber; ++i)
+    {
+        const double dt = (double)(times[i] - times[0]) - meanT;
+        sxx += dt * dt;
+        sxy += dt * (phases[i] - meanP);
+    }
+    const double slope = sxy / sxx;
+
+    // the residuals of two fixes are always zero, the expected fix error is the lower bound
+    double sigma = FIX_ERROR;
+    if (fixesNumber > 2)
+    {
+        double ssr = 0.0;
+        for (size_t i = 0; i < fixesNumber; ++i)
+        {
+            const double r = phases[i] - meanP - slope * ((double)(times[i] - times[0]) - meanT);
+            ssr += r * r;
+        }
+        sigma = std::max(sigma, ::sqrt(ssr / (n - 2.0)));
+    }
+    slopeError = sigma / ::sqrt(sxx);
+
+    const double ppb = -slope * 1.0e6;
+    correction = (int32_t)::lround(std::max((double)-MAX_DRIFT, std::min((double)MAX_DRIFT, ppb)));
+    valid = true;
+    USART_DEBUG("Drift fit: fixes = " << fixesNumber << ", correction = " << correction
+                << " ppb, error = " << (int32_t)(slopeError * 1.0e6) << " ppb");
+}
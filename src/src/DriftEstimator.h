@@ -0,0 +1,108 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef DRIFTESTIMATOR_H_
+#define DRIFTESTIMATOR_H_
+
+#include "StmPlusPlus/StmPlusPlus.h"
+
+/**
+ * @brief Class estimating the frequency drift of the RTC from successive DCF fixes.
+ *
+ * Each fix gives the error of the RTC against the DCF time just before the RTC is
+ * set. Since the RTC is set at each fix, the uncorrected phase of the oscillator is
+ * reconstructed by accumulating the errors minus the part compensated by the
+ * correction that was applied during the interval. A linear regression of this
+ * phase over the time gives the drift. A manual time change breaks the chain: the
+ * next fix starts a new one, and the last correction is kept until the new chain
+ * spans MIN_SPAN. A fix that does not fit the chain starts a new one as well.
+ */
+class DriftEstimator
+{
+public:
+
+    static const size_t MAX_FIXES = 8;
+    static const time_t MIN_SPAN = 6 * 3600; // in seconds
+    static const int32_t MAX_DRIFT = 200000; // in ppb
+    static const int32_t FIX_ERROR = 20; // expected error of a single fix, in ms
+    static const int32_t MAX_RESIDUAL = 250; // in ms
+    static const int32_t WANDER = 2000; // assumed drift change between fixes, in ppb
+    static const int32_t DEFAULT_DRIFT = 50000; // tolerance of an uncalibrated LSE, in ppb
+    static const StmPlusPlus::duration_ms UNKNOWN_ERROR = __INT64_MAX__;
+
+    DriftEstimator ();
+
+    /**
+     * @brief Breaks the chain of fixes, for example after a manual time change.
+     */
+    void interrupt ();
+
+    /**
+     * @brief Adds a fix.
+     *
+     * @param time the DCF time of the fix.
+     * @param errorMs the RTC time minus the DCF time, in milliseconds.
+     * @param appliedPpb the correction that was applied to the RTC since the previous fix.
+     * @return false if the fix was not consistent with the chain, which is restarted.
+     */
+    bool addFix (time_t time, int32_t errorMs, int32_t appliedPpb);
+
+    inline bool isValid () const
+    {
+        return valid;
+    }
+
+    /**
+     * @brief Returns the correction in ppb that should be applied to the RTC.
+     */
+    inline int32_t getCorrection () const
+    {
+        return correction;
+    }
+
+    /**
+     * @brief Returns the standard error of the correction in ppb.
+     */
+    inline int32_t getCorrectionError () const
+    {
+        return (int32_t)(slopeError * 1.0e6);
+    }
+
+    /**
+     * @brief Returns the expected absolute error of the corrected RTC in
+     *        milliseconds at the given time. It grows with the time elapsed
+     *        since the last fix, or UNKNOWN_ERROR if there is no fix since
+     *        the last interrupt.
+     */
+    StmPlusPlus::duration_ms getPredictedError (time_t time) const;
+
+private:
+
+    time_t times[MAX_FIXES];
+    double phases[MAX_FIXES]; // uncorrected RTC phase, in ms
+    size_t fixesNumber;
+    bool valid;
+    int32_t correction; // in ppb
+    double slopeError; // in ms/sec
+
+    void fit ();
+};
+
+
+#endif
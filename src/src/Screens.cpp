@@ -32,26 +32,31 @@
 
 static const char * emptyString = "      ";
 static const char * dayNames[7] = {"So", "Mo", "Di", "Mi", "Do", "Fr", "Sa"};
-static const char dcfSymbols[5] = {' ', 'e', '+', '-', 0b00010101};
+static const char dcfSymbols[6] = {' ', 'e', '+', '-', 0b00010101, '?'};
 
-unsigned char cicleIncrement (unsigned char val, int s, unsigned char min, unsigned char max)
+unsigned char cicleIncrement (unsigned char val, int s, unsigned char min, unsigned char max, unsigned char step = 1)
 {
-    unsigned char ret = val;    
-    if (s > 0 && ret == max)
+    int ret = (int)val + s * (int)step;
+    if (ret > (int)max)
     {
         ret = min;
     }
-    else if (s < 0 && ret == min)
+    else if (ret < (int)min)
     {
         ret = max;
     }
-    else
-    {
-        ret += s;
-    }
     return ret;
 }
 
+/**
+ * @brief Increments or decrements a numeric value within the range of the given configuration parameter.
+ */
+static unsigned char cicleIncrement (unsigned char val, int s, CfgParameter::Type par)
+{
+    const Config::Field & f = Config::schema[par];
+    return cicleIncrement(val, s, f.min, f.max, f.step);
+}
+
 /************************************************************************
  * Class HomeScreen
  ************************************************************************/
@@ -218,11 +223,11 @@ void BrightnessSetting::modifyValue (int s)
     const Config::Brightness & data = config.getBrightness();
     if (activeElement == BS_MODE)
     {
-        config.setBrightnessManual(!data.isManual);
+        config.setBrightnessManual(cicleIncrement(data.isManual, s, CfgParameter::BRIGH_MANUAL));
     }
     else
     {
-        config.setBrightnessManValue(cicleIncrement(data.manValue, s, 0, 100));
+        config.setBrightnessManValue(cicleIncrement(data.manValue, s, CfgParameter::BRIGH_MANVAL));
     }
 }
 
@@ -243,10 +248,10 @@ const unsigned char AlarmSetting::elementPos[10][3] = {
 };
 const char * AlarmSetting::activeString[2] = {"AUS", " AN"};
 
-AlarmSetting::AlarmSetting (size_t _number, Config & _config):
+AlarmSetting::AlarmSetting (Config & _config):
     config(_config),
     activeElement(AS_ACTIVE),
-    number(_number)
+    number(0)
 {
     // empty
 }
@@ -286,21 +291,23 @@ void AlarmSetting::fillLine (int line, const DisplayDataProvider * dataProvider,
 void AlarmSetting::modifyValue (int s)
 {
     const Config::Alarm & data = config.getAlarm(number);
+    // the range of the alarm time is given as HHMM and its step in minutes
+    const Config::Field & hm = Config::schema[CfgParameter::ALARM_HM];
     switch (activeElement)
     {
     case AS_ACTIVE:
-        config.setAlarmActive(number, !data.isActive);
+        config.setAlarmActive(number, cicleIncrement(data.isActive, s, CfgParameter::ALARM_ACTIVE));
         break;
     case AS_HOUR:
-        config.setAlarmHour(number, cicleIncrement(data.hour, s, 0, 23));
+        config.setAlarmHour(number, cicleIncrement(data.hour, s, hm.min / 100, hm.max / 100));
         break;
     case AS_MIN:
-        config.setAlarmMin(number, cicleIncrement(data.min, s, 0, 59));
+        config.setAlarmMin(number, cicleIncrement(data.min, s, 0, 60 - hm.step, hm.step));
         break;
     case AS_DAY1: case AS_DAY2: case AS_DAY3: case AS_DAY4: case AS_DAY5: case AS_DAY6: case AS_DAY7:
         {
             size_t dayNr = activeElement - 3;
-            config.setAlarmDay(number, dayNr, !data.days[dayNr]);
+            config.setAlarmDay(number, dayNr, cicleIncrement(data.days[dayNr], s, CfgParameter::ALARM_DAYS));
         }
         break;
     }
@@ -49,7 +49,8 @@ enum class DcfState
     ERROR = 1,
     BIT_PLUS = 2,
     BIT_MINUS = 3,
-    READY = 4
+    READY = 4,
+    BIT_WEAK = 5
 };
 
 /**
@@ -151,7 +152,8 @@ private:
 
 
 /**
- * @brief Class describing the state of alarm setting screen.
+ * @brief Class describing the state of alarm setting screen. The same screen
+ *        is used for all alarms.
  */
 class AlarmSetting : public Screen
 {
@@ -170,7 +172,7 @@ public:
         AS_DAY7 = 9
     };
     
-    AlarmSetting (size_t _number, Config & _config);
+    AlarmSetting (Config & _config);
     void setFirst ();
     void setNext ();
     void fillLine (int line, const DisplayDataProvider * dataProvider, char * dest);
@@ -181,6 +183,16 @@ public:
         return activeElement;
     }
 
+    inline void setNumber (size_t _number)
+    {
+        number = _number;
+    }
+
+    inline size_t getNumber () const
+    {
+        return number;
+    }
+
 private:
 
     Config & config;
@@ -44,19 +44,7 @@ void Dac_MCP49x1::putValue (uint16_t percent)
     else
     {
         message.fields.outputShutdownControl = 1;
-        uint16_t valueInVolts = lowerLimit + ((upperLimit - lowerLimit) * percent)/100;
-        switch (resolution)
-        {
-        case Resolution::BIT_8:
-            message.fields.valueInVolts = valueInVolts << 4;
-            break;
-        case Resolution::BIT_10:
-            message.fields.valueInVolts = valueInVolts << 2;
-            break;
-        case Resolution::BIT_12:
-            message.fields.valueInVolts = valueInVolts;
-            break;
-        }
+        setValue(lowerLimit + ((upperLimit - lowerLimit) * percent)/100);
     }
 
     pinCs.setLow();
@@ -66,3 +54,33 @@ void Dac_MCP49x1::putValue (uint16_t percent)
     HAL_Delay(1);
     pinCs.setHigh();
 }
+
+
+void Dac_MCP49x1::putRawValue (uint16_t value)
+{
+    message.fields.outputShutdownControl = (value != 0);
+    setValue(value);
+
+    pinCs.setLow();
+    spi.putChar(message.bytes.high);
+    spi.putChar(message.bytes.low);
+    spi.waitForIdle();
+    pinCs.setHigh();
+}
+
+
+void Dac_MCP49x1::setValue (uint16_t value)
+{
+    switch (resolution)
+    {
+    case Resolution::BIT_8:
+        message.fields.valueInVolts = value << 4;
+        break;
+    case Resolution::BIT_10:
+        message.fields.valueInVolts = value << 2;
+        break;
+    case Resolution::BIT_12:
+        message.fields.valueInVolts = value;
+        break;
+    }
+}
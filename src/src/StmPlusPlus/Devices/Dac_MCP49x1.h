@@ -44,7 +44,24 @@ public:
         message.fields.outputGainControl = !outputGain;
     }
 
+    inline uint16_t getLowerLimit () const
+    {
+        return lowerLimit;
+    }
+
+    inline uint16_t getUpperLimit () const
+    {
+        return upperLimit;
+    }
+
     void putValue (uint16_t percent);
+
+    /**
+     * @brief Puts a value in the units of the DAC resolution without delays,
+     *        i.e. it can be called often from the main loop. Zero shuts the
+     *        output down.
+     */
+    void putRawValue (uint16_t value);
     
 private:
 
@@ -72,6 +89,8 @@ private:
     Resolution resolution;
     uint16_t lowerLimit, upperLimit;
     Message message;
+
+    void setValue (uint16_t value);
 };
 
 } // end of namespace Devices
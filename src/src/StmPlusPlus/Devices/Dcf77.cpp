@@ -19,6 +19,8 @@
  ******************************************************************************/
 
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 #include "Dcf77.h"
 
@@ -29,36 +31,591 @@ using namespace StmPlusPlus::Devices;
 
 
 /************************************************************************
- * Class MedianFilter
+ * Class DcfPhaseDetector
  ************************************************************************/
 
-bool MedianFilter::processSample (bool val)
+DcfPhaseDetector::DcfPhaseDetector ():
+    phase(-1),
+    candidate(-1),
+    confirmations(0),
+    score(0)
 {
-    if (currSample <= lastSample)
+    reset();
+}
+
+
+void DcfPhaseDetector::reset ()
+{
+    for (auto & p : profile)
+    {
+        p = FULL_SCALE / 2;
+    }
+    phase = -1;
+    candidate = -1;
+    confirmations = 0;
+    score = 0;
+}
+
+
+void DcfPhaseDetector::evaluate ()
+{
+    // circular prefix sums, i.e. each window sum is a single difference
+    int32_t sums[2 * BINS + 1];
+    sums[0] = 0;
+    for (size_t i = 0; i < 2 * BINS; ++i)
     {
-        samples[currSample] = val;
-        ++currSample;
-        return getDefault();
+        sums[i + 1] = sums[i] + profile[i % BINS];
     }
-    size_t nrTrue = 0;
-    size_t nrFalse = 0;
-    for (auto & s : samples)
+
+    int16_t best = 0;
+    int32_t bestScore = INT32_MIN;
+    for (size_t b = 0; b < BINS; ++b)
     {
-        if (s)
+        int32_t pulse = sums[b + PULSE_BINS] - sums[b];
+        int32_t gap = sums[b + BINS] - sums[b + GAP_BEGIN];
+        int32_t s = GAP_WEIGHT * pulse - gap;
+        if (s > bestScore)
         {
-            ++nrTrue;
+            bestScore = s;
+            best = b;
+        }
+    }
+    score = bestScore;
+
+    if (phase >= 0)
+    {
+        // follow a slow drift of the phase, give up if the template does not fit anymore
+        if (score < UNLOCK_THRESHOLD)
+        {
+            USART_DEBUG("Phase lost, score = " << score);
+            phase = -1;
+            candidate = -1;
+            confirmations = 0;
         }
         else
         {
-            ++nrFalse;
+            phase = best;
         }
+        return;
+    }
+
+    // the lock requires a stable phase over several seconds
+    int16_t diff = (best - candidate + BINS) % BINS;
+    if (score >= LOCK_THRESHOLD && candidate >= 0 && (diff <= 1 || diff >= (int16_t)BINS - 1))
+    {
+        ++confirmations;
+    }
+    else
+    {
+        confirmations = 0;
+    }
+    candidate = best;
+    if (confirmations >= LOCK_CONFIRMATIONS)
+    {
+        USART_DEBUG("Phase locked at " << best << ", score = " << score);
+        phase = best;
+    }
+}
+
+
+/************************************************************************
+ * Class DcfFrameAccumulator
+ ************************************************************************/
+
+// see https://de.wikipedia.org/wiki/DCF77
+const DcfFrameAccumulator::Field DcfFrameAccumulator::fields[FIELDS_NUMBER] = {
+    // first length parity min  values
+    { 21,   7,     28,    0,   60 },  // MINUTE
+    { 29,   6,     35,    0,   24 },  // HOUR
+    { 36,   6,     -1,    1,   31 },  // DAY
+    { 42,   3,     -1,    1,   7 },   // WEEKDAY
+    { 45,   5,     -1,    1,   12 },  // MONTH
+    { 50,   8,     -1,    0,   100 }  // YEAR
+};
+
+
+DcfFrameAccumulator::DcfFrameAccumulator ():
+    scores{minutes, hours, days, weekdays, months, years},
+    dateParity(0),
+    framesNumber(0)
+{
+    reset();
+}
+
+
+void DcfFrameAccumulator::reset ()
+{
+    for (size_t f = 0; f < FIELDS_NUMBER; ++f)
+    {
+        clear((FieldType)f);
+    }
+    dateParity = 0;
+    framesNumber = 0;
+}
+
+
+void DcfFrameAccumulator::addFrame (const int8_t * bits, size_t elapsedMinutes)
+{
+    if (framesNumber > 0)
+    {
+        if (elapsedMinutes > MAX_ELAPSED_MINUTES)
+        {
+            reset();
+        }
+        for (size_t i = 0; i < elapsedMinutes && framesNumber > 0; ++i)
+        {
+            advanceMinute();
+        }
+    }
+
+    // older frames lose weight, i.e. a wrong prediction is forgotten
+    for (size_t f = 0; f < FIELDS_NUMBER; ++f)
+    {
+        const Field & field = fields[f];
+        for (size_t v = 0; v < field.valuesNumber; ++v)
+        {
+            int32_t & score = scores[f][v];
+            score -= score >> DECAY_SHIFT;
+
+            uint8_t code = toBcd(field.minValue + v);
+            int32_t corr = 0;
+            for (size_t i = 0; i < field.length; ++i)
+            {
+                corr += ((code >> i) & 1)? bits[field.first + i] : -bits[field.first + i];
+            }
+            if (field.parity >= 0)
+            {
+                corr += (__builtin_parity(code))? bits[field.parity] : -bits[field.parity];
+            }
+            score += corr;
+        }
+    }
+    dateParity -= dateParity >> DECAY_SHIFT;
+    dateParity += bits[DATE_PARITY_BIT];
+    ++framesNumber;
+}
+
+
+int DcfFrameAccumulator::getValue (FieldType f) const
+{
+    int32_t margin;
+    size_t best = findBest(f, margin);
+    int32_t required = (fields[f].parity >= 0)? 2 * DECISION_MARGIN : DECISION_MARGIN;
+    return (framesNumber > 0 && margin >= required)? fields[f].minValue + best : -1;
+}
+
+
+bool DcfFrameAccumulator::decode (::tm & dayTime) const
+{
+    int values[FIELDS_NUMBER];
+    uint8_t parity = 0;
+    for (size_t f = 0; f < FIELDS_NUMBER; ++f)
+    {
+        values[f] = getValue((FieldType)f);
+        if (values[f] < 0)
+        {
+            return false;
+        }
+        if (f >= DAY)
+        {
+            parity ^= __builtin_parity(toBcd(values[f]));
+        }
+    }
+    if ((parity && dateParity <= 0) || (!parity && dateParity >= 0))
+    {
+        USART_DEBUG("Date does not match its parity");
+        return false;
+    }
+
+    fillTime(values, dayTime);
+    return true;
+}
+
+
+void DcfFrameAccumulator::decodeFlags (const int8_t * bits, Flags & flags)
+{
+    const int8_t cest = bits[CEST_BIT], cet = bits[CET_BIT];
+    flags.valid = bits[MINUTE_START_BIT] <= FLAG_THRESHOLD &&
+                  bits[TIME_START_BIT] >= -FLAG_THRESHOLD &&
+                  !(cest > FLAG_THRESHOLD && cet > FLAG_THRESHOLD) &&
+                  !(cest < -FLAG_THRESHOLD && cet < -FLAG_THRESHOLD);
+    flags.callBit = bits[CALL_BIT] > 0;
+    flags.dstAnnounced = bits[DST_ANNOUNCEMENT_BIT] > 0;
+    flags.summerTime = cest > cet;
+    flags.leapSecondAnnounced = bits[LEAP_SECOND_ANNOUNCEMENT_BIT] > 0;
+}
+
+
+bool DcfFrameAccumulator::decodeFrame (const int8_t * bits, ::tm & dayTime)
+{
+    for (size_t i = 0; i <= DATE_PARITY_BIT; ++i)
+    {
+        if (bits[i] == 0)
+        {
+            return false;
+        }
+    }
+    if (bits[MINUTE_START_BIT] > 0 || bits[TIME_START_BIT] < 0 || (bits[CEST_BIT] > 0) == (bits[CET_BIT] > 0))
+    {
+        return false;
+    }
+
+    int values[FIELDS_NUMBER];
+    bool dateParity = false;
+    for (size_t f = 0; f < FIELDS_NUMBER; ++f)
+    {
+        const Field & field = fields[f];
+        uint8_t code = 0;
+        for (size_t i = 0; i < field.length; ++i)
+        {
+            code |= (bits[field.first + i] > 0) << i;
+        }
+        const int value = (code >> 4) * 10 + (code & 0x0F);
+        if ((code & 0x0F) > 9 || value < field.minValue || value >= field.minValue + field.valuesNumber)
+        {
+            return false;
+        }
+        if (field.parity >= 0 && __builtin_parity(code) != (bits[field.parity] > 0))
+        {
+            return false;
+        }
+        if (f >= DAY)
+        {
+            dateParity ^= __builtin_parity(code);
+        }
+        values[f] = value;
+    }
+    if (dateParity != (bits[DATE_PARITY_BIT] > 0))
+    {
+        return false;
+    }
+    fillTime(values, dayTime);
+    return true;
+}
+
+
+/**
+ * @brief Shifts the scores to the next minute. The carries follow the most
+ *        probable values; the day of month is not predicted but learned again.
+ */
+void DcfFrameAccumulator::advanceMinute ()
+{
+    int32_t margin;
+    size_t minute = findBest(MINUTE, margin);
+    rotate(MINUTE);
+    if (minute != fields[MINUTE].valuesNumber - 1U)
+    {
+        return;
+    }
+    size_t hour = findBest(HOUR, margin);
+    rotate(HOUR);
+    if (hour != fields[HOUR].valuesNumber - 1U)
+    {
+        return;
+    }
+    rotate(WEEKDAY);
+    clear(DAY);
+    clear(MONTH);
+    clear(YEAR);
+    dateParity = 0;
+}
+
+
+void DcfFrameAccumulator::rotate (FieldType f)
+{
+    int32_t * s = scores[f];
+    const size_t n = fields[f].valuesNumber;
+    int32_t last = s[n - 1];
+    for (size_t v = n - 1; v > 0; --v)
+    {
+        s[v] = s[v - 1];
+    }
+    s[0] = last;
+}
+
+
+void DcfFrameAccumulator::clear (FieldType f)
+{
+    for (size_t v = 0; v < fields[f].valuesNumber; ++v)
+    {
+        scores[f][v] = 0;
+    }
+}
+
+
+size_t DcfFrameAccumulator::findBest (FieldType f, int32_t & margin) const
+{
+    const int32_t * s = scores[f];
+    size_t best = 0;
+    int32_t first = INT32_MIN, second = INT32_MIN;
+    for (size_t v = 0; v < fields[f].valuesNumber; ++v)
+    {
+        if (s[v] > first)
+        {
+            second = first;
+            first = s[v];
+            best = v;
+        }
+        else if (s[v] > second)
+        {
+            second = s[v];
+        }
+    }
+    margin = first - second;
+    return best;
+}
+
+
+uint8_t DcfFrameAccumulator::toBcd (int value)
+{
+    return ((value / 10) << 4) | (value % 10);
+}
+
+
+/**
+ * @brief Fills the time from the field values. The time is the local wall-clock
+ *        time, the time zone is given by the flags.
+ */
+void DcfFrameAccumulator::fillTime (const int * values, ::tm & dayTime)
+{
+    dayTime.tm_sec = 0;
+    dayTime.tm_min = values[MINUTE];
+    dayTime.tm_hour = values[HOUR];
+    dayTime.tm_mday = values[DAY];
+    dayTime.tm_wday = values[WEEKDAY] % 7;
+    dayTime.tm_mon = values[MONTH] - 1;
+    dayTime.tm_year = values[YEAR] + 100;
+    dayTime.tm_isdst = 0;
+}
+
+
+/************************************************************************
+ * Class DcfSampleRecorder
+ ************************************************************************/
+
+DcfSampleRecorder::DcfSampleRecorder (RealTimeClock & _rtc):
+    rtc(_rtc),
+    writeBlock(0),
+    sampleNr(0),
+    currByte(0),
+    sequence(0),
+    dropped(0),
+    producedBlocks(0),
+    consumedBlocks(0)
+{
+    // empty
+}
+
+
+void DcfSampleRecorder::start ()
+{
+    writeBlock = 0;
+    sampleNr = 0;
+    currByte = 0;
+    sequence = 0;
+    dropped = 0;
+    producedBlocks = 0;
+    consumedBlocks = 0;
+}
+
+
+void DcfSampleRecorder::finish ()
+{
+    if (sampleNr == 0)
+    {
+        return;
+    }
+    size_t bits = sampleNr & 7;
+    if (bits != 0)
+    {
+        blocks[writeBlock].data[sampleNr >> 3] = currByte << (8 - bits);
+    }
+    closeBlock();
+}
+
+
+/**
+ * @brief Prepares the header of the next block. Fails if the ring is full.
+ */
+bool DcfSampleRecorder::openBlock ()
+{
+    if (producedBlocks - consumedBlocks >= BLOCKS_NUMBER)
+    {
+        return false;
+    }
+    Header & h = blocks[writeBlock].header;
+    h.magic = MAGIC;
+    h.samples = 0;
+    h.sequence = sequence++;
+    h.dropped = dropped;
+    h.reserved = 0;
+    h.startTime = rtc.getTimeMillisec();
+    dropped = 0;
+    return true;
+}
+
+
+void DcfSampleRecorder::closeBlock ()
+{
+    Block & b = blocks[writeBlock];
+    b.header.samples = sampleNr;
+    size_t used = (sampleNr + 7) >> 3;
+    ::memset(b.data + used, 0, DATA_SIZE - used);
+    sampleNr = 0;
+    currByte = 0;
+    writeBlock = (writeBlock + 1) % BLOCKS_NUMBER;
+    ++producedBlocks;
+}
+
+
+const uint8_t * DcfSampleRecorder::getReadyData (size_t & blocksNumber) const
+{
+    size_t first = consumedBlocks % BLOCKS_NUMBER;
+    blocksNumber = std::min(getReadyBlocks(), BLOCKS_NUMBER - first);
+    return reinterpret_cast<const uint8_t *>(&blocks[first]);
+}
+
+
+void DcfSampleRecorder::release (size_t blocksNumber)
+{
+    consumedBlocks += std::min(blocksNumber, getReadyBlocks());
+}
+
+
+/************************************************************************
+ * Class DcfEdgeFilter
+ ************************************************************************/
+
+DcfEdgeFilter::DcfEdgeFilter ()
+{
+    reset(0, false);
+}
+
+
+void DcfEdgeFilter::reset (uint32_t now, bool _level)
+{
+    isPending = false;
+    firstEdge = 0;
+    edgesNumber = 0;
+    level = _level;
+    nextSample = now + SAMPLE_PERIOD;
+    glitches = 0;
+}
+
+
+void DcfEdgeFilter::addEdge (const Edge & e)
+{
+    const Edge * last = isPending? &pending : (edgesNumber > 0)? &edges[(firstEdge + edgesNumber - 1) % MAX_EDGES] : NULL;
+    if (e.level == ((last != NULL)? last->level : level))
+    {
+        // the level does not change, e.g. the ISR read the level after a glitch
+        return;
+    }
+    if (isPending && (int32_t)(e.time - pending.time) < (int32_t)GLITCH_TIME)
+    {
+        // the pending edge and this edge enclose a glitch
+        isPending = false;
+        ++glitches;
+        return;
+    }
+    confirmPending();
+    pending = e;
+    isPending = true;
+}
+
+
+bool DcfEdgeFilter::getSample (uint32_t now, bool & sample)
+{
+    // all edges before the grid point are final if it is older than GLITCH_TIME
+    if ((int32_t)(now - nextSample) < (int32_t)GLITCH_TIME)
+    {
+        return false;
+    }
+    if (isPending && (int32_t)(now - pending.time) >= (int32_t)GLITCH_TIME)
+    {
+        confirmPending();
+    }
+    while (edgesNumber > 0 && (int32_t)(edges[firstEdge].time - nextSample) <= 0)
+    {
+        level = edges[firstEdge].level;
+        firstEdge = (firstEdge + 1) % MAX_EDGES;
+        --edgesNumber;
+    }
+    sample = level;
+    nextSample += SAMPLE_PERIOD;
+    return true;
+}
+
+
+void DcfEdgeFilter::confirmPending ()
+{
+    if (!isPending)
+    {
+        return;
     }
-    for (size_t i = 0; i < lastSample; ++i)
+    if (edgesNumber == MAX_EDGES)
     {
-        samples[i] = samples[i+1];
+        // the samples are not fetched: the oldest edge is applied at once
+        level = edges[firstEdge].level;
+        firstEdge = (firstEdge + 1) % MAX_EDGES;
+        --edgesNumber;
     }
-    samples[lastSample] = val;
-    return (nrTrue > nrFalse)? true : false;
+    edges[(firstEdge + edgesNumber) % MAX_EDGES] = pending;
+    ++edgesNumber;
+    isPending = false;
+}
+
+
+/************************************************************************
+ * Class DcfEdgeCapture
+ ************************************************************************/
+
+DcfEdgeCapture::DcfEdgeCapture (IOPin & _pinInput, uint32_t _alternate, Timer::TimerName timerName, IRQn_Type timerIrq, uint32_t _channel):
+    pinInput(_pinInput),
+    alternate(_alternate),
+    timer(timerName, timerIrq),
+    channel(_channel),
+    captureFlag(TIM_IT_CC1 << (_channel >> 2)),
+    edges()
+{
+    // empty
+}
+
+
+void DcfEdgeCapture::start (const InterruptPriority & prio)
+{
+    pinInput.setAlternate(alternate);
+    pinInput.setMode(GPIO_MODE_AF_PP);
+    edges.clear();
+
+    // free-running counter; the APB1 timer clock is the half of the MCU clock
+    TIM_HandleTypeDef * t = timer.getTimerParameters();
+    t->Init.CounterMode = TIM_COUNTERMODE_UP;
+    t->Init.Prescaler = System::getMcuFreq() / 2 / TICKS_PER_SEC - 1;
+    t->Init.Period = UINT32_MAX;
+    t->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    t->Init.RepetitionCounter = 0;
+    HAL_TIM_IC_Init(t);
+
+    TIM_IC_InitTypeDef ic;
+    ic.ICPolarity = TIM_INPUTCHANNELPOLARITY_BOTHEDGE;
+    ic.ICSelection = TIM_ICSELECTION_DIRECTTI;
+    ic.ICPrescaler = TIM_ICPSC_DIV1;
+    ic.ICFilter = INPUT_FILTER;
+    HAL_TIM_IC_ConfigChannel(t, &ic, channel);
+
+    timer.startInterrupt(prio);
+    HAL_TIM_IC_Start_IT(t, channel);
+}
+
+
+void DcfEdgeCapture::stop ()
+{
+    TIM_HandleTypeDef * t = timer.getTimerParameters();
+    HAL_TIM_IC_Stop_IT(t, channel);
+    timer.stopInterrupt();
+    HAL_TIM_IC_DeInit(t);
+    pinInput.setMode(GPIO_MODE_INPUT);
 }
 
 
@@ -72,17 +629,31 @@ DcfReceiver::DcfReceiver(RealTimeClock & _rtc, IOPin & _pinInput, IOPin & _pinPo
     pinInput(_pinInput),
     pinPower(_pinPower),
     timer(timerName, timerIrq),
+    recorder(NULL),
+    edgeCapture(NULL),
+    edgeFilter(),
     active(false),
     dataBitsAvailable(false),
-    filter(),
+    secondElapsed(false),
+    events(),
+    reportedOverflows(0),
+    sampleTime(0),
+    phaseDetector(),
     secondNr(-1),
-    sampleNr(SIZE_MAX),
+    bin(0),
     errorNr(0),
-    prevSample(false),
-    highStart(0),
-    highEnd(0),
+    markSum(0),
+    bitSum(0),
+    secondCounter(0),
+    minuteMark(-1),
     ptrRec(NULL),
-    ptrProc(NULL)
+    ptrProc(NULL),
+    accumulator(),
+    lastFrameTime(0),
+    singleFrameTime(0),
+    singleFrameReceived(0),
+    timePending(false),
+    markTime(0)
 {
     ptrRec = &dataBits1[0];
     ptrProc = &dataBits2[0];
@@ -93,9 +664,21 @@ void DcfReceiver::start (const InterruptPriority & prio, EventHandler * _handler
 {
     reset();
     handler = _handler;
+    if (recorder != NULL)
+    {
+        recorder->start();
+    }
     pinPower.setLow();
-    timer.start(TIM_COUNTERMODE_UP, System::getMcuFreq() / 2000, 1000/DCF_SAMPLE_PER_SEC - 1);
-    timer.startInterrupt(prio);
+    if (edgeCapture != NULL)
+    {
+        edgeCapture->start(prio);
+        edgeFilter.reset(edgeCapture->getTime(), !pinInput.getBit());
+    }
+    else
+    {
+        timer.start(TIM_COUNTERMODE_UP, System::getMcuFreq() / 2000, 1000/DCF_SAMPLE_PER_SEC - 1);
+        timer.startInterrupt(prio);
+    }
     active = true;
     USART_DEBUG("Started receiver, irqPrio = " << prio.first << "," << prio.second);
 }
@@ -103,239 +686,373 @@ void DcfReceiver::start (const InterruptPriority & prio, EventHandler * _handler
 
 void DcfReceiver::periodic ()
 {
+    if (edgeCapture != NULL && active)
+    {
+        processEdges();
+    }
+    SecondEvent e;
+    while (events.get(e))
+    {
+        processEvent(e);
+    }
+    if (events.getOverflows() != reportedOverflows)
+    {
+        reportedOverflows = events.getOverflows();
+        USART_DEBUG("Event queue overflow, " << reportedOverflows << " event(s) dropped");
+    }
+    if (secondElapsed)
+    {
+        secondElapsed = false;
+        phaseDetector.evaluate();
+        evaluateMinutePhase();
+    }
     if (dataBitsAvailable)
     {
         dataBitsAvailable = false;
-        for (size_t i = 0; i < DCF_BITS_PER_MIN; ++i)
-        {
-            logStr[i] = (ptrProc[i] == 0)? '0' : '1';
-        }
-        logStr[DCF_BITS_PER_MIN] = 0;
-        USART_DEBUG("Bits: " << logStr << ";");
-        if (decodeTime(ptrProc, 21))
-        {
-            sprintf(logStr, "%02d.%02d.%04d %02d:%02d",
-                    dayTime.tm_mday,
-                    dayTime.tm_mon+1,
-                    dayTime.tm_year,
-                    dayTime.tm_hour,
-                    dayTime.tm_min);
-
-            USART_DEBUG(logStr);
-            if (handler != NULL)
-            {
-                handler->onDcfTimeReceived(dayTime, logStr);
-            }
-        }
+        processFrame();
     }
 }
 
 
-void DcfReceiver::onSample ()
+/**
+ * @brief Decodes a complete frame. A frame that is decoded by itself is accepted
+ *        at once if it matches the time predicted by the RTC or the frame of the
+ *        previous minute decoded by itself. Otherwise, the accumulated frames are decoded, and the
+ *        result is rejected if it contradicts the current frame. The accepted time
+ *        is reported with the next minute mark.
+ */
+void DcfReceiver::processFrame ()
 {
-    __HAL_TIM_CLEAR_IT(timer.getTimerParameters(), TIM_IT_UPDATE);
+    for (size_t i = 0; i < DCF_BITS_PER_MIN; ++i)
+    {
+        logStr[i] = (ptrProc[i] == 0)? '?' : (ptrProc[i] < 0)? '0' : '1';
+    }
+    logStr[DCF_BITS_PER_MIN] = 0;
+    USART_DEBUG("Bits: " << logStr << ";");
 
-    time_ms now = rtc.getTimeMillisec();
-    bool newSample = filter.processSample(!pinInput.getBit());
-    if (!prevSample && newSample)
+    DcfFrameAccumulator::decodeFlags(ptrProc, flags);
+    if (!flags.valid)
     {
-        duration_ms highDuration = 0, lowDuration = 0;
-        if (highEnd > highStart)
+        USART_DEBUG("Frame structure is invalid");
+        return;
+    }
+    if (flags.dstAnnounced || flags.leapSecondAnnounced)
+    {
+        USART_DEBUG("Announced: DST change = " << flags.dstAnnounced << ", leap second = " << flags.leapSecondAnnounced);
+    }
+
+    // the scores are shifted by the minutes since the previous frame
+    time_t now = rtc.getTimeSec();
+    accumulator.addFrame(ptrProc, (now - lastFrameTime + 30) / 60);
+    lastFrameTime = now;
+
+    // the frame refers to the next minute mark, about two seconds after its last bit
+    const time_t predicted = (now + 2 + 30) / 60 * 60;
+    ::tm frameTm;
+    const char * source = NULL;
+    if (DcfFrameAccumulator::decodeFrame(ptrProc, frameTm))
+    {
+        const time_t frameTime = ::mktime(&frameTm);
+        const time_t elapsed = (now - singleFrameReceived + 30) / 60 * 60;
+        if (frameTime == predicted)
         {
-            highDuration = highEnd - highStart;
+            source = "prediction";
         }
-        if (rtc.getTimeMillisec() > highEnd)
+        else if (singleFrameTime != 0 && elapsed == 60 && frameTime == singleFrameTime + elapsed)
         {
-            lowDuration = now - highEnd;
+            source = "previous frame";
         }
-        bool bit = highDuration < 150? false : true;
-        size_t s = sampleNr;
-
-        bool sampleValid = false;
-        if (sampleNr >= DCF_SAMPLE_PER_SEC - SAMPLE_TOLERANCE)
+        singleFrameTime = frameTime;
+        singleFrameReceived = now;
+        if (source != NULL)
+        {
+            dayTime = frameTm;
+        }
+        else if (accumulator.decode(dayTime))
         {
-            if (lowDuration > 1500)
+            if (::mktime(&dayTime) == frameTime)
             {
-                ++secondNr;
-                if (secondNr == DCF_BITS_PER_MIN - 1)
-                {
-                    dataBitsAvailable = true;
-                }
-                secondNr = DCF_BITS_PER_MIN - 1;
-                sampleValid = true;
-
+                source = "accumulator";
             }
-            else if (sampleNr <= DCF_SAMPLE_PER_SEC + SAMPLE_TOLERANCE)
+            else
             {
-                ++secondNr;
-                if (secondNr > DCF_BITS_PER_MIN - 1)
-                {
-                    secondNr = 0;
-                }
-                sampleValid = true;
+                USART_DEBUG("Accumulated time contradicts the frame");
             }
-            sampleNr = 0;
         }
+    }
+    else if (accumulator.decode(dayTime))
+    {
+        source = "accumulator";
+    }
+    if (source == NULL)
+    {
+        return;
+    }
+
+    // the minute with a leap second has a mark more, i.e. the next mark is late
+    if (flags.leapSecondAnnounced && dayTime.tm_min == 0)
+    {
+        USART_DEBUG("Time is not reported before the leap second");
+        return;
+    }
+    sprintf(logStr, "%02d.%02d.%04d %02d:%02d",
+            dayTime.tm_mday,
+            dayTime.tm_mon+1,
+            dayTime.tm_year,
+            dayTime.tm_hour,
+            dayTime.tm_min);
+    USART_DEBUG(logStr << " " << (flags.summerTime? "CEST" : "CET") << ", confirmed by " << source);
+    timePending = true;
+}
+
 
-        if (sampleValid)
+void DcfReceiver::onSample ()
+{
+    __HAL_TIM_CLEAR_IT(timer.getTimerParameters(), TIM_IT_UPDATE);
+    bool rawSample = !pinInput.getBit();
+    sampleTime = rtc.getMonotonicMillisec();
+    if (recorder != NULL)
+    {
+        recorder->addSample(rawSample);
+    }
+    processSample(rawSample);
+}
+
+
+void DcfReceiver::processSample (bool rawSample)
+{
+    phaseDetector.addSample(bin, rawSample);
+
+    int16_t phase = phaseDetector.getPhase();
+    if (phase >= 0)
+    {
+        // decisions are taken on the locked phase
+        size_t offset = (bin + DcfPhaseDetector::BINS - phase) % DcfPhaseDetector::BINS;
+        if (offset < WINDOW_SAMPLES)
         {
-            errorNr = 0;
+            markSum = (offset == 0)? rawSample : markSum + rawSample;
         }
-        else
+        else if (offset < 2 * WINDOW_SAMPLES)
         {
-            ++errorNr;
-            secondNr = -1;
-        }
-
-        if (errorNr == 0)
-        {
-            storeBit(secondNr, bit);
-            if (dataBitsAvailable)
+            bitSum = (offset == WINDOW_SAMPLES)? rawSample : bitSum + rawSample;
+            if (offset == 2 * WINDOW_SAMPLES - 1)
             {
-                std::swap(ptrRec, ptrProc);
+                processSecond(markSum, bitSum);
             }
         }
-
-        USART_DEBUG("[" << secondNr
-                << "]: sample=" << s
-                << "; errors=" << errorNr
-                << "; H/L=" << highDuration << "/" << lowDuration
-                << "; bit=" << bit
-                << (dataBitsAvailable? " // end of minute" : ""));
-        if (handler != NULL)
+    }
+    else if (bin == 0)
+    {
+        // searching the phase
+        if (minuteMark >= 0)
         {
-            handler->onDcfBit(secondNr, errorNr, bit);
+            resetMinutePhase();
         }
-
-        highStart = now;
+        secondNr = -1;
+        ++errorNr;
+        events.put({secondNr, -1, (uint32_t)errorNr, 0, 0, false, sampleTime});
     }
-    else if (prevSample && !newSample)
+
+    if (++bin == DcfPhaseDetector::BINS)
     {
-        highEnd = now;
+        bin = 0;
+        secondElapsed = true;
     }
-    ++sampleNr;
-    prevSample = newSample;
 }
 
 
-void DcfReceiver::stop ()
+/**
+ * @brief Feeds the captured edges into the filter and processes the samples that
+ *        are final. Called from the main loop in the edge capture mode.
+ */
+void DcfReceiver::processEdges ()
 {
-    reset();
-    pinPower.setHigh();
-    timer.stop();
-    active = false;
-    USART_DEBUG("Stopped receiver");
+    // the time is taken first: all edges before it are already queued
+    uint32_t now = edgeCapture->getTime();
+    const time_ms nowMs = rtc.getMonotonicMillisec();
+    DcfEdgeFilter::Edge e;
+    while (edgeCapture->getEdge(e))
+    {
+        edgeFilter.addEdge(e);
+    }
+    bool sample;
+    while (edgeFilter.getSample(now, sample))
+    {
+        // the sample refers to its grid point, not to the time it became final
+        sampleTime = nowMs - (now - edgeFilter.getSampleTime()) / 1000;
+        if (recorder != NULL)
+        {
+            recorder->addSample(sample);
+        }
+        processSample(sample);
+    }
 }
 
 
-void DcfReceiver::storeBit (int16_t sec, bool bit)
+/**
+ * @brief Handles a second of the locked phase. Seconds 0..58 start with a mark,
+ *        the missing mark of second 59 announces the next minute. The levels are
+ *        the numbers of samples with carrier reduction in the mark and bit windows.
+ */
+void DcfReceiver::processSecond (size_t markLevel, size_t bitLevel)
 {
-    if (sec >= 0 && sec < DCF_BITS_PER_MIN)
+    errorNr = 0;
+    int16_t & p = markProfile[secondCounter];
+    p += ((int16_t)(markLevel * MARK_SCALE / WINDOW_SAMPLES) - p) >> 1;
+
+    // soft bit within [-SOFT_MAX, SOFT_MAX]: zero if half of the window is reduced
+    const int32_t span = WINDOW_SAMPLES - 2 * SATURATION_SAMPLES;
+    int32_t soft = ((int32_t)(2 * bitLevel) - (int32_t)WINDOW_SAMPLES) * DcfFrameAccumulator::SOFT_MAX / span;
+    soft = std::max<int32_t>(-DcfFrameAccumulator::SOFT_MAX, std::min<int32_t>(DcfFrameAccumulator::SOFT_MAX, soft));
+
+    bool endOfMinute = false;
+    int16_t mm = minuteMark;
+    if (mm >= 0)
+    {
+        secondNr = (secondCounter + SECONDS_PER_MIN - 1 - mm) % SECONDS_PER_MIN;
+        storeBit(secondNr, soft);
+        if (secondNr == DCF_BITS_PER_MIN - 1)
+        {
+            std::swap(ptrRec, ptrProc);
+            dataBitsAvailable = true;
+            endOfMinute = true;
+        }
+    }
+    else
     {
-        ptrRec[sec] = bit;
+        secondNr = -1;
     }
+    if (++secondCounter == SECONDS_PER_MIN)
+    {
+        secondCounter = 0;
+    }
+
+    // logging and the handler are served from the main loop
+    events.put({secondNr, phaseDetector.getPhase(), (uint32_t)errorNr, (uint8_t)markLevel, (int8_t)soft, endOfMinute, sampleTime});
 }
 
 
-bool DcfReceiver::isCheckSumValid (const uint8_t * bits, size_t i1, size_t i2) const
+/**
+ * @brief Reports a second that was detected by the sampling ISR. Called from the main loop.
+ */
+void DcfReceiver::processEvent (const SecondEvent & e)
 {
-    uint8_t sum = 0;
-    for (size_t i = i1; i < i2; ++i)
+    bool bit = e.softBit > 0;
+    uint8_t confidence = ::abs(e.softBit) * 100 / DcfFrameAccumulator::SOFT_MAX;
+    if (e.phase >= 0)
     {
-        sum += bits[i];
+        USART_DEBUG("[" << e.secondNr
+                << "]: phase=" << e.phase
+                << "; mark=" << (int)e.markLevel
+                << "; bit=" << bit << "/" << (int)confidence << "%"
+                << (e.endOfMinute? " // end of minute" : ""));
+    }
+    if (handler != NULL)
+    {
+        handler->onDcfBit(e.secondNr, e.errorNr, bit, confidence);
+    }
+
+    // the handler may stop the receiver, i.e. the time is reported at last
+    if (timePending && e.secondNr <= 0)
+    {
+        timePending = false;
+        if (e.secondNr < 0)
+        {
+            USART_DEBUG("Phase lost before the minute mark");
+        }
+        else if (handler != NULL)
+        {
+            markTime = e.time - MARK_DELAY;
+            handler->onDcfTimeReceived(dayTime, logStr);
+        }
     }
-    uint8_t checkBit = bits[i2];
-    return (sum % 2 == checkBit);
 }
 
 
-int DcfReceiver::getData (const uint8_t * bits, size_t i1, size_t i2) const
+void DcfReceiver::stop ()
 {
-    static int coeff[8] = {1, 2, 4, 8, 10, 20, 40, 80};
-    int data = 0;
-    for (size_t i = i1; i < i2; ++i)
+    pinPower.setHigh();
+    if (edgeCapture != NULL)
     {
-        data += coeff[i-i1] * bits[i];
+        edgeCapture->stop();
+        USART_DEBUG("Glitches removed: " << edgeFilter.getGlitches()
+                << ", edges dropped: " << edgeCapture->getOverflows());
     }
-    return data;
+    else
+    {
+        timer.stop();
+    }
+    reset();
+    if (recorder != NULL)
+    {
+        recorder->finish();
+    }
+    active = false;
+    USART_DEBUG("Stopped receiver");
 }
 
 
-bool DcfReceiver::decodeTime (const uint8_t * bits, size_t start)
+/**
+ * @brief Searches the second whose mark is clearly missing more often than
+ *        in all other seconds. Called once a second from the main loop.
+ */
+void DcfReceiver::evaluateMinutePhase ()
 {
-    // see https://de.wikipedia.org/wiki/DCF77
-    // Header [0-19]            |T|Min [21]|H[29]  |Data[36-58]
-    // 0|Reserved[1-14]|A|C|Z |C|1|       C|      C|
-    // 0|01011110001010|0|0|10|0|1|00011011|0100010|10100100101100101010001
-    // 0|00101110101110|0|0|10|0|1|10000001|1100011|10100100101100101010001
-    // 0|10101010010111|0|0|10|0|1|01000001|1100011|10100100101100101010001
-    // 0|00000010001010|0|0|10|0|1|10100001|1100011|10100100101100101010001
-
-    // minute
-    bool valid = true;
-    int min = -1;
+    size_t first = 0;
+    int16_t min1 = INT16_MAX, min2 = INT16_MAX;
+    for (size_t s = 0; s < SECONDS_PER_MIN; ++s)
     {
-        if (isCheckSumValid(bits, start, start + 7))
+        if (markProfile[s] < min1)
         {
-            min = getData(bits, start, start + 7);
+            min2 = min1;
+            min1 = markProfile[s];
+            first = s;
         }
-        else
+        else if (markProfile[s] < min2)
         {
-            USART_DEBUG("Invalid check bit for minutes");
-            valid = false;
+            min2 = markProfile[s];
         }
     }
-
-    // hour
-    int hour = -1;
+    if (min2 - min1 >= MARK_SCALE / 4 && minuteMark != (int16_t)first)
     {
-        if (isCheckSumValid(bits, start + 8, start + 14))
-        {
-            hour = getData(bits, start + 8, start + 14);
-        }
-        else
-        {
-            USART_DEBUG("Invalid check bit for hour");
-            valid = false;
-        }
+        USART_DEBUG("Minute mark found at " << first);
+        minuteMark = first;
     }
+}
+
 
-    // date
-    int day = -1, month = -1, year = -1;
+void DcfReceiver::resetMinutePhase ()
+{
+    for (auto & p : markProfile)
     {
-        if (isCheckSumValid(bits, start + 15, start + 37))
-        {
-            day = getData(bits, start + 15, start + 21);
-            month = getData(bits, start + 24, start + 29);
-            year = getData(bits, start + 29, start + 37);
-        }
-        else
-        {
-            USART_DEBUG("Invalid check bit for date");
-            valid = false;
-        }
+        p = MARK_SCALE / 2;
     }
+    secondCounter = 0;
+    minuteMark = -1;
+}
+
 
-    if (valid)
+void DcfReceiver::storeBit (int16_t sec, int8_t softBit)
+{
+    if (sec >= 0 && sec < DCF_BITS_PER_MIN)
     {
-        dayTime.tm_sec = 0;
-        dayTime.tm_min = min;
-        dayTime.tm_hour = hour;
-        dayTime.tm_mday = day;
-        dayTime.tm_mon = month - 1;
-        dayTime.tm_year = year + 100;
+        ptrRec[sec] = softBit;
     }
-
-    return valid;
 }
 
 
 void DcfReceiver::reset ()
 {
     secondNr = -1;
-    sampleNr = SIZE_MAX;
+    bin = 0;
     errorNr = 0;
-    prevSample = filter.getDefault();
-    highStart = 0;
-    highEnd = 0;
+    markSum = 0;
+    bitSum = 0;
+    phaseDetector.reset();
+    resetMinutePhase();
+    accumulator.reset();
+    flags = DcfFrameAccumulator::Flags();
+    singleFrameTime = 0;
+    timePending = false;
+    events.clear();
 }
@@ -22,6 +22,7 @@
 #define DCF77_H_
 
 #include "../StmPlusPlus.h"
+#include "../EventQueue.h"
 
 namespace StmPlusPlus {
 namespace Devices {
@@ -30,15 +31,24 @@ namespace Devices {
  * Class MedianFilter
  ************************************************************************/
 
-class MedianFilter
+/**
+ * @brief Sliding-window majority filter for binary samples.
+ *
+ * The window is kept as a shift register together with the number of set
+ * bits, so a sample costs a shift, a mask and an add for any window length.
+ * Until the window is filled, the default value is returned. Afterwards,
+ * the result is the majority of the window preceding the new sample.
+ */
+template <size_t window> class MedianFilter
 {
 public:
 
-    static const size_t DCF_FILTER_WINDOW = 7;
+    static_assert(window > 0 && window < 32, "Window does not fit into the shift register");
 
     MedianFilter ():
-        currSample(0),
-        lastSample(DCF_FILTER_WINDOW - 1)
+        samples(0),
+        samplesCount(0),
+        filled(0)
     {
         // empty
     }
@@ -48,14 +58,486 @@ public:
         return false;
     }
 
-    bool processSample (bool val);
+    inline bool processSample (bool val)
+    {
+        bool retValue = (filled < window)? getDefault() : (2 * samplesCount > window);
+        if (filled < window)
+        {
+            ++filled;
+        }
+        uint32_t oldest = (samples >> (window - 1)) & 1;
+        samples = ((samples << 1) | (uint32_t)val) & WINDOW_MASK;
+        samplesCount += (uint32_t)val - oldest;
+        return retValue;
+    }
+
+private:
+
+    static const uint32_t WINDOW_MASK = (1UL << window) - 1;
+
+    uint32_t samples;
+    uint32_t samplesCount;
+    uint32_t filled;
+
+};
+
+static const size_t DCF_FILTER_WINDOW = 7;
+typedef MedianFilter<DCF_FILTER_WINDOW> DcfMedianFilter;
+
+
+/************************************************************************
+ * Class DcfPhaseDetector
+ ************************************************************************/
+
+/**
+ * @brief Class that locks the phase of the DCF77 second marks.
+ *
+ * Each raw sample is averaged into the bin of its position within the second,
+ * i.e. the bins converge to the probability of the carrier reduction at this
+ * position. Once a second, the profile is correlated with the pulse template:
+ * the first 100 ms always contain a reduction, the last 800 ms never. The bins
+ * between 100 and 200 ms depend on the bit value and are ignored. A single
+ * noisy edge does not move the phase since the evidence of many seconds is
+ * integrated.
+ */
+class DcfPhaseDetector
+{
+public:
+
+    static const size_t BINS = 100;
+    static const size_t PULSE_BINS = 10;
+    static const size_t GAP_BEGIN = 20;
+    static const int32_t GAP_WEIGHT = (BINS - GAP_BEGIN) / PULSE_BINS;
+    static const int32_t FULL_SCALE = 4096;
+    static const int PROFILE_SHIFT = 3; // time constant of 2^3 seconds
+
+    // ideal score is PULSE_BINS * GAP_WEIGHT * FULL_SCALE; a random signal gives zero
+    static const int32_t LOCK_THRESHOLD = PULSE_BINS * GAP_WEIGHT * FULL_SCALE / 3;
+    static const int32_t UNLOCK_THRESHOLD = LOCK_THRESHOLD / 2;
+    static const size_t LOCK_CONFIRMATIONS = 3;
+
+    DcfPhaseDetector ();
+
+    void reset ();
+
+    /**
+     * @brief Adds a raw sample. Called from the sampling interrupt.
+     */
+    inline void addSample (size_t bin, bool sample)
+    {
+        int32_t p = profile[bin];
+        profile[bin] = p + ((((int32_t)sample * FULL_SCALE) - p) >> PROFILE_SHIFT);
+    }
+
+    /**
+     * @brief Correlates the profile with the template and updates the lock.
+     *        Called once a second from the main loop.
+     */
+    void evaluate ();
+
+    /**
+     * @brief Returns the bin of the second mark or -1 if the phase is not locked.
+     */
+    inline int16_t getPhase () const
+    {
+        return phase;
+    }
+
+    inline int32_t getScore () const
+    {
+        return score;
+    }
+
+private:
+
+    int16_t profile[BINS];
+    volatile int16_t phase;
+    int16_t candidate;
+    size_t confirmations;
+    int32_t score;
+};
+
+
+/************************************************************************
+ * Class DcfFrameAccumulator
+ ************************************************************************/
+
+/**
+ * @brief Class that integrates the soft bits of consecutive DCF77 frames.
+ *
+ * Each possible value of a time field keeps a score: the correlation of its
+ * BCD code and parity bit with the received soft bits. Before a frame is added,
+ * the scores are shifted by the elapsed minutes (with carries into the hour
+ * and the date), i.e. they always predict the current frame. A field is
+ * decided when its best value leads the second best by more than a single
+ * clean frame can provide. The date fields are additionally checked against the date parity.
+ * A single corrupted bit therefore does not discard the evidence of a minute.
+ *
+ * The flags of a frame (time zone, announcements) are not accumulated but
+ * decoded from each frame, and a single frame can be decoded by hard decisions
+ * in order to check it against a predicted time.
+ */
+class DcfFrameAccumulator
+{
+public:
+
+    static const int8_t SOFT_MAX = 64;
+
+    // a value differing in a single bit needs one and a half clean frames, i.e.
+    // a single frame is never sufficient (fields with parity need the double)
+    static const int32_t DECISION_MARGIN = 3 * SOFT_MAX;
+    static const int DECAY_SHIFT = 4;
+    static const size_t DATE_PARITY_BIT = 58;
+    static const size_t MAX_ELAPSED_MINUTES = 120;
+
+    // see https://de.wikipedia.org/wiki/DCF77
+    static const size_t MINUTE_START_BIT = 0;
+    static const size_t CALL_BIT = 15;
+    static const size_t DST_ANNOUNCEMENT_BIT = 16;
+    static const size_t CEST_BIT = 17;
+    static const size_t CET_BIT = 18;
+    static const size_t LEAP_SECOND_ANNOUNCEMENT_BIT = 19;
+    static const size_t TIME_START_BIT = 20;
+
+    // a structural bit is only considered wrong if it is received with this confidence
+    static const int8_t FLAG_THRESHOLD = SOFT_MAX / 2;
+
+    enum FieldType
+    {
+        MINUTE = 0,
+        HOUR = 1,
+        DAY = 2,
+        WEEKDAY = 3,
+        MONTH = 4,
+        YEAR = 5,
+        FIELDS_NUMBER = 6
+    };
+
+    struct Field
+    {
+        uint8_t first;        // bit of the lowest BCD digit
+        uint8_t length;       // number of bits
+        int8_t parity;        // parity bit of the field or -1
+        uint8_t minValue;
+        uint8_t valuesNumber;
+    };
+
+    static const Field fields[FIELDS_NUMBER];
+
+    struct Flags
+    {
+        bool valid;                  // the structural bits are not confidently wrong
+        bool callBit;                // irregularity of the transmitter
+        bool dstAnnounced;           // the time zone changes at the end of the hour
+        bool summerTime;             // CEST, otherwise CET
+        bool leapSecondAnnounced;    // a leap second is inserted at the end of the hour
+    };
+
+    DcfFrameAccumulator ();
+
+    void reset ();
+
+    /**
+     * @brief Adds a frame of soft bits: positive for 1, negative for 0 and
+     *        zero if the bit is unknown.
+     */
+    void addFrame (const int8_t * bits, size_t elapsedMinutes);
+
+    /**
+     * @brief Returns the decided value of the field or -1.
+     */
+    int getValue (FieldType f) const;
+
+    /**
+     * @brief Fills the time if all fields are decided.
+     */
+    bool decode (::tm & dayTime) const;
+
+    /**
+     * @brief Decodes the flags of a frame. The frame is invalid if the start
+     *        of minute or time bit, or the time zone bits are confidently wrong.
+     */
+    static void decodeFlags (const int8_t * bits, Flags & flags);
+
+    /**
+     * @brief Decodes a single frame by hard decisions: all bits shall be known,
+     *        the BCD digits and the values within their ranges and all parities
+     *        valid. Used to check a frame against a predicted time.
+     */
+    static bool decodeFrame (const int8_t * bits, ::tm & dayTime);
+
+    inline size_t getFramesNumber () const
+    {
+        return framesNumber;
+    }
+
+private:
+
+    int32_t minutes[60], hours[24], days[31], weekdays[7], months[12], years[100];
+    int32_t * scores[FIELDS_NUMBER];
+    int32_t dateParity;
+    size_t framesNumber;
+
+    void advanceMinute ();
+    void rotate (FieldType f);
+    void clear (FieldType f);
+    size_t findBest (FieldType f, int32_t & margin) const;
+    static uint8_t toBcd (int value);
+    static void fillTime (const int * values, ::tm & dayTime);
+};
+
+
+/************************************************************************
+ * Class DcfSampleRecorder
+ ************************************************************************/
+
+/**
+ * @brief Class that records the raw samples of the receiver for offline analysis.
+ *
+ * The samples are bit-packed (MSB first) into blocks of the SD card sector size.
+ * Each block starts with a header that contains the RTC time of its first sample,
+ * i.e. the blocks are appended to the capture file as they are and each file
+ * offset stays sector-aligned. The ISR only shifts a bit; full blocks are handed
+ * over to the main loop via a single-producer/single-consumer ring. If the ring
+ * is full, the samples are dropped and counted in the next block.
+ */
+class DcfSampleRecorder
+{
+public:
+
+    static const uint32_t MAGIC = 0x43464344; // "DCFC"
+    static const size_t BLOCK_SIZE = 512;
+    static const size_t BLOCKS_NUMBER = 8;
+
+    /**
+     * @brief Number of ready blocks that shall be written at once.
+     */
+    static const size_t FLUSH_BLOCKS = BLOCKS_NUMBER / 2;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint16_t samples;  // number of valid samples in this block
+        uint16_t sequence; // block number since the start of the capture
+        uint32_t dropped;  // samples dropped before this block
+        uint32_t reserved;
+        time_ms startTime; // RTC time of the first sample
+    };
+
+    static const size_t DATA_SIZE = BLOCK_SIZE - sizeof(Header);
+    static const size_t SAMPLES_PER_BLOCK = 8 * DATA_SIZE;
+
+    struct Block
+    {
+        Header header;
+        uint8_t data[DATA_SIZE];
+    };
+
+    static_assert(sizeof(Block) == BLOCK_SIZE, "Block does not match the sector size");
+
+    DcfSampleRecorder (RealTimeClock & _rtc);
+
+    /**
+     * @brief Starts a new capture. All pending blocks are discarded.
+     */
+    void start ();
+
+    /**
+     * @brief Closes the incomplete block. The ISR shall not add samples anymore.
+     */
+    void finish ();
+
+    /**
+     * @brief Adds a sample. Called from the sampling ISR.
+     */
+    inline void addSample (bool sample)
+    {
+        if (sampleNr == 0 && !openBlock())
+        {
+            ++dropped;
+            return;
+        }
+        currByte = (currByte << 1) | (uint8_t)sample;
+        ++sampleNr;
+        if ((sampleNr & 7) == 0)
+        {
+            blocks[writeBlock].data[(sampleNr >> 3) - 1] = currByte;
+            if (sampleNr == SAMPLES_PER_BLOCK)
+            {
+                closeBlock();
+            }
+        }
+    }
+
+    inline size_t getReadyBlocks () const
+    {
+        return producedBlocks - consumedBlocks;
+    }
+
+    inline bool isFlushRequired () const
+    {
+        return getReadyBlocks() >= FLUSH_BLOCKS;
+    }
+
+    /**
+     * @brief Returns the oldest ready blocks that are contiguous in memory.
+     *
+     * @param blocksNumber number of returned blocks, 0 if none is ready.
+     */
+    const uint8_t * getReadyData (size_t & blocksNumber) const;
+
+    /**
+     * @brief Releases the given number of ready blocks after they are written.
+     */
+    void release (size_t blocksNumber);
+
+private:
+
+    RealTimeClock & rtc;
+    Block blocks[BLOCKS_NUMBER];
+
+    // producer (ISR) side
+    size_t writeBlock, sampleNr;
+    uint8_t currByte;
+    uint16_t sequence;
+    uint32_t dropped;
+    volatile uint32_t producedBlocks;
+
+    // consumer (main loop) side
+    volatile uint32_t consumedBlocks;
+
+    bool openBlock ();
+    void closeBlock ();
+};
+
+
+/************************************************************************
+ * Class DcfEdgeFilter
+ ************************************************************************/
+
+/**
+ * @brief Class that converts timestamped edges of the receiver output into the
+ *        100 Hz sample stream of the decoder.
+ *
+ * An edge that is followed by the opposite edge within GLITCH_TIME is removed
+ * together with this edge. Since an edge is only final after GLITCH_TIME, the
+ * samples lag the input by this time. The sample at a grid point is the level
+ * after the last final edge before it. Times are given in microseconds of a
+ * free-running 32-bit counter, i.e. they wrap after 71 minutes.
+ */
+class DcfEdgeFilter
+{
+public:
+
+    static const uint32_t SAMPLE_PERIOD = 10000;
+    static const uint32_t GLITCH_TIME = 20000;
+    static const size_t MAX_EDGES = 8;
+
+    /**
+     * @brief An edge: the level is true if the carrier is reduced after the edge.
+     */
+    struct Edge
+    {
+        uint32_t time;
+        bool level;
+    };
+
+    DcfEdgeFilter ();
+
+    void reset (uint32_t now, bool _level);
+    void addEdge (const Edge & e);
+
+    /**
+     * @brief Returns the sample of the next grid point if it is final at the given time.
+     */
+    bool getSample (uint32_t now, bool & sample);
+
+    /**
+     * @brief Returns the time of the grid point of the last sample.
+     */
+    inline uint32_t getSampleTime () const
+    {
+        return nextSample - SAMPLE_PERIOD;
+    }
+
+    inline uint32_t getGlitches () const
+    {
+        return glitches;
+    }
 
 private:
 
-    bool samples[DCF_FILTER_WINDOW];
-    size_t currSample;
-    size_t lastSample;
+    Edge pending;
+    bool isPending;
+    Edge edges[MAX_EDGES]; // final edges after the last grid point
+    size_t firstEdge, edgesNumber;
+    bool level;            // level at the last grid point
+    uint32_t nextSample;
+    uint32_t glitches;
+
+    void confirmPending ();
+};
+
+
+/************************************************************************
+ * Class DcfEdgeCapture
+ ************************************************************************/
+
+/**
+ * @brief Class that timestamps both edges of the receiver output using an
+ *        input capture channel of a 32-bit timer running at 1 MHz.
+ *
+ * The ISR is only called on edges. It passes the captured time and the new
+ * level to the main loop via an event queue.
+ */
+class DcfEdgeCapture
+{
+public:
+
+    static const uint32_t TICKS_PER_SEC = 1000000;
+    static const uint32_t INPUT_FILTER = 0xF;
+    static const size_t EVENT_QUEUE_SIZE = 16;
+
+    DcfEdgeCapture (IOPin & _pinInput, uint32_t _alternate, Timer::TimerName timerName, IRQn_Type timerIrq, uint32_t _channel);
+
+    void start (const InterruptPriority & prio);
+    void stop ();
+
+    inline uint32_t getTime () const
+    {
+        return timer.getValue();
+    }
+
+    inline bool getEdge (DcfEdgeFilter::Edge & e)
+    {
+        return edges.get(e);
+    }
+
+    inline uint32_t getOverflows () const
+    {
+        return edges.getOverflows();
+    }
 
+    /**
+     * @brief Stores a captured edge. Called from the timer ISR.
+     */
+    inline void onCapture ()
+    {
+        TIM_HandleTypeDef * t = timer.getTimerParameters();
+        if (__HAL_TIM_GET_FLAG(t, captureFlag) != RESET)
+        {
+            __HAL_TIM_CLEAR_IT(t, captureFlag);
+            edges.put({HAL_TIM_ReadCapturedValue(t, channel), !pinInput.getBit()});
+        }
+    }
+
+private:
+
+    IOPin & pinInput;
+    uint32_t alternate;
+    Timer timer;
+    uint32_t channel, captureFlag;
+    EventQueue<DcfEdgeFilter::Edge, EVENT_QUEUE_SIZE> edges;
 };
 
 
@@ -70,13 +552,47 @@ public:
     static const size_t DCF_SAMPLE_PER_SEC = 100;
     static const int16_t DCF_BITS_PER_MIN = 59;
 
-    const uint32_t SAMPLE_TOLERANCE = 3;
+    /**
+     * @brief Matched filter: the raw samples are summed over the mark window
+     *        (0..100 ms after the locked second mark) and the bit window
+     *        (100..200 ms). Both sums are evaluated at the end of the bit window.
+     */
+    static const size_t WINDOW_SAMPLES = DcfPhaseDetector::PULSE_BINS;
+
+    /**
+     * @brief The soft bit saturates if at most this number of samples in the
+     *        bit window disagree with the decision.
+     */
+    static const size_t SATURATION_SAMPLES = 2;
+
+    /**
+     * @brief The second without mark (second 59) is found from the marks of
+     *        each second averaged over the minutes, i.e. a single wrong mark
+     *        does not lose the minute.
+     */
+    static const size_t SECONDS_PER_MIN = 60;
+    static const int16_t MARK_SCALE = 256;
+
+    /**
+     * @brief A decoded frame refers to the next minute mark. It is reported with
+     *        the event of the second 0, i.e. this time after the mark.
+     */
+    static const duration_ms MARK_DELAY = (2 * WINDOW_SAMPLES - 1) * 1000 / DCF_SAMPLE_PER_SEC;
 
     class EventHandler
     {
     public:
 
-        virtual void onDcfBit (int16_t secondNr, size_t errorNr, bool bit) =0;
+        /**
+         * @brief Called for each second. The confidence of the bit is given in
+         *        percent: 0 if both bit values are equally probable.
+         */
+        virtual void onDcfBit (int16_t secondNr, size_t errorNr, bool bit, uint8_t confidence) =0;
+
+        /**
+         * @brief Called from the main loop after the minute mark the time refers
+         *        to. The time of the mark is given by getMarkTime().
+         */
         virtual void onDcfTimeReceived (
                 const ::tm & dayTime, const char * dayTimeStr) =0;
     };
@@ -93,6 +609,57 @@ public:
     void onSample ();
     void stop ();
 
+    /**
+     * @brief Sets the recorder of the raw samples, NULL if the samples are not
+     *        recorded. Shall be called before start().
+     */
+    inline void setRecorder (DcfSampleRecorder * _recorder)
+    {
+        recorder = _recorder;
+    }
+
+    /**
+     * @brief Sets the edge capture that replaces the 100 Hz sampling timer, NULL
+     *        if the input is sampled. Shall be called before start().
+     */
+    inline void setEdgeCapture (DcfEdgeCapture * _edgeCapture)
+    {
+        edgeCapture = _edgeCapture;
+    }
+
+    /**
+     * @brief Processes a single sample of the 100 Hz stream: true if the carrier
+     *        is reduced. Called from onSample() with the pin state; a simulated or
+     *        recorded stream can be fed here instead.
+     */
+    void processSample (bool rawSample);
+
+    /**
+     * @brief Returns the time between the minute mark and the report of the
+     *        received time. Edges are final after the glitch time.
+     */
+    inline duration_ms getMarkDelay () const
+    {
+        return MARK_DELAY + ((edgeCapture != NULL)? DcfEdgeFilter::GLITCH_TIME / 1000 : 0);
+    }
+
+    /**
+     * @brief Returns the monotonic time of the minute mark the received time
+     *        refers to. Valid within onDcfTimeReceived().
+     */
+    inline time_ms getMarkTime () const
+    {
+        return markTime;
+    }
+
+    /**
+     * @brief Returns the flags of the last received frame.
+     */
+    inline const DcfFrameAccumulator::Flags & getFlags () const
+    {
+        return flags;
+    }
+
 private:
 
     // Data handler
@@ -107,35 +674,71 @@ private:
 
     // Sampling
     Timer timer;
+    DcfSampleRecorder * recorder;
+    DcfEdgeCapture * edgeCapture;
+    DcfEdgeFilter edgeFilter;
 
     // general flags
     bool active;
-    bool dataBitsAvailable;
+    volatile bool dataBitsAvailable;
+    volatile bool secondElapsed;
+
+    /**
+     * @brief Record of a second that is passed from the sampling ISR to the main loop.
+     */
+    struct SecondEvent
+    {
+        int16_t secondNr;
+        int16_t phase;    // -1 if the phase is not locked
+        uint32_t errorNr;
+        uint8_t markLevel;
+        int8_t softBit;
+        bool endOfMinute;
+        time_ms time;     // monotonic time of the sample that completed the second
+    };
+
+    static const size_t EVENT_QUEUE_SIZE = 8;
+
+    // Events of the sampling ISR
+    EventQueue<SecondEvent, EVENT_QUEUE_SIZE> events;
+    uint32_t reportedOverflows;
 
     // Input stream processing
-    MedianFilter filter;
+    time_ms sampleTime; // monotonic time of the current sample
+    DcfPhaseDetector phaseDetector;
     int16_t secondNr;
-    size_t sampleNr, errorNr;
-    bool prevSample;
-    uint64_t highStart, highEnd;
+    size_t bin, errorNr;
+    uint8_t markSum, bitSum;
+    int16_t markProfile[SECONDS_PER_MIN];
+    size_t secondCounter;
+    volatile int16_t minuteMark;
 
     // Decoding
-    uint8_t dataBits1[DCF_BITS_PER_MIN];
-    uint8_t * ptrRec;
-    uint8_t dataBits2[DCF_BITS_PER_MIN];
-    uint8_t * ptrProc;
-
-    // Resulting time
+    int8_t dataBits1[DCF_BITS_PER_MIN];
+    int8_t * ptrRec;
+    int8_t dataBits2[DCF_BITS_PER_MIN];
+    int8_t * ptrProc;
+    DcfFrameAccumulator accumulator;
+    DcfFrameAccumulator::Flags flags;
+    time_t lastFrameTime;
+    time_t singleFrameTime, singleFrameReceived; // last frame decoded by itself
+
+    // Resulting time, reported with the next minute mark
     ::tm dayTime;
+    bool timePending;
+    time_ms markTime;
 
     // Logging
     char logStr[DCF_BITS_PER_MIN + 1];
 
     // internal methods
-    void storeBit (int16_t sec, bool bit);
-    bool isCheckSumValid (const uint8_t * bits, size_t i1, size_t i2) const;
-    int getData (const uint8_t * bits, size_t i1, size_t i2) const;
-    bool decodeTime (const uint8_t * bits, size_t start);
+    void processSecond (size_t markLevel, size_t bitLevel);
+    void processEvent (const SecondEvent & e);
+    void processEdges ();
+    void processFrame ();
+    void evaluateMinutePhase ();
+    void resetMinutePhase ();
+    void storeBit (int16_t sec, int8_t softBit);
     void reset ();
 };
 
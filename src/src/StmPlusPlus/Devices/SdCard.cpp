@@ -27,6 +27,13 @@ using namespace StmPlusPlus::Devices;
 
 #define USART_DEBUG_MODULE "SD: "
 
+// Card commands and arguments used by the power-up sequence
+#define SD_OP_COND_VOLTAGE_WINDOW   ((uint32_t)0x80100000U)
+#define SD_OP_COND_HIGH_CAPACITY    ((uint32_t)0x40000000U)
+#define SD_OP_COND_POWER_UP_DONE    ((uint32_t)0x80000000U)
+#define SD_IF_COND_CHECK_PATTERN    ((uint32_t)0x000001AAU)
+#define SD_COMMAND_TIMEOUT          ((uint32_t)0x00010000U)
+
 /************************************************************************
  * FAT FS driver
  ************************************************************************/
@@ -139,11 +146,20 @@ Diskio_drvTypeDef SdCard::fatFsDriver =
  * Class SdCard
  ************************************************************************/
 
-SdCard::SdCard (IOPin & _sdDetect, IOPort & _portSd1, IOPort & _portSd2):
+SdCard::SdCard (IOPin & _sdDetect, IOPin & _sdPower, IOPort & _portSd1, IOPort & _portSd2):
+    handler(NULL),
     sdDetect(_sdDetect),
+    sdPower(_sdPower),
     portSd1(_portSd1),
     portSd2(_portSd2),
-    irqPrio(5,0)
+    irqPrio(5,0),
+    cardInserted(!_sdDetect.getBit()),
+    detectPending(false),
+    detectTime(0),
+    reportedInserted(cardInserted),
+    powerState(PowerState::OFF),
+    powerTime(0),
+    opCondArgument(0)
 {
     // empty
 }
@@ -159,6 +175,177 @@ void SdCard::clearPort ()
 }
 
 
+void SdCard::startDetection (IRQn_Type detectIrq, const InterruptPriority & prio, EventHandler * _handler)
+{
+    handler = _handler;
+    sdDetect.setMode(GPIO_MODE_IT_RISING_FALLING);
+    cardInserted = reportedInserted = !sdDetect.getBit();
+    HAL_NVIC_SetPriority(detectIrq, prio.first, prio.second);
+    HAL_NVIC_EnableIRQ(detectIrq);
+    USART_DEBUG("Started card detection: inserted = " << cardInserted
+             << ", irqPrio = " << prio.first << "," << prio.second);
+}
+
+
+void SdCard::powerOn ()
+{
+    if (powerState != PowerState::OFF)
+    {
+        return;
+    }
+    clearPort();
+    sdPower.setHigh();
+    powerTime = HAL_GetTick();
+    powerState = PowerState::RAMP_UP;
+}
+
+
+void SdCard::powerOff ()
+{
+    if (powerState == PowerState::PROBE)
+    {
+        stopProbe();
+    }
+    sdPower.setLow();
+    powerState = PowerState::OFF;
+}
+
+
+SdCard::PowerState SdCard::periodic ()
+{
+    bool inserted = cardInserted;
+    if (inserted != reportedInserted)
+    {
+        reportedInserted = inserted;
+        USART_DEBUG("Card " << (inserted? "inserted" : "removed"));
+        if (handler != NULL)
+        {
+            if (inserted)
+            {
+                handler->onCardInserted();
+            }
+            else
+            {
+                handler->onCardRemoved();
+            }
+        }
+    }
+
+    switch (powerState)
+    {
+    case PowerState::OFF:
+    case PowerState::READY:
+    case PowerState::FAILED:
+        break;
+    case PowerState::RAMP_UP:
+        if (HAL_GetTick() - powerTime >= POWER_RAMP_TIME)
+        {
+            startProbe();
+            powerState = PowerState::PROBE;
+        }
+        break;
+    case PowerState::PROBE:
+        if (isProbeReady())
+        {
+            USART_DEBUG("Card is ready after " << (int)(HAL_GetTick() - powerTime) << "ms");
+            powerState = PowerState::READY;
+        }
+        else if (HAL_GetTick() - powerTime >= POWER_UP_TIMEOUT)
+        {
+            USART_DEBUG("Card is not ready after " << (int)POWER_UP_TIMEOUT << "ms");
+            stopProbe();
+            powerState = PowerState::FAILED;
+        }
+        break;
+    }
+    return powerState;
+}
+
+
+void SdCard::startProbe ()
+{
+    portSd1.setMode(GPIO_MODE_AF_PP);
+    portSd1.setAlternate(GPIO_AF12_SDIO);
+
+    portSd2.setMode(GPIO_MODE_AF_PP);
+    portSd2.setAlternate(GPIO_AF12_SDIO);
+
+    __HAL_RCC_SDIO_CLK_ENABLE();
+    SDIO_InitTypeDef probeInit;
+    probeInit.ClockEdge = SDIO_CLOCK_EDGE_RISING;
+    probeInit.ClockBypass = SDIO_CLOCK_BYPASS_DISABLE;
+    probeInit.ClockPowerSave = SDIO_CLOCK_POWER_SAVE_DISABLE;
+    probeInit.BusWide = SDIO_BUS_WIDE_1B;
+    probeInit.HardwareFlowControl = SDIO_HARDWARE_FLOW_CONTROL_DISABLE;
+    probeInit.ClockDiv = SDIO_INIT_CLK_DIV;
+    SDIO_Init(SDIO, probeInit);
+    SDIO_PowerState_ON(SDIO);
+    __SDIO_ENABLE();
+
+    // CMD0 puts the card into idle state, CMD8 is only answered by cards of version 2.0 or later
+    opCondArgument = SD_OP_COND_VOLTAGE_WINDOW;
+    sendCommand(SD_CMD_GO_IDLE_STATE, 0, SDIO_RESPONSE_NO);
+    if (sendCommand(SD_CMD_HS_SEND_EXT_CSD, SD_IF_COND_CHECK_PATTERN, SDIO_RESPONSE_SHORT) == SD_OK)
+    {
+        opCondArgument |= SD_OP_COND_HIGH_CAPACITY;
+    }
+}
+
+
+bool SdCard::isProbeReady ()
+{
+    // ACMD41 is an application command and needs the CMD55 prefix
+    if (sendCommand(SD_CMD_APP_CMD, 0, SDIO_RESPONSE_SHORT) != SD_OK)
+    {
+        return false;
+    }
+    HAL_SD_ErrorTypedef status = sendCommand(SD_CMD_SD_APP_OP_COND, opCondArgument, SDIO_RESPONSE_SHORT);
+    // R3 response does not contain a valid CRC
+    if (status != SD_OK && status != SD_CMD_CRC_FAIL)
+    {
+        return false;
+    }
+    return (SDIO_GetResponse(SDIO_RESP1) & SD_OP_COND_POWER_UP_DONE) != 0;
+}
+
+
+void SdCard::stopProbe ()
+{
+    __SDIO_DISABLE();
+    SDIO_PowerState_OFF(SDIO);
+    __HAL_RCC_SDIO_CLK_DISABLE();
+}
+
+
+HAL_SD_ErrorTypedef SdCard::sendCommand (uint32_t index, uint32_t argument, uint32_t response)
+{
+    SDIO_CmdInitTypeDef cmd;
+    cmd.Argument = argument;
+    cmd.CmdIndex = index;
+    cmd.Response = response;
+    cmd.WaitForInterrupt = SDIO_WAIT_NO;
+    cmd.CPSM = SDIO_CPSM_ENABLE;
+    SDIO_SendCommand(SDIO, &cmd);
+
+    const uint32_t endFlags = (response == SDIO_RESPONSE_NO)?
+        SDIO_FLAG_CMDSENT : (SDIO_FLAG_CMDREND | SDIO_FLAG_CCRCFAIL | SDIO_FLAG_CTIMEOUT);
+    uint32_t timeout = SD_COMMAND_TIMEOUT;
+    while (!__SDIO_GET_FLAG(SDIO, endFlags) && --timeout > 0);
+
+    HAL_SD_ErrorTypedef status = SD_OK;
+    if (timeout == 0 || __SDIO_GET_FLAG(SDIO, SDIO_FLAG_CTIMEOUT))
+    {
+        status = SD_CMD_RSP_TIMEOUT;
+    }
+    else if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CCRCFAIL))
+    {
+        status = SD_CMD_CRC_FAIL;
+    }
+    __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CMDSENT | SDIO_FLAG_CMDREND | SDIO_FLAG_CCRCFAIL | SDIO_FLAG_CTIMEOUT);
+    return status;
+}
+
+
 bool SdCard::start (uint32_t clockDiv)
 {
     if (!isCardInserted())
@@ -44,6 +44,41 @@ public:
     const IRQn_Type TX_IRQ = DMA2_Stream6_IRQn;
     const IRQn_Type SDIO_IRQ = SDIO_IRQn;
 
+    /**
+     * @brief Time (in milliseconds) needed by the card supply to ramp up before the first command.
+     */
+    static const uint32_t POWER_RAMP_TIME = 2;
+
+    /**
+     * @brief Maximal time (in milliseconds) the card may stay busy after power-on.
+     */
+    static const uint32_t POWER_UP_TIMEOUT = 1000;
+
+    /**
+     * @brief Time (in milliseconds) the card detect pin shall be stable after an edge.
+     */
+    static const uint32_t DETECT_DEBOUNCE_TIME = 20;
+
+    class EventHandler
+    {
+    public:
+
+        virtual void onCardInserted () =0;
+        virtual void onCardRemoved () =0;
+    };
+
+    /**
+     * @brief States of the non-blocking power-up sequence.
+     */
+    enum class PowerState
+    {
+        OFF = 0,     // card is not powered
+        RAMP_UP = 1, // power is switched on, waiting for supply ramp
+        PROBE = 2,   // card is polled with ACMD41 until its busy bit is cleared
+        READY = 3,   // card finished its power-up and can be started
+        FAILED = 4   // card did not respond within POWER_UP_TIMEOUT
+    };
+
     typedef struct
     {
         FATFS key;  /* File system object for SD card logical drive */
@@ -56,7 +91,7 @@ public:
     /**
      * @brief Default constructor.
      */
-    SdCard (IOPin & _sdDetect, IOPort & _portSd1, IOPort & _portSd2);
+    SdCard (IOPin & _sdDetect, IOPin & _sdPower, IOPort & _portSd1, IOPort & _portSd2);
 
     static SdCard * getInstance ()
     {
@@ -93,9 +128,41 @@ public:
         return sdCardInfo;
     }
 
+    /**
+     * @brief Returns the debounced state of the card detect pin.
+     */
     inline bool isCardInserted () const
     {
-        return !sdDetect.getBit();
+        return cardInserted;
+    }
+
+    /**
+     * @brief Enables edge interrupt on the card detect pin.
+     *
+     * Debounced insert/remove events are passed to the handler from periodic().
+     */
+    void startDetection (IRQn_Type detectIrq, const InterruptPriority & prio, EventHandler * _handler);
+
+    /**
+     * @brief Processes the EXTI interrupt of the card detect pin.
+     */
+    inline void processDetectInterrupt ()
+    {
+        __HAL_GPIO_EXTI_CLEAR_IT(sdDetect.getPin());
+        detectTime = HAL_GetTick();
+        detectPending = true;
+    }
+
+    /**
+     * @brief Finishes the debouncing of the card detect pin. Shall be called from SysTick.
+     */
+    inline void onMilliSecondInterrupt ()
+    {
+        if (detectPending && HAL_GetTick() - detectTime >= DETECT_DEBOUNCE_TIME)
+        {
+            detectPending = false;
+            cardInserted = !sdDetect.getBit();
+        }
     }
 
     inline void setIrqPrio (const InterruptPriority & prio)
@@ -103,8 +170,31 @@ public:
         irqPrio = prio;
     }
 
+    inline PowerState getPowerState () const
+    {
+        return powerState;
+    }
+
     void clearPort ();
 
+    /**
+     * @brief Switches the card supply on and starts the power-up sequence.
+     *
+     * The sequence is driven by periodic() from the main loop.
+     */
+    void powerOn ();
+
+    /**
+     * @brief Switches the card supply off.
+     */
+    void powerOff ();
+
+    /**
+     * @brief Passes card detect events to the handler and advances the power-up
+     *        sequence. Returns the current power state.
+     */
+    PowerState periodic ();
+
     bool start (uint32_t clockDiv = 0);
 
     bool mountFatFs ();
@@ -120,7 +210,9 @@ private:
 
     static SdCard * instance;
 
+    EventHandler * handler;
     IOPin & sdDetect;
+    IOPin & sdPower;
     IOPort & portSd1;
     IOPort & portSd2;
     SD_HandleTypeDef sdParams;
@@ -129,9 +221,26 @@ private:
     DMA_HandleTypeDef sdDmaTx;
     InterruptPriority irqPrio;
 
+    // Card detection. These variables are modified from interrupt service routine,
+    // therefore declare them as volatile
+    volatile bool cardInserted;
+    volatile bool detectPending;
+    volatile uint32_t detectTime;
+    bool reportedInserted;
+
+    // Power-up sequence
+    PowerState powerState;
+    uint32_t powerTime;
+    uint32_t opCondArgument;
+
     // FAT FS
     static Diskio_drvTypeDef fatFsDriver;
     FatFs fatFs;
+
+    void startProbe ();
+    bool isProbeReady ();
+    void stopProbe ();
+    HAL_SD_ErrorTypedef sendCommand (uint32_t index, uint32_t argument, uint32_t response);
 };
 
 } // end of namespace Devices
@@ -0,0 +1,123 @@
+/*******************************************************************************
+ * StmPlusPlus: object-oriented library implementing device drivers for 
+ * STM32F3 and STM32F4 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef EVENTQUEUE_H_
+#define EVENTQUEUE_H_
+
+#include <atomic>
+
+#include "StmPlusPlus.h"
+
+namespace StmPlusPlus {
+
+/**
+ * @brief Lock-free queue of fixed-size event records that an interrupt service
+ *        routine passes to the main loop.
+ *
+ * There shall be exactly one producer (a single ISR) and one consumer (the main
+ * loop). The producer only writes the head index and the consumer only writes
+ * the tail index; both indices run freely and are masked on access. If the queue
+ * is full, the event is dropped and counted.
+ *
+ * Producer and consumer run on the same core, i.e. only the compiler may reorder
+ * the accesses to a record and the indices: signal fences suffice.
+ */
+template <typename T, size_t capacity> class EventQueue
+{
+public:
+
+    static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "Capacity shall be a power of two");
+
+    EventQueue ():
+        head(0),
+        tail(0),
+        overflows(0)
+    {
+        // empty
+    }
+
+    /**
+     * @brief Appends an event. Called by the producer.
+     *
+     * @return False if the queue is full and the event is dropped.
+     */
+    inline bool put (const T & event)
+    {
+        uint32_t h = head;
+        if (h - tail >= capacity)
+        {
+            ++overflows;
+            return false;
+        }
+        events[h & INDEX_MASK] = event;
+        // the record shall be complete before the consumer sees it
+        std::atomic_signal_fence(std::memory_order_release);
+        head = h + 1;
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest event. Called by the consumer.
+     *
+     * @return False if the queue is empty.
+     */
+    inline bool get (T & event)
+    {
+        uint32_t t = tail;
+        if (t == head)
+        {
+            return false;
+        }
+        // the record is read only after the head that publishes it
+        std::atomic_signal_fence(std::memory_order_acquire);
+        event = events[t & INDEX_MASK];
+        // and it shall be read before the producer may reuse it
+        std::atomic_signal_fence(std::memory_order_release);
+        tail = t + 1;
+        return true;
+    }
+
+    /**
+     * @brief Drops all pending events. Called by the consumer.
+     */
+    inline void clear ()
+    {
+        tail = head;
+    }
+
+    /**
+     * @brief Returns the number of events dropped since the start.
+     */
+    inline uint32_t getOverflows () const
+    {
+        return overflows;
+    }
+
+private:
+
+    static const uint32_t INDEX_MASK = capacity - 1;
+
+    T events[capacity];
+    volatile uint32_t head, tail;
+    volatile uint32_t overflows;
+};
+
+} // end namespace
+#endif
@@ -0,0 +1,328 @@
+/*******************************************************************************
+ * StmPlusPlus: object-oriented library implementing device drivers for 
+ * STM32F3 and STM32F4 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "FlashStore.h"
+
+#include <cstring>
+
+using namespace StmPlusPlus;
+
+#define USART_DEBUG_MODULE "FLSH: "
+
+/************************************************************************
+ * Class FlashStore
+ ************************************************************************/
+
+FlashStore::FlashStore (const Sector & _sector1, const Sector & _sector2):
+    active(NULL),
+    writeAddress(0),
+    spareErased(false)
+{
+    sectors[0] = _sector1;
+    sectors[1] = _sector2;
+}
+
+
+HAL_StatusTypeDef FlashStore::start ()
+{
+    bool valid1 = isSectorValid(sectors[0]);
+    bool valid2 = isSectorValid(sectors[1]);
+    if (valid1 && valid2)
+    {
+        // both valid: a compaction was interrupted before the old sector was reused
+        int32_t diff = readWord(sectors[1].address + sizeof(uint32_t)) - readWord(sectors[0].address + sizeof(uint32_t));
+        active = (diff > 0)? &sectors[1] : &sectors[0];
+    }
+    else if (valid1 || valid2)
+    {
+        active = valid1? &sectors[0] : &sectors[1];
+    }
+    else
+    {
+        USART_DEBUG("No valid sector found, initializing the store");
+        active = NULL;
+        HAL_StatusTypeDef status = compact(1);
+        if (status != HAL_OK)
+        {
+            USART_DEBUG("Can not initialize the store: " << status);
+            return status;
+        }
+    }
+
+    size_t records = 0;
+    uint32_t address = active->address + HEADER_SIZE;
+    while (findRecord(*active, address, address) != 0)
+    {
+        ++records;
+    }
+    writeAddress = address;
+    spareErased = isSectorErased(getSpare());
+
+    USART_DEBUG("Started flash store: sector = " << active->number
+            << ", sequence = " << getSequence()
+            << ", records = " << records
+            << ", free = " << (active->address + active->size - writeAddress)
+            << ", spare erased = " << spareErased);
+    return HAL_OK;
+}
+
+
+void FlashStore::readAll (RecordHandler & handler) const
+{
+    if (active == NULL)
+    {
+        return;
+    }
+    uint32_t next = active->address + HEADER_SIZE;
+    uint32_t record;
+    while ((record = findRecord(*active, next, next)) != 0)
+    {
+        uint32_t header = readWord(record);
+        handler.onRecord(header & 0xFFFF, reinterpret_cast<const void *>(record + sizeof(uint32_t)), header >> 16);
+    }
+}
+
+
+HAL_StatusTypeDef FlashStore::write (uint16_t key, const void * data, size_t length)
+{
+    if (active == NULL || key >= MAX_KEYS || length > MAX_LENGTH)
+    {
+        return HAL_ERROR;
+    }
+
+    size_t recordSize = sizeof(uint32_t) + getDataSize(length) + sizeof(uint32_t);
+    if (writeAddress + recordSize > active->address + active->size)
+    {
+        HAL_StatusTypeDef status = compact(getSequence() + 1);
+        if (status != HAL_OK)
+        {
+            USART_DEBUG("Can not compact the store: " << status);
+            return status;
+        }
+        if (writeAddress + recordSize > active->address + active->size)
+        {
+            return HAL_ERROR;
+        }
+    }
+
+    HAL_StatusTypeDef status = appendRecord(writeAddress, key, data, length);
+    writeAddress += recordSize;
+    return status;
+}
+
+
+HAL_StatusTypeDef FlashStore::eraseSpare ()
+{
+    if (active == NULL || spareErased)
+    {
+        return HAL_OK;
+    }
+    HAL_StatusTypeDef status = erase(getSpare());
+    spareErased = status == HAL_OK;
+    USART_DEBUG("Erased spare sector " << getSpare().number << ": status = " << status);
+    return status;
+}
+
+
+bool FlashStore::isSectorValid (const Sector & s) const
+{
+    return readWord(s.address) == MAGIC;
+}
+
+
+bool FlashStore::isSectorErased (const Sector & s) const
+{
+    for (uint32_t address = s.address; address < s.address + s.size; address += sizeof(uint32_t))
+    {
+        if (readWord(address) != 0xFFFFFFFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Returns the address of the first valid record at or behind the given
+ *        address, or 0 at the end of the log. The parameter next receives the
+ *        address behind the found record or the end of the log.
+ */
+uint32_t FlashStore::findRecord (const Sector & s, uint32_t address, uint32_t & next) const
+{
+    const uint32_t end = s.address + s.size;
+    while (address + 2 * sizeof(uint32_t) <= end)
+    {
+        uint32_t header = readWord(address);
+        if (header == 0xFFFFFFFF)
+        {
+            // erased word: end of log
+            break;
+        }
+        uint16_t key = header & 0xFFFF;
+        size_t length = header >> 16;
+        uint32_t crcAddress = address + sizeof(uint32_t) + getDataSize(length);
+        if (key == NO_KEY || length > MAX_LENGTH || crcAddress + sizeof(uint32_t) > end)
+        {
+            // interrupted header: the rest of the sector is not usable
+            address = end;
+            break;
+        }
+        if (Crc32::calculate(reinterpret_cast<const void *>(address), crcAddress - address) == readWord(crcAddress))
+        {
+            next = crcAddress + sizeof(uint32_t);
+            return address;
+        }
+        // interrupted record: skip it
+        address = crcAddress + sizeof(uint32_t);
+    }
+    next = address;
+    return 0;
+}
+
+
+HAL_StatusTypeDef FlashStore::compact (uint32_t sequence)
+{
+    const Sector * target = &getSpare();
+    HAL_StatusTypeDef status = spareErased? HAL_OK : erase(*target);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    spareErased = false;
+
+    // copy the latest valid record of each key
+    uint32_t address = target->address + HEADER_SIZE;
+    if (active != NULL)
+    {
+        uint32_t latest[MAX_KEYS];
+        ::memset(latest, 0, sizeof(latest));
+        uint32_t next = active->address + HEADER_SIZE;
+        uint32_t record;
+        while ((record = findRecord(*active, next, next)) != 0)
+        {
+            uint16_t key = readWord(record) & 0xFFFF;
+            if (key < MAX_KEYS)
+            {
+                latest[key] = record;
+            }
+        }
+        for (size_t key = 0; key < MAX_KEYS && status == HAL_OK; ++key)
+        {
+            if (latest[key] != 0)
+            {
+                size_t length = readWord(latest[key]) >> 16;
+                status = appendRecord(address, key, reinterpret_cast<const void *>(latest[key] + sizeof(uint32_t)), length);
+                address += sizeof(uint32_t) + getDataSize(length) + sizeof(uint32_t);
+            }
+        }
+    }
+
+    // the magic word is programmed last and commits the sector
+    uint32_t magic = MAGIC;
+    if (status == HAL_OK)
+    {
+        status = program(target->address + sizeof(uint32_t), &sequence, sizeof(uint32_t));
+    }
+    if (status == HAL_OK)
+    {
+        status = program(target->address, &magic, sizeof(uint32_t));
+    }
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    active = target;
+    writeAddress = address;
+    USART_DEBUG("Compacted flash store into sector " << active->number
+            << ": sequence = " << sequence
+            << ", free = " << (active->address + active->size - writeAddress));
+    return HAL_OK;
+}
+
+
+HAL_StatusTypeDef FlashStore::erase (const Sector & s)
+{
+    // an interrupted erase leaves undefined content: invalidate the sector
+    // before, so that it can not be taken as the active one afterwards
+    if (isSectorValid(s))
+    {
+        uint32_t invalid = 0;
+        program(s.address, &invalid, sizeof(uint32_t));
+    }
+
+    FLASH_EraseInitTypeDef eraseInit;
+    eraseInit.TypeErase = FLASH_TYPEERASE_SECTORS;
+    eraseInit.Sector = s.number;
+    eraseInit.NbSectors = 1;
+    eraseInit.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+    uint32_t sectorError = 0;
+    HAL_FLASH_Unlock();
+    HAL_StatusTypeDef status = HAL_FLASHEx_Erase(&eraseInit, &sectorError);
+    HAL_FLASH_Lock();
+    return status;
+}
+
+
+HAL_StatusTypeDef FlashStore::program (uint32_t address, const void * data, size_t length)
+{
+    HAL_StatusTypeDef status = HAL_OK;
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    const uint8_t * ptr = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < length && status == HAL_OK; i += sizeof(uint32_t))
+    {
+        uint32_t word;
+        ::memcpy(&word, ptr + i, sizeof(uint32_t));
+        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + i, word);
+    }
+    HAL_FLASH_Lock();
+
+    // the data cache may still contain the erased words
+    if (READ_BIT(FLASH->ACR, FLASH_ACR_DCEN) != RESET)
+    {
+        __HAL_FLASH_DATA_CACHE_DISABLE();
+        __HAL_FLASH_DATA_CACHE_RESET();
+        __HAL_FLASH_DATA_CACHE_ENABLE();
+    }
+    return status;
+}
+
+
+HAL_StatusTypeDef FlashStore::appendRecord (uint32_t address, uint16_t key, const void * data, size_t length)
+{
+    uint32_t buffer[1 + MAX_LENGTH / sizeof(uint32_t)];
+    ::memset(buffer, 0, sizeof(buffer));
+    buffer[0] = (uint32_t)key | ((uint32_t)length << 16);
+    ::memcpy(&buffer[1], data, length);
+
+    // the CRC word is programmed last and commits the record
+    size_t size = sizeof(uint32_t) + getDataSize(length);
+    uint32_t crc = Crc32::calculate(buffer, size);
+    HAL_StatusTypeDef status = program(address, buffer, size);
+    if (status == HAL_OK)
+    {
+        status = program(address + size, &crc, sizeof(uint32_t));
+    }
+    return status;
+}
@@ -0,0 +1,143 @@
+/*******************************************************************************
+ * StmPlusPlus: object-oriented library implementing device drivers for 
+ * STM32F3 and STM32F4 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef FLASHSTORE_H_
+#define FLASHSTORE_H_
+
+#include "StmPlusPlus.h"
+
+namespace StmPlusPlus {
+
+/**
+ * @brief Class implementing a log-structured key/value store over two flash sectors.
+ *
+ * Records are only appended to the active sector. Each record consists of a header
+ * word (key and length), the data padded to whole words and a CRC-32 word that is
+ * programmed last, i.e. a record interrupted by a power loss is ignored. When the
+ * active sector is full, the latest valid record of each key is copied into the
+ * other sector and its header is programmed last; the sector with the higher
+ * sequence number is active. Both sectors are erased in turn.
+ *
+ * A sector erase stalls the CPU for one or two seconds. Therefore, the spare
+ * sector should be erased ahead of the compaction by eraseSpare() at a time
+ * when such a stall does no harm.
+ */
+class FlashStore
+{
+public:
+
+    static const uint32_t MAGIC = 0x4B565331; // "KVS1"
+    static const size_t MAX_KEYS = 64;
+    static const size_t MAX_LENGTH = 128;
+
+    /**
+     * @brief Interface that is called for each valid record.
+     */
+    class RecordHandler
+    {
+    public:
+
+        virtual void onRecord (uint16_t key, const void * data, size_t length) =0;
+    };
+
+    /**
+     * @brief Sector number, address and size of both sectors.
+     */
+    struct Sector
+    {
+        uint32_t number;
+        uint32_t address;
+        size_t size;
+    };
+
+    FlashStore (const Sector & _sector1, const Sector & _sector2);
+
+    /**
+     * @brief Finds the active sector and the end of the log. Initializes the
+     *        store if no sector is valid.
+     */
+    HAL_StatusTypeDef start ();
+
+    /**
+     * @brief Calls the handler for all valid records in the order they were
+     *        written, i.e. the last call for a key delivers its current value.
+     */
+    void readAll (RecordHandler & handler) const;
+
+    /**
+     * @brief Appends a record. Compacts the store into the other sector if the
+     *        active one is full.
+     */
+    HAL_StatusTypeDef write (uint16_t key, const void * data, size_t length);
+
+    /**
+     * @brief Erases the spare sector, i.e. the target of the next compaction.
+     *
+     * Blocks for the duration of the sector erase. If it was not called before,
+     * the compaction erases the spare sector itself.
+     */
+    HAL_StatusTypeDef eraseSpare ();
+
+    inline bool isSpareErased () const
+    {
+        return spareErased;
+    }
+
+    inline uint32_t getSequence () const
+    {
+        return active == NULL? 0 : readWord(active->address + sizeof(uint32_t));
+    }
+
+private:
+
+    static const uint16_t NO_KEY = 0xFFFF;
+    static const size_t HEADER_SIZE = 2 * sizeof(uint32_t);
+
+    Sector sectors[2];
+    const Sector * active;
+    uint32_t writeAddress;
+    bool spareErased;
+
+    static inline uint32_t readWord (uint32_t address)
+    {
+        return *reinterpret_cast<const volatile uint32_t *>(address);
+    }
+
+    static inline size_t getDataSize (size_t length)
+    {
+        return (length + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+    }
+
+    bool isSectorValid (const Sector & s) const;
+    bool isSectorErased (const Sector & s) const;
+
+    inline const Sector & getSpare () const
+    {
+        return (active == &sectors[0])? sectors[1] : sectors[0];
+    }
+    uint32_t findRecord (const Sector & s, uint32_t address, uint32_t & next) const;
+    HAL_StatusTypeDef compact (uint32_t sequence);
+    HAL_StatusTypeDef erase (const Sector & s);
+    HAL_StatusTypeDef program (uint32_t address, const void * data, size_t length);
+    HAL_StatusTypeDef appendRecord (uint32_t address, uint16_t key, const void * data, size_t length);
+};
+
+} // end namespace
+#endif
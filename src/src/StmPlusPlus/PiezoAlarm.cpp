@@ -45,7 +45,7 @@ void PiezoAlarm::start (unsigned char _maxNumber)
 {
     maxNumber = _maxNumber;
     state = ON1;
-    startTime = rtc.getTimeMillisec();
+    startTime = rtc.getMonotonicMillisec();
     stateTime = startTime;
     number = 0;
     setHigh();
@@ -59,40 +59,40 @@ void PiezoAlarm::periodic ()
     case OFF:
         return;
     case ON1:
-        if (rtc.getTimeMillisec() > (stateTime + onDuratin))
+        if (rtc.getMonotonicMillisec() > (stateTime + onDuratin))
         {
             state = PAUSE1;
-            stateTime = rtc.getTimeMillisec();
+            stateTime = rtc.getMonotonicMillisec();
             setLow();
         }
         break;
     case PAUSE1:
-        if (rtc.getTimeMillisec() > (stateTime + pause1Duratin))
+        if (rtc.getMonotonicMillisec() > (stateTime + pause1Duratin))
         {
             state = ON2;
-            stateTime = rtc.getTimeMillisec();
+            stateTime = rtc.getMonotonicMillisec();
             setHigh();
         }
         break;
     case ON2:
-        if (rtc.getTimeMillisec() > (stateTime + onDuratin))
+        if (rtc.getMonotonicMillisec() > (stateTime + onDuratin))
         {
             state = PAUSE2;
-            stateTime = rtc.getTimeMillisec();
+            stateTime = rtc.getMonotonicMillisec();
             setLow();
         }
         break;
     case PAUSE2:
-        if (rtc.getTimeMillisec() > (stateTime + pause2Duratin))
+        if (rtc.getMonotonicMillisec() > (stateTime + pause2Duratin))
         {
-            if (++number >= maxNumber)
+            if (maxNumber > 0 && ++number >= maxNumber)
             {
                 stop();
             }
             else
             {
                 state = ON1;
-                stateTime = rtc.getTimeMillisec();
+                stateTime = rtc.getMonotonicMillisec();
                 setHigh();
             }
         }
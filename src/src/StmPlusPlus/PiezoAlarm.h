@@ -54,7 +54,13 @@ public:
 
     PiezoAlarm (PortName name, uint32_t pin, const RealTimeClock & _rtc);
     void resetTime ();
+
+    /**
+     * @brief Starts the beep pattern that is repeated the given number of
+     *        times, or until stop() is called if the number is zero.
+     */
     void start (unsigned char _maxNumber);
+
     void periodic ();
     void stop ();
 
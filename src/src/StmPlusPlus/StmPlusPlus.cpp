@@ -20,6 +20,7 @@
 
 #include <cstring>
 #include <cstdlib>
+#include <algorithm>
 
 #include "StmPlusPlus.h"
 
@@ -27,6 +28,28 @@ using namespace StmPlusPlus;
 
 #define USART_DEBUG_MODULE "COMM: "
 
+/************************************************************************
+ * Class Crc32
+ ************************************************************************/
+
+uint32_t Crc32::calculate (const void * data, size_t length, uint32_t crc)
+{
+    // half-byte table of the reflected polynomial 0xEDB88320
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const uint8_t * ptr = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i)
+    {
+        crc = table[(crc ^ ptr[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (ptr[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+
 /************************************************************************
  * Class System
  ************************************************************************/
@@ -468,7 +491,13 @@ RealTimeClock::RealTimeClock ():
     syncMs2(0),
     errorMs(0),
     timeMillisec(0),
-    timeSec(0)
+    timeSec(0),
+    monotonicMillisec(0),
+    sequence(0),
+    offsetMs(0),
+    slewMs(0),
+    correctionPpb(0),
+    correctionNs(0)
 {
     rtcParameters.Instance = RTC;
     rtcParameters.Init.HourFormat = RTC_HOURFORMAT_24;
@@ -534,12 +563,40 @@ HAL_StatusTypeDef RealTimeClock::start (uint32_t counter, uint32_t prescaler, co
 void RealTimeClock::onMilliSecondInterrupt ()
 {
     HAL_IncTick();
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    ++monotonicMillisec;
     if (syncMs1 < 999)
     {
         ++timeMillisec;
         ++syncMs1;
     }
     ++syncMs2;
+    ++sequence;
+    __set_PRIMASK(primask);
+}
+
+
+time_us RealTimeClock::getTimeMicros () const
+{
+    const uint32_t load = SysTick->LOAD + 1;
+    uint32_t s, value;
+    time_ms ms;
+    do
+    {
+        s = sequence;
+        ms = monotonicMillisec;
+        value = SysTick->VAL;
+        // the counter is reloaded but its interrupt is not served yet
+        if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0)
+        {
+            value = SysTick->VAL;
+            ++ms;
+        }
+    }
+    while (s != sequence);
+    // the SysTick counter counts down
+    return (time_us)ms * 1000L + (time_us)(load - 1 - value) * 1000L / load;
 }
 
 
@@ -548,11 +605,32 @@ void RealTimeClock::onSecondInterrupt ()
     /* Get the pending status of the WAKEUPTIMER Interrupt */
     if(__HAL_RTC_WAKEUPTIMER_GET_FLAG(&rtcParameters, RTC_FLAG_WUTF) != RESET)
     {
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
         ++syncMs2;
         errorMs = syncMs2 - 1000;
         ++timeSec;
-        timeMillisec = (time_ms)timeSec * 1000L;
+        correctionNs += correctionPpb;
+        if (correctionNs >= 1000000L)
+        {
+            correctionNs -= 1000000L;
+            ++offsetMs;
+        }
+        else if (correctionNs <= -1000000L)
+        {
+            correctionNs += 1000000L;
+            --offsetMs;
+        }
+        if (slewMs != 0)
+        {
+            const int32_t s = (slewMs > 0)? SLEW_RATE : -SLEW_RATE;
+            offsetMs += s;
+            slewMs -= s;
+        }
+        applyOffset();
         syncMs1 = syncMs2 = 0;
+        ++sequence;
+        __set_PRIMASK(primask);
 
         if (handler != NULL)
         {
@@ -567,6 +645,66 @@ void RealTimeClock::onSecondInterrupt ()
 }
 
 
+void RealTimeClock::setTimeSec (time_t sec, int32_t elapsedMs)
+{
+    // the offset is normalized with the next wakeup
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    slewMs = 0;
+    offsetMs = elapsedMs - (int32_t)syncMs1;
+    timeSec = sec;
+    timeMillisec = (time_ms)sec * 1000L + elapsedMs;
+    ++sequence;
+    __set_PRIMASK(primask);
+}
+
+
+void RealTimeClock::slewTimeSec (time_t sec, int32_t elapsedMs)
+{
+    // the step replaces the remaining slew: the wakeup interrupt shall not apply
+    // a part of it between the reading of the time and the new slew
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const duration_ms step = ((duration_ms)sec * 1000L + elapsedMs) - (duration_ms)getTimeMillisec();
+    const bool slew = ::llabs(step) <= MAX_SLEW;
+    if (slew)
+    {
+        slewMs = (int32_t)step;
+    }
+    __set_PRIMASK(primask);
+    if (!slew)
+    {
+        setTimeSec(sec, elapsedMs);
+    }
+}
+
+
+void RealTimeClock::setCorrection (int32_t ppb)
+{
+    correctionPpb = std::max(-MAX_CORRECTION, std::min(MAX_CORRECTION, ppb));
+}
+
+
+/**
+ * @brief Normalizes the millisecond offset and recalculates the time in milliseconds
+ *        for the start of the current wakeup period.
+ */
+void RealTimeClock::applyOffset ()
+{
+    if (offsetMs >= 500)
+    {
+        offsetMs -= 1000;
+        ++timeSec;
+    }
+    else if (offsetMs < -500)
+    {
+        offsetMs += 1000;
+        --timeSec;
+    }
+    timeMillisec = (time_ms)timeSec * 1000L + offsetMs;
+}
+
+
 void RealTimeClock::stop ()
 {
     USART_DEBUG("Stopping RTC");
@@ -579,6 +717,21 @@ void RealTimeClock::stop ()
 }
 
 
+/************************************************************************
+ * Class BackupSram
+ ************************************************************************/
+
+HAL_StatusTypeDef BackupSram::start ()
+{
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    __HAL_RCC_BKPSRAM_CLK_ENABLE();
+    HAL_StatusTypeDef status = HAL_PWREx_EnableBkUpReg();
+    USART_DEBUG("Started backup SRAM: Status = " << status);
+    return status;
+}
+
+
 /************************************************************************
  * Class Spi
  ************************************************************************/
@@ -721,7 +874,7 @@ PeriodicalEvent::PeriodicalEvent (const RealTimeClock & _rtc, time_ms _delay, lo
 
 void PeriodicalEvent::resetTime ()
 {
-    lastEventTime = rtc.getTimeMillisec();
+    lastEventTime = rtc.getMonotonicMillisec();
     occurred = 0;
 }
 
@@ -732,9 +885,9 @@ bool PeriodicalEvent::isOccured ()
     {
         return false;
     }
-    if (rtc.getTimeMillisec() >= lastEventTime + delay)
+    if (rtc.getMonotonicMillisec() >= lastEventTime + delay)
     {
-        lastEventTime = rtc.getTimeMillisec();
+        lastEventTime = rtc.getMonotonicMillisec();
         if (maxOccurrence > 0)
         {
             ++occurred;
@@ -58,6 +58,7 @@ namespace StmPlusPlus {
 typedef int32_t duration_sec;
 typedef uint64_t time_ms;
 typedef int64_t duration_ms;
+typedef uint64_t time_us;
 
 typedef std::pair<uint32_t, uint32_t> InterruptPriority;
 
@@ -84,6 +85,21 @@ typedef union
 } WordToBytes;
 
 
+/**
+ * @brief Static class calculating CRC-32 (IEEE 802.3) checksums.
+ */
+class Crc32
+{
+public:
+
+    /**
+     * @brief Calculates the checksum of the given data. A previous checksum can
+     *        be passed in order to continue the calculation over several blocks.
+     */
+    static uint32_t calculate (const void * data, size_t length, uint32_t crc = 0);
+};
+
+
 /**
  * @brief Static class collecting helper methods for general system settings.
  */
@@ -226,6 +242,14 @@ public:
         HAL_GPIO_TogglePin(port, gpioParameters.Pin);
     }
 
+    /**
+     * @brief Returns the pin mask this port is configured for.
+     */
+    inline uint32_t getPin () const
+    {
+        return gpioParameters.Pin;
+    }
+
     /**
      * @brief Write the given integer into the GPIO port output data register.
      */
@@ -496,6 +520,18 @@ class RealTimeClock
 {
 public:
 
+    /**
+     * @brief Maximal drift correction in ppb.
+     */
+    static const int32_t MAX_CORRECTION = 500000;
+
+    /**
+     * @brief A time difference up to MAX_SLEW milliseconds is not stepped but
+     *        slewed by SLEW_RATE milliseconds per second.
+     */
+    static const int32_t MAX_SLEW = 1000;
+    static const int32_t SLEW_RATE = 1;
+
     class EventHandler
     {
     public:
@@ -513,20 +549,77 @@ public:
         return errorMs;
     }
 
+    /**
+     * @brief The 64-bit times are read in two halves. The readers repeat the read
+     *        if an update happened in between, the writers update the time with
+     *        disabled interrupts. Thus, the time is consistent in any context.
+     */
     inline time_ms getTimeMillisec () const
     {
-        return timeMillisec;
+        uint32_t s;
+        time_ms t;
+        do
+        {
+            s = sequence;
+            t = timeMillisec;
+        }
+        while (s != sequence);
+        return t;
     }
 
+    /**
+     * @brief Returns the seconds of the corrected time, i.e. they tick together
+     *        with getTimeMillisec() and not with the wakeup timer.
+     */
     inline time_t getTimeSec () const
     {
-        return timeSec;
+        return (time_t)(getTimeMillisec() / 1000L);
     }
 
-    void setTimeSec (time_t sec)
+    /**
+     * @brief Returns the milliseconds since the start. This time never jumps when
+     *        the wall clock time is set, i.e. it is the base of all timers.
+     */
+    inline time_ms getMonotonicMillisec () const
+    {
+        uint32_t s;
+        time_ms t;
+        do
+        {
+            s = sequence;
+            t = monotonicMillisec;
+        }
+        while (s != sequence);
+        return t;
+    }
+
+    /**
+     * @brief Returns the monotonic time in microseconds: the milliseconds are
+     *        combined with the SysTick counter. Intended for timestamps of
+     *        edges, profiling and audio clock measurements.
+     */
+    time_us getTimeMicros () const;
+
+    /**
+     * @brief Sets the time. The given second started elapsedMs before this moment,
+     *        i.e. the phase of the wakeup timer is compensated by the millisecond offset.
+     */
+    void setTimeSec (time_t sec, int32_t elapsedMs = 0);
+
+    /**
+     * @brief Same as setTimeSec, but a difference up to MAX_SLEW is slewed.
+     */
+    void slewTimeSec (time_t sec, int32_t elapsedMs = 0);
+
+    /**
+     * @brief Sets the frequency correction of the LSE in ppb: a positive value
+     *        means that the oscillator is slow and the time is advanced.
+     */
+    void setCorrection (int32_t ppb);
+
+    inline int32_t getCorrection () const
     {
-        timeSec = sec;
-        timeMillisec = (duration_ms)sec * 1000L;
+        return correctionPpb;
     }
 
     HAL_StatusTypeDef start (uint32_t counterMode, uint32_t prescaler, const InterruptPriority & prio, RealTimeClock::EventHandler * _handler = NULL);
@@ -547,7 +640,40 @@ private:
     volatile uint32_t syncMs1, syncMs2;
     volatile int32_t errorMs;
     volatile time_ms timeMillisec; // current time (in milliseconds)
-    volatile time_t timeSec; // current time (in seconds)
+    volatile time_t timeSec; // time at the last wakeup (in seconds) without the offset
+    volatile time_ms monotonicMillisec; // time since start (in milliseconds)
+    volatile uint32_t sequence; // incremented with each update of the time
+
+    // Software correction: the offset of the milliseconds against the wakeup
+    // timer is kept within [-500, 500) by moving whole seconds into timeSec
+    volatile int32_t offsetMs;
+    volatile int32_t slewMs;
+    volatile int32_t correctionPpb;
+    int32_t correctionNs;
+
+    void applyOffset ();
+};
+
+
+/**
+ * @brief Class that implements access to the battery-backed SRAM.
+ */
+class BackupSram
+{
+public:
+
+    static const size_t SIZE = 4096;
+
+    /**
+     * @brief Enables the clock and the backup regulator so that the content
+     *        is kept while the board is supplied from VBAT.
+     */
+    HAL_StatusTypeDef start ();
+
+    inline void * getData () const
+    {
+        return reinterpret_cast<void *>(BKPSRAM_BASE);
+    }
 };
 
 
@@ -594,6 +720,14 @@ public:
         while (!__HAL_SPI_GET_FLAG(hspi, SPI_FLAG_TXE));
     }
 
+    /**
+     * @brief Waits until the last transmitted frame has left the shift register.
+     */
+    inline void waitForIdle ()
+    {
+        while (__HAL_SPI_GET_FLAG(hspi, SPI_FLAG_BSY));
+    }
+
     inline HAL_StatusTypeDef writeBuffer (uint8_t *pData, uint16_t pSize)
     {
         return HAL_SPI_Transmit(hspi, pData, pSize, TIMEOUT);
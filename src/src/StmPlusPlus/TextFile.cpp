@@ -0,0 +1,166 @@
+/*******************************************************************************
+ * StmPlusPlus: object-oriented library implementing device drivers for 
+ * STM32F3 and STM32F4 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "TextFile.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+using namespace StmPlusPlus;
+
+#define USART_DEBUG_MODULE "FILE: "
+
+/************************************************************************
+ * Class TextFileReader
+ ************************************************************************/
+
+TextFileReader::TextFileReader (FIL & _file):
+    file(_file),
+    begin(0),
+    end(0),
+    eof(false),
+    result(FR_OK),
+    readCalls(0)
+{
+    buffer[0] = 0;
+}
+
+
+char * TextFileReader::readLine ()
+{
+    while (true)
+    {
+        char * line = &buffer[begin];
+        char * lineEnd = static_cast<char *>(::memchr(line, '\n', end - begin));
+        if (lineEnd == NULL && (eof || end - begin >= SECTOR_SIZE))
+        {
+            // last line without terminator or a line that does not fit into the buffer
+            if (begin == end)
+            {
+                return NULL;
+            }
+            lineEnd = &buffer[end];
+        }
+        if (lineEnd != NULL)
+        {
+            begin = std::min((size_t)(lineEnd - buffer) + 1, end);
+            if (lineEnd > line && *(lineEnd - 1) == '\r')
+            {
+                --lineEnd;
+            }
+            *lineEnd = 0;
+            return line;
+        }
+        fill();
+    }
+}
+
+
+void TextFileReader::fill ()
+{
+    // move the incomplete line (shorter than a sector) in front of the sector slot
+    const size_t len = end - begin;
+    ::memmove(&buffer[SECTOR_SIZE - len], &buffer[begin], len);
+    begin = SECTOR_SIZE - len;
+    end = SECTOR_SIZE;
+    UINT bytesRead = 0;
+    result = f_read(&file, &buffer[SECTOR_SIZE], SECTOR_SIZE, &bytesRead);
+    ++readCalls;
+    if (result != FR_OK)
+    {
+        USART_DEBUG("Can not read file: " << result);
+        bytesRead = 0;
+    }
+    end += bytesRead;
+    eof = bytesRead < SECTOR_SIZE;
+}
+
+
+/************************************************************************
+ * Class TextFileWriter
+ ************************************************************************/
+
+TextFileWriter::TextFileWriter (FIL & _file):
+    file(_file),
+    end(0),
+    result(FR_OK),
+    writeCalls(0)
+{
+    buffer[0] = 0;
+}
+
+
+TextFileWriter & TextFileWriter::printf (const char * format, ...)
+{
+    for (int trial = 0; trial < 2; ++trial)
+    {
+        va_list args;
+        va_start(args, format);
+        int len = ::vsnprintf(&buffer[end], BUFFER_SIZE + 1 - end, format, args);
+        va_end(args);
+        if (len < 0)
+        {
+            buffer[end] = 0;
+            break;
+        }
+        if (end + len <= BUFFER_SIZE || end < SECTOR_SIZE)
+        {
+            // formatted string fits (or is truncated since it is longer than a sector)
+            end = std::min(end + len, BUFFER_SIZE);
+            break;
+        }
+        // pass the complete sector to the file and repeat formatting
+        buffer[end] = 0;
+        write(SECTOR_SIZE);
+    }
+    if (end >= SECTOR_SIZE)
+    {
+        write(SECTOR_SIZE);
+    }
+    return *this;
+}
+
+
+FRESULT TextFileWriter::flush ()
+{
+    if (end > 0)
+    {
+        write(end);
+    }
+    return result;
+}
+
+
+void TextFileWriter::write (size_t len)
+{
+    UINT bytesWritten = 0;
+    FRESULT code = f_write(&file, &buffer[0], len, &bytesWritten);
+    ++writeCalls;
+    if (code != FR_OK || bytesWritten != len)
+    {
+        USART_DEBUG("Can not write file: err=" << code << ", bytesWritten=" << bytesWritten);
+        result = (code != FR_OK)? code : FR_DENIED;
+    }
+    ::memmove(&buffer[0], &buffer[len], end - len);
+    end -= len;
+    buffer[end] = 0;
+}
@@ -0,0 +1,126 @@
+/*******************************************************************************
+ * StmPlusPlus: object-oriented library implementing device drivers for 
+ * STM32F3 and STM32F4 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef TEXTFILE_H_
+#define TEXTFILE_H_
+
+#include "StmPlusPlus.h"
+#include "FatFS/ff.h"
+
+namespace StmPlusPlus {
+
+/**
+ * @brief Class implementing buffered line-by-line reading of a text file.
+ *
+ * The file is read in whole sectors into an internal buffer. Lines are returned
+ * as pointers into this buffer, i.e. without copying. Each sector is read into
+ * the word-aligned second half of the buffer, so that FatFS passes it directly
+ * to the SDIO DMA; the incomplete line is kept in front of it.
+ */
+class TextFileReader
+{
+public:
+
+    static const size_t SECTOR_SIZE = 512;
+    static const size_t BUFFER_SIZE = 2 * SECTOR_SIZE;
+
+    TextFileReader (FIL & _file);
+
+    /**
+     * @brief Returns the next line without line terminator or NULL at the end of file.
+     *
+     * The line is terminated by zero inside the internal buffer and may be modified
+     * by the caller. It stays valid until the next call. Lines that are longer than
+     * a sector are split.
+     */
+    char * readLine ();
+
+    inline FRESULT getResult () const
+    {
+        return result;
+    }
+
+    inline size_t getReadCalls () const
+    {
+        return readCalls;
+    }
+
+private:
+
+    FIL & file;
+    alignas(4) char buffer[BUFFER_SIZE + 1];
+    size_t begin, end;
+    bool eof;
+    FRESULT result;
+    size_t readCalls;
+
+    void fill ();
+};
+
+
+/**
+ * @brief Class implementing buffered formatted writing of a text file.
+ *
+ * The formatted text is collected in an internal buffer that is passed to
+ * the file in whole sectors.
+ */
+class TextFileWriter
+{
+public:
+
+    static const size_t SECTOR_SIZE = 512;
+    static const size_t BUFFER_SIZE = 2 * SECTOR_SIZE;
+
+    TextFileWriter (FIL & _file);
+
+    /**
+     * @brief Formats the given arguments (see printf) into the internal buffer.
+     */
+    TextFileWriter & printf (const char * format, ...) __attribute__ ((format (printf, 2, 3)));
+
+    /**
+     * @brief Writes all buffered data into the file.
+     */
+    FRESULT flush ();
+
+    inline FRESULT getResult () const
+    {
+        return result;
+    }
+
+    inline size_t getWriteCalls () const
+    {
+        return writeCalls;
+    }
+
+private:
+
+    FIL & file;
+    alignas(4) char buffer[BUFFER_SIZE + 1];
+    size_t end;
+    FRESULT result;
+    size_t writeCalls;
+
+    void write (size_t len);
+};
+
+} // end namespace
+
+#endif
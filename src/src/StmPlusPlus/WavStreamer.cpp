@@ -58,6 +58,11 @@ WavStreamer::WavStreamer (Devices::SdCard & _sdCard, Spi & _spiWav, IOPin & _pin
     currSample(0),
     samplesPerSec(0),
     readNextBlock(false),
+    triggered(false),
+    playing(false),
+    startTick(0),
+    underruns(),
+    underrunsNumber(0),
     volume(0),
     testPin(NULL)
 {
@@ -67,6 +72,17 @@ WavStreamer::WavStreamer (Devices::SdCard & _sdCard, Spi & _spiWav, IOPin & _pin
 
 
 bool WavStreamer::start (const InterruptPriority & timerPrio, SourceType s, const char * fileName)
+{
+    if (!prepare(timerPrio, s, fileName))
+    {
+        return false;
+    }
+    trigger();
+    return true;
+}
+
+
+bool WavStreamer::prepare (const InterruptPriority & timerPrio, SourceType s, const char * fileName)
 {
     sourceType = s;
     clearStream();
@@ -138,13 +154,15 @@ void WavStreamer::stop ()
 
 void WavStreamer::periodic ()
 {
-    if (currDataBuffer == NULL || sourceType != SourceType::SD_CARD)
+    UnderrunEvent e;
+    while (underruns.get(e))
     {
-        return;
+        ++underrunsNumber;
+        USART_DEBUG("Buffer underrun at sample " << e.sample << ", underruns = " << underrunsNumber);
     }
-    if (sourceType == SourceType::SD_CARD && !sdCard.isCardInserted())
+    if (currDataBuffer == NULL || sourceType != SourceType::SD_CARD)
     {
-        stop();
+        return;
     }
     if (currSample > samplesPerWav)
     {
@@ -196,6 +214,16 @@ void WavStreamer::onSample ()
 {
     __HAL_TIM_CLEAR_IT(timer.getTimerParameters(), TIM_IT_UPDATE);
 
+    if (!playing)
+    {
+        if (!triggered)
+        {
+            return;
+        }
+        playing = true;
+        startTick = HAL_GetTick();
+    }
+
     pinLeftChannel.setLow();
     spiWav.putInt(currDataBuffer[currIndexInBlock]);
     pinLeftChannel.setHigh();
@@ -208,6 +236,10 @@ void WavStreamer::onSample ()
 
     if (currIndexInBlock >= BLOCK_SIZE/2)
     {
+        if (readNextBlock)
+        {
+            underruns.put({currSample});
+        }
         currIndexInBlock = 0;
         currDataBuffer = (currDataBuffer == dataPtr1)? dataPtr2 : dataPtr1;
         readNextBlock = true;
@@ -239,9 +271,12 @@ void WavStreamer::onSecond ()
 void WavStreamer::clearStream ()
 {
     readNextBlock = false;
+    triggered = playing = false;
     samplesPerWav = UINT32_MAX;
     currIndexInBlock = currSample = 0;
     currDataBuffer = NULL;
+    underruns.clear();
+    underrunsNumber = 0;
     active = false;
 }
 
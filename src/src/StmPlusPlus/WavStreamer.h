@@ -22,6 +22,7 @@
 #define WAVSTREAMER_H_
 
 #include "StmPlusPlus.h"
+#include "EventQueue.h"
 #include "Devices/SdCard.h"
 
 #ifdef STM32F405xx
@@ -100,13 +101,55 @@ public:
         return active;
     }
 
+    /**
+     * @brief The stream is prepared and waits for trigger().
+     */
+    inline bool isArmed () const
+    {
+        return active && !playing;
+    }
+
+    /**
+     * @brief The first sample of the stream was sent to the DAC.
+     */
+    inline bool isPlaying () const
+    {
+        return active && playing;
+    }
+
+    /**
+     * @brief Returns the system tick of the first sample.
+     */
+    inline uint32_t getStartTick () const
+    {
+        return startTick;
+    }
+
     inline void setVolume (float v)
     {
         volume = v;
     }
 
+    /**
+     * @brief Prepares and immediately starts the stream.
+     */
     bool start (const InterruptPriority & timerPrio, SourceType s, const char * fileName);
 
+    /**
+     * @brief Opens the source, fills both buffers and starts the sampling timer.
+     *        The DAC is not updated until trigger() is called.
+     */
+    bool prepare (const InterruptPriority & timerPrio, SourceType s, const char * fileName);
+
+    /**
+     * @brief Starts the output of a prepared stream with the next sample.
+     *        Can be called from an interrupt service routine.
+     */
+    inline void trigger ()
+    {
+        triggered = true;
+    }
+
     void stop ();
 
     void periodic ();
@@ -150,6 +193,22 @@ private:
     volatile uint16_t * currDataBuffer;
     volatile uint32_t currIndexInBlock, currSample, samplesPerSec;
     volatile bool readNextBlock;
+    volatile bool triggered, playing;
+    volatile uint32_t startTick;
+
+    /**
+     * @brief A buffer was switched before it was refilled: the sample number
+     *        of the switch is passed from the sampling ISR to the main loop.
+     */
+    struct UnderrunEvent
+    {
+        uint32_t sample;
+    };
+
+    static const size_t EVENT_QUEUE_SIZE = 4;
+
+    EventQueue<UnderrunEvent, EVENT_QUEUE_SIZE> underruns;
+    uint32_t underrunsNumber;
 
     float volume;
 
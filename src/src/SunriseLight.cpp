@@ -0,0 +1,108 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include "SunriseLight.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace StmPlusPlus;
+
+#define USART_DEBUG_MODULE "SUN: "
+
+/************************************************************************
+ * Class SunriseLight
+ ************************************************************************/
+
+SunriseLight::SunriseLight (Devices::Dac_MCP49x1 & _dac, float gamma):
+    dac(_dac),
+    active(false),
+    startTime(0),
+    endTime(0),
+    nextUpdateTime(INFINITY_TIME),
+    value(0)
+{
+    // the light starts at the lower limit since the output is off below it
+    const float lower = dac.getLowerLimit();
+    const float range = dac.getUpperLimit() - dac.getLowerLimit();
+    for (size_t i = 0; i <= CURVE_SIZE; ++i)
+    {
+        curve[i] = (uint16_t)::lroundf(lower + range * ::powf((float)i / CURVE_SIZE, gamma));
+    }
+}
+
+
+void SunriseLight::start (time_ms _startTime, time_ms _endTime)
+{
+    USART_DEBUG("Sunrise starts, duration = " << (int)((_endTime - _startTime) / 1000L) << " sec");
+    startTime = _startTime;
+    endTime = std::max(_startTime + 1, _endTime);
+    nextUpdateTime = 0;
+    value = 0;
+    active = true;
+}
+
+
+void SunriseLight::stop ()
+{
+    if (!active)
+    {
+        return;
+    }
+    USART_DEBUG("Sunrise finished");
+    active = false;
+    nextUpdateTime = INFINITY_TIME;
+}
+
+
+void SunriseLight::periodic (time_ms now)
+{
+    if (!active || now < nextUpdateTime)
+    {
+        return;
+    }
+    nextUpdateTime = (now < endTime)? now + UPDATE_INTERVAL : INFINITY_TIME;
+    uint16_t newValue = getValue(now);
+    if (newValue != value)
+    {
+        value = newValue;
+        dac.putRawValue(value);
+    }
+}
+
+
+/**
+ * @brief Linear interpolation of the curve in fixed point: the ramp position
+ *        has 8 fractional bits per curve segment.
+ */
+uint16_t SunriseLight::getValue (time_ms now) const
+{
+    if (now <= startTime)
+    {
+        return curve[0];
+    }
+    if (now >= endTime)
+    {
+        return curve[CURVE_SIZE];
+    }
+    uint32_t pos = (uint32_t)((now - startTime) * (CURVE_SIZE << 8) / (endTime - startTime));
+    size_t i = pos >> 8;
+    int32_t frac = pos & 0xFF;
+    return curve[i] + (((int32_t)curve[i + 1] - (int32_t)curve[i]) * frac) / 256;
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef SUNRISELIGHT_H_
+#define SUNRISELIGHT_H_
+
+#include "StmPlusPlus/Devices/Dac_MCP49x1.h"
+
+/**
+ * @brief Class implementing a sunrise simulation on a DAC-controlled light.
+ *
+ * The light rises from off to the upper DAC limit along a perceptual (gamma)
+ * curve that is precomputed in DAC units. The curve is interpolated, i.e. the
+ * output changes by single DAC steps. The DAC is only written when the value
+ * changes, at most each UPDATE_INTERVAL.
+ */
+class SunriseLight
+{
+public:
+
+    static const size_t CURVE_SIZE = 64;
+    static const StmPlusPlus::duration_ms UPDATE_INTERVAL = 50;
+
+    SunriseLight (StmPlusPlus::Devices::Dac_MCP49x1 & _dac, float gamma = 2.2);
+
+    inline bool isActive () const
+    {
+        return active;
+    }
+
+    /**
+     * @brief Starts the ramp that reaches the full light at the end time. The
+     *        light stays on until stop() is called.
+     */
+    void start (StmPlusPlus::time_ms _startTime, StmPlusPlus::time_ms _endTime);
+
+    void stop ();
+
+    void periodic (StmPlusPlus::time_ms now);
+
+private:
+
+    StmPlusPlus::Devices::Dac_MCP49x1 & dac;
+    uint16_t curve[CURVE_SIZE + 1];
+    bool active;
+    StmPlusPlus::time_ms startTime, endTime, nextUpdateTime;
+    uint16_t value;
+
+    uint16_t getValue (StmPlusPlus::time_ms now) const;
+};
+
+
+#endif
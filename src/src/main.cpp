@@ -45,6 +45,10 @@ int main(void)
 extern "C" void SysTick_Handler(void)
 {
     rtcPtr->onMilliSecondInterrupt();
+    if (Devices::SdCard::getInstance() != NULL)
+    {
+        Devices::SdCard::getInstance()->onMilliSecondInterrupt();
+    }
 }
 
 extern "C" void TIM3_IRQHandler()
@@ -58,6 +62,11 @@ extern "C" void TIM4_IRQHandler()
     appPtr->onTim4Interrupt();
 }
 
+extern "C" void TIM5_IRQHandler()
+{
+    appPtr->onTim5Interrupt();
+}
+
 extern "C" void RTC_WKUP_IRQHandler()
 {
     rtcPtr->onSecondInterrupt();
@@ -77,3 +86,8 @@ extern "C" void SDIO_IRQHandler(void)
 {
     Devices::SdCard::getInstance()->processSdIOInterrupt();
 }
+
+extern "C" void EXTI15_10_IRQHandler(void)
+{
+    Devices::SdCard::getInstance()->processDetectInterrupt();
+}
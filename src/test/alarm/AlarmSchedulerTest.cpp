@@ -0,0 +1,256 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Year-long virtual-time test of the alarm scheduler. The wall clock follows
+ * the central European time including both daylight saving time transitions,
+ * small DCF corrections and stalls of the main loop, from October 2027 to
+ * January 2029, i.e. over the leap day 29.02.2028 and two new years. Each
+ * alarm shall fire exactly once per alarm day: at its time, or at once when
+ * the clock jumped over it.
+ */
+
+#include <cstdlib>
+#include <vector>
+
+#include "HostHal.h"
+#include "HostFlash.h"
+#include "AlarmScheduler.h"
+
+using namespace StmPlusPlus;
+using namespace StmPlusPlus::Devices;
+
+static const time_t SECONDS_PER_DAY = 24 * 3600;
+static const time_t MAX_STALL = 45;
+static const time_t MAX_CORRECTION = 2;
+
+/**
+ * @brief Days since 01.01.1970 of the given date.
+ */
+static time_t daysFromCivil (int y, int m, int d)
+{
+    ::tm t = {};
+    t.tm_year = y - 1900;
+    t.tm_mon = m - 1;
+    t.tm_mday = d;
+    return ::timegm(&t) / SECONDS_PER_DAY;
+}
+
+/**
+ * @brief UTC time of the transition at 01:00 UTC on the last Sunday of the given month.
+ */
+static time_t lastSunday (int y, int m)
+{
+    time_t day = daysFromCivil(y, m + 1, 1) - 1;
+    while ((day + 4) % 7 != 0)
+    {
+        --day;
+    }
+    return day * SECONDS_PER_DAY + 3600;
+}
+
+/**
+ * @brief Offset of the central European time for the given UTC time.
+ */
+static time_t getUtcOffset (time_t utc)
+{
+    // the simulation covers the years 2027 to 2029
+    static const time_t transitions[] = {
+        lastSunday(2027, 3), lastSunday(2027, 10),
+        lastSunday(2028, 3), lastSunday(2028, 10),
+        lastSunday(2029, 3), lastSunday(2029, 10)
+    };
+    size_t n = 0;
+    while (n < sizeof(transitions) / sizeof(transitions[0]) && utc >= transitions[n])
+    {
+        ++n;
+    }
+    return (n % 2 == 1)? 7200 : 3600;
+}
+
+struct Firing
+{
+    time_t wallTime;
+    bool afterJump; // the clock jumped forward since the last loop pass
+};
+
+struct Bench
+{
+    IOPin pinSdPower, pinSdDetect;
+    IOPort portSd1, portSd2;
+    SdCard sdCard;
+    BackupSram backupSram;
+    FlashStore flashStore;
+    Config config;
+    Calendar calendar;
+    AlarmScheduler scheduler;
+
+    Bench ():
+        pinSdPower(IOPort::A, GPIO_PIN_10, GPIO_MODE_OUTPUT_PP, GPIO_PULLDOWN, GPIO_SPEED_HIGH, true, false),
+        pinSdDetect(IOPort::A, GPIO_PIN_12, GPIO_MODE_INPUT, GPIO_PULLUP),
+        portSd1(IOPort::C, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP, GPIO_SPEED_FREQ_VERY_HIGH, GPIO_PIN_8, false),
+        portSd2(IOPort::D, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP, GPIO_SPEED_FREQ_VERY_HIGH, GPIO_PIN_2, false),
+        sdCard(pinSdDetect, pinSdPower, portSd1, portSd2),
+        flashStore({FLASH_SECTOR_10, 0x080C0000, 0x20000}, {FLASH_SECTOR_11, 0x080E0000, 0x20000}),
+        config(sdCard, backupSram, flashStore, "conf.txt"),
+        calendar(sdCard, "calendar.txt", "calendar.idx"),
+        scheduler(config, calendar)
+    {
+        flashStore.start();
+    }
+
+    void setAlarm (size_t alarm, int hour, int min, const char * days)
+    {
+        config.setAlarmActive(alarm, true);
+        config.setAlarmHour(alarm, hour);
+        config.setAlarmMin(alarm, min);
+        for (size_t d = 0; d < 7; ++d)
+        {
+            config.setAlarmDay(alarm, d, days[d] == '1');
+        }
+    }
+};
+
+static void testYear ()
+{
+    Host::reset();
+    Bench b;
+    // 02:30 does not exist in spring and exists twice in autumn
+    b.setAlarm(0, 2, 30, "1111111");
+    // midnight starts the leap day, a Tuesday
+    b.setAlarm(1, 0, 0, "0111110");
+    // the last minute of a day, Saturday and Sunday
+    b.setAlarm(2, 23, 59, "1000001");
+
+    const time_t startUtc = daysFromCivil(2027, 10, 1) * SECONDS_PER_DAY;
+    const time_t endUtc = daysFromCivil(2029, 1, 3) * SECONDS_PER_DAY;
+
+    ::srandom(33);
+    time_t utc = startUtc;
+    time_t correction = 0;
+    time_t wall = utc + getUtcOffset(utc) + correction;
+    time_t lastCorrectionDay = wall / SECONDS_PER_DAY;
+    const time_t startWall = wall;
+    b.scheduler.reschedule(wall);
+
+    std::vector<Firing> firings[Config::ALARMS_NUMBER];
+    size_t jumps = 0, stalls = 0, passes = 0;
+    bool jumped = false;
+    while (utc < endUtc)
+    {
+        // the main loop usually passes several times a second, but sometimes stalls
+        time_t step = 1;
+        if (random() % 5000 == 0)
+        {
+            step = 1 + random() % MAX_STALL;
+            ++stalls;
+        }
+        utc += step;
+
+        // the DCF receiver sets the clock once a day
+        time_t newWall = utc + getUtcOffset(utc) + correction;
+        if (newWall / SECONDS_PER_DAY != lastCorrectionDay)
+        {
+            lastCorrectionDay = newWall / SECONDS_PER_DAY;
+            correction = (time_t)(random() % (2 * MAX_CORRECTION + 1)) - MAX_CORRECTION;
+            newWall = utc + getUtcOffset(utc) + correction;
+        }
+        if (newWall != wall + step)
+        {
+            b.scheduler.onTimeChanged(wall + step, newWall);
+            ++jumps;
+            jumped = jumped || newWall > wall + step;
+        }
+        wall = newWall;
+
+        size_t alarm;
+        while ((alarm = b.scheduler.checkDeadline(wall)) < Config::ALARMS_NUMBER)
+        {
+            firings[alarm].push_back({wall, jumped});
+        }
+        jumped = false;
+        ++passes;
+    }
+    ::printf("%zu loop passes, %zu clock jumps, %zu stalls\n", passes, jumps, stalls);
+
+    // reference: every alarm day of every alarm, by brute force over the calendar days
+    size_t expectedTotal = 0, skipped = 0, repeated = 0;
+    for (size_t a = 0; a < Config::ALARMS_NUMBER; ++a)
+    {
+        const Config::Alarm & cfg = b.config.getAlarm(a);
+        std::vector<time_t> expected;
+        for (time_t day = startWall / SECONDS_PER_DAY; day * SECONDS_PER_DAY < wall; ++day)
+        {
+            time_t deadline = day * SECONDS_PER_DAY + cfg.hour * 3600 + cfg.min * 60;
+            ::tm t;
+            ::gmtime_r(&deadline, &t);
+            if (deadline > startWall && deadline <= wall && cfg.days[t.tm_wday])
+            {
+                expected.push_back(deadline);
+            }
+        }
+        expectedTotal += expected.size();
+        HOST_CHECK(firings[a].size() == expected.size());
+        for (size_t i = 0; i < expected.size() && i < firings[a].size(); ++i)
+        {
+            const time_t delay = firings[a][i].wallTime - expected[i];
+            // a stall delays the alarm, a skipped alarm time fires right after the jump
+            HOST_CHECK(delay >= 0);
+            HOST_CHECK(delay <= MAX_STALL + MAX_CORRECTION || (firings[a][i].afterJump && delay <= 3600 + MAX_CORRECTION));
+            if (delay > MAX_STALL + MAX_CORRECTION)
+            {
+                ++skipped;
+            }
+        }
+    }
+
+    // the only spring transition in range, 26.03.2028, skipped 02:30
+    HOST_CHECK(skipped == 1);
+
+    // 02:30 occurs twice on the autumn transition days but fires only once
+    for (int y = 2027; y <= 2028; ++y)
+    {
+        const time_t transition = lastSunday(y, 10);
+        const time_t day = (transition + 3600) / SECONDS_PER_DAY;
+        size_t n = 0;
+        for (const Firing & f : firings[0])
+        {
+            n += f.wallTime / SECONDS_PER_DAY == day;
+        }
+        HOST_CHECK(n == 1);
+        repeated += n;
+    }
+
+    // the leap day and the new years are alarm days like any other
+    const time_t leapDay = daysFromCivil(2028, 2, 29);
+    bool leapDayAlarm = false;
+    for (const Firing & f : firings[1])
+    {
+        leapDayAlarm = leapDayAlarm || f.wallTime / SECONDS_PER_DAY == leapDay;
+    }
+    HOST_CHECK(leapDayAlarm);
+    ::printf("%zu alarm days, %zu alarms after a spring transition, %zu on autumn transitions\n",
+             expectedTotal, skipped, repeated);
+}
+
+int main ()
+{
+    testYear();
+    return HOST_RESULT();
+}
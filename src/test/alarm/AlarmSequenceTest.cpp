@@ -0,0 +1,278 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Virtual-time test of the alarm sequence engine: the main loop calls it at
+ * irregular intervals and stalls now and then. The steps shall nevertheless
+ * follow each other without gaps, the volume ramp shall be linear and a
+ * snooze shall skip to the next snooze step. A snoozed alarm shall still be
+ * dismissed by the mode button.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "HostHal.h"
+#include "AlarmSequence.h"
+
+using namespace StmPlusPlus;
+
+static const duration_ms MAX_LOOP_INTERVAL = 50;
+static const duration_ms MAX_STALL = 2000;
+
+class Recorder : public AlarmSequence::EventHandler
+{
+public:
+
+    struct Event
+    {
+        time_ms time;
+        AlarmSequence::Action action;
+        uint8_t volume;
+        bool isOutput; // onSequenceOutput, otherwise onSequenceVolume
+    };
+
+    std::vector<Event> events;
+    time_ms now = 0;
+    size_t finished = 0;
+
+    virtual void onSequenceOutput (AlarmSequence::Action action, uint8_t volume)
+    {
+        events.push_back({now, action, volume, true});
+    }
+
+    virtual void onSequenceVolume (uint8_t volume)
+    {
+        events.push_back({now, events.back().action, volume, false});
+    }
+
+    virtual void onSequenceFinished ()
+    {
+        ++finished;
+    }
+};
+
+/**
+ * @brief Advances the virtual time like the main loop: mostly short passes, sometimes a stall.
+ */
+static void runLoop (AlarmSequence & seq, Recorder & rec, time_ms until)
+{
+    while (rec.now < until && seq.isActive())
+    {
+        rec.now += (random() % 200 == 0)? 1 + random() % MAX_STALL : 1 + random() % MAX_LOOP_INTERVAL;
+        seq.periodic(rec.now);
+    }
+}
+
+static void testParse ()
+{
+    static const char * valid[] = {"P10 W20-80/60 S540 x3", "W50/30", "P1", "S5 P3 x2", "W0-100/65535 x255"};
+    for (const char * str : valid)
+    {
+        AlarmSequence::Program p;
+        char formatted[64];
+        HOST_CHECK(AlarmSequence::parse(str, p));
+        AlarmSequence::format(p, formatted, sizeof(formatted));
+        HOST_CHECK(::strcmp(str, formatted) == 0);
+    }
+    static const char * invalid[] = {"", "x3", "P0", "W20-/60", "W101/10", "P10 Q5", "P1 P1 P1 P1 P1 P1 P1", "P10 x0"};
+    for (const char * str : invalid)
+    {
+        AlarmSequence::Program p;
+        HOST_CHECK(!AlarmSequence::parse(str, p));
+    }
+}
+
+static void testTiming ()
+{
+    AlarmSequence::Program program;
+    HOST_CHECK(AlarmSequence::parse("P10 W20-80/60 S540 x3", program));
+
+    AlarmSequence seq;
+    Recorder rec;
+    seq.setHandler(&rec);
+    ::srandom(35);
+    const time_ms start = 1000000;
+    rec.now = start;
+    seq.start(program, start);
+    runLoop(seq, rec, start + 3600000L);
+    HOST_CHECK(!seq.isActive());
+    HOST_CHECK(rec.finished == 1);
+
+    // reference: the step boundaries follow from the durations only
+    std::vector<time_ms> boundaries;
+    std::vector<AlarmSequence::Action> actions;
+    time_ms t = start;
+    for (size_t i = 0; i < program.repeat; ++i)
+    {
+        for (size_t k = 0; k < program.stepsNumber; ++k)
+        {
+            boundaries.push_back(t);
+            actions.push_back(program.steps[k].action);
+            t += program.steps[k].duration * 1000L;
+        }
+    }
+    const time_ms end = t;
+
+    std::vector<const Recorder::Event *> outputs;
+    for (const Recorder::Event & e : rec.events)
+    {
+        if (e.isOutput)
+        {
+            outputs.push_back(&e);
+        }
+    }
+    HOST_CHECK(outputs.size() == boundaries.size());
+    duration_ms maxDelay = 0;
+    for (size_t i = 0; i < outputs.size() && i < boundaries.size(); ++i)
+    {
+        HOST_CHECK(outputs[i]->action == actions[i]);
+        HOST_CHECK(outputs[i]->time >= boundaries[i]);
+        maxDelay = std::max(maxDelay, (duration_ms)(outputs[i]->time - boundaries[i]));
+    }
+    // a stall delays a step but never shifts the following ones
+    HOST_CHECK(maxDelay <= MAX_STALL + MAX_LOOP_INTERVAL);
+    HOST_CHECK(rec.now >= end && rec.now <= end + MAX_STALL + MAX_LOOP_INTERVAL);
+
+    // the ramp rises linearly from 20 to 80 percent in steps of RAMP_INTERVAL
+    size_t rampEvents = 0, rampErrors = 0;
+    for (size_t i = 0; i < rec.events.size(); ++i)
+    {
+        const Recorder::Event & e = rec.events[i];
+        if (e.isOutput || e.action != AlarmSequence::Action::SOUND)
+        {
+            continue;
+        }
+        ++rampEvents;
+        const Recorder::Event & prev = rec.events[i - 1];
+        HOST_CHECK(e.volume >= prev.volume);
+        // the step this event belongs to
+        size_t k = boundaries.size() - 1;
+        while (boundaries[k] > e.time)
+        {
+            --k;
+        }
+        const int expected = 20 + 60 * (int)(e.time - boundaries[k]) / 60000;
+        // a stalled loop catches up with the volume of its own time
+        rampErrors += std::abs(expected - e.volume) > 1;
+    }
+    ::printf("%zu step changes, max. delay %d ms, %zu volume changes\n",
+             outputs.size(), (int)maxDelay, rampEvents);
+    HOST_CHECK(rampErrors == 0);
+    HOST_CHECK(rampEvents >= program.repeat * (60000 / AlarmSequence::RAMP_INTERVAL - 1) - program.repeat);
+    HOST_CHECK(rampEvents <= program.repeat * (60000 / AlarmSequence::RAMP_INTERVAL));
+}
+
+static void testSnooze ()
+{
+    AlarmSequence::Program program;
+    HOST_CHECK(AlarmSequence::parse("P10 W20-80/60 S540 x3", program));
+
+    AlarmSequence seq;
+    Recorder rec;
+    seq.setHandler(&rec);
+    rec.now = 0;
+    seq.start(program, 0);
+
+    // a snooze in the sound step jumps to the snooze step of the same iteration
+    runLoop(seq, rec, 30000);
+    HOST_CHECK(seq.isRinging());
+    seq.snooze(rec.now);
+    HOST_CHECK(seq.isActive() && !seq.isRinging());
+    HOST_CHECK(rec.events.back().isOutput && rec.events.back().action == AlarmSequence::Action::SNOOZE);
+    const time_ms snoozeStart = rec.now;
+
+    // it lasts the full snooze time from the button press
+    runLoop(seq, rec, snoozeStart + 540000L - MAX_STALL - MAX_LOOP_INTERVAL);
+    HOST_CHECK(!seq.isRinging());
+    runLoop(seq, rec, snoozeStart + 540000L + MAX_STALL + MAX_LOOP_INTERVAL);
+    HOST_CHECK(seq.isRinging());
+    HOST_CHECK(seq.getNextEventTime() == snoozeStart + 540000L + 10000L);
+
+    // the second iteration is snoozed in its piezo step
+    runLoop(seq, rec, snoozeStart + 540000L + 5000L);
+    HOST_CHECK(seq.isRinging());
+    seq.snooze(rec.now);
+    HOST_CHECK(seq.isActive() && !seq.isRinging());
+    HOST_CHECK(rec.finished == 0);
+
+    // the snooze step of the last iteration is its end
+    const time_ms lastSnooze = rec.now + 540000L;
+    runLoop(seq, rec, lastSnooze + 1000L);
+    HOST_CHECK(seq.isRinging());
+    seq.snooze(rec.now);
+    HOST_CHECK(seq.isActive() && !seq.isRinging());
+    runLoop(seq, rec, rec.now + 540000L + MAX_STALL + MAX_LOOP_INTERVAL);
+    HOST_CHECK(!seq.isActive());
+    HOST_CHECK(rec.finished == 1);
+    HOST_CHECK(seq.getNextEventTime() == INFINITY_TIME);
+
+    // without a snooze step left, a snooze dismisses the alarm
+    HOST_CHECK(AlarmSequence::parse("W50/30 S60 P5", program));
+    seq.start(program, rec.now);
+    runLoop(seq, rec, rec.now + 92000L);
+    HOST_CHECK(seq.isRinging());
+    seq.snooze(rec.now);
+    HOST_CHECK(!seq.isActive());
+    HOST_CHECK(rec.finished == 2);
+}
+
+static void testButtons ()
+{
+    AlarmSequence::Program program;
+    HOST_CHECK(AlarmSequence::parse("P10 W20-80/60 S540 x3", program));
+
+    AlarmSequence seq;
+    Recorder rec;
+    seq.setHandler(&rec);
+    rec.now = 0;
+
+    // without an active sequence, the buttons are not consumed
+    HOST_CHECK(!seq.onButtonPressed(false, rec.now) && !seq.onButtonPressed(true, rec.now));
+
+    // a button snoozes the ringing alarm; in the snooze step it is consumed without effect
+    seq.start(program, rec.now);
+    runLoop(seq, rec, 5000);
+    HOST_CHECK(seq.onButtonPressed(false, rec.now));
+    HOST_CHECK(seq.isActive() && !seq.isRinging());
+    const time_ms snoozeEnd = rec.now + 540000L;
+    runLoop(seq, rec, rec.now + 60000L);
+    HOST_CHECK(seq.onButtonPressed(false, rec.now));
+    HOST_CHECK(seq.isActive() && !seq.isRinging());
+    HOST_CHECK(seq.getNextEventTime() == snoozeEnd);
+
+    // the snoozed alarm is dismissed and does not ring again
+    HOST_CHECK(seq.onButtonPressed(true, rec.now));
+    HOST_CHECK(!seq.isActive());
+    HOST_CHECK(rec.finished == 1);
+    const size_t events = rec.events.size();
+    rec.now += 2 * 540000L;
+    seq.periodic(rec.now);
+    HOST_CHECK(rec.events.size() == events);
+}
+
+int main ()
+{
+    testParse();
+    testTiming();
+    testSnooze();
+    testButtons();
+    return HOST_RESULT();
+}
@@ -0,0 +1,249 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Host test of the batched configuration changes: the setters called from the
+ * button handler shall neither program nor erase the flash. The changes are
+ * committed after Config::COMMIT_DELAY or by Config::commit(). The backup SRAM
+ * is updated at once, i.e. a reset before the commit does not lose a change.
+ */
+
+#include "HostHal.h"
+#include "HostFlash.h"
+#include "Config.h"
+
+using namespace StmPlusPlus;
+using namespace StmPlusPlus::Devices;
+
+struct Bench
+{
+    IOPin pinSdPower, pinSdDetect;
+    IOPort portSd1, portSd2;
+    SdCard sdCard;
+    BackupSram backupSram;
+    FlashStore flashStore;
+    Config config;
+
+    Bench ():
+        pinSdPower(IOPort::A, GPIO_PIN_10, GPIO_MODE_OUTPUT_PP, GPIO_PULLDOWN, GPIO_SPEED_HIGH, true, false),
+        pinSdDetect(IOPort::A, GPIO_PIN_12, GPIO_MODE_INPUT, GPIO_PULLUP),
+        portSd1(IOPort::C, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP, GPIO_SPEED_FREQ_VERY_HIGH, GPIO_PIN_8, false),
+        portSd2(IOPort::D, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP, GPIO_SPEED_FREQ_VERY_HIGH, GPIO_PIN_2, false),
+        sdCard(pinSdDetect, pinSdPower, portSd1, portSd2),
+        flashStore({FLASH_SECTOR_10, 0x080C0000, 0x20000}, {FLASH_SECTOR_11, 0x080E0000, 0x20000}),
+        config(sdCard, backupSram, flashStore, "conf.txt")
+    {
+        flashStore.start();
+    }
+};
+
+/**
+ * @brief Presses the "+" button on the hour of the first alarm the given number of times.
+ */
+static void pressHourButton (Bench & b, size_t presses)
+{
+    for (size_t i = 0; i < presses; ++i)
+    {
+        b.config.setAlarmHour(0, (b.config.getAlarm(0).hour + 1) % 24);
+        Host::advance(300);
+    }
+}
+
+static void testCommitAfterDelay ()
+{
+    Host::reset();
+    Bench b;
+    Host::resetFlashStatistics();
+
+    uint32_t start = Host::getTick();
+    pressHourButton(b, 20);
+    HOST_CHECK(b.config.hasPendingChanges());
+    HOST_CHECK(Host::getFlashStatistics().programs == 0);
+    // the button handler is never stalled by the flash
+    HOST_CHECK(Host::getTick() - start == 20 * 300);
+
+    // the changes are kept until the user stops pressing buttons
+    Host::advance(Config::COMMIT_DELAY - 400);
+    b.config.periodic();
+    HOST_CHECK(b.config.hasPendingChanges());
+    HOST_CHECK(Host::getFlashStatistics().programs == 0);
+
+    Host::advance(100);
+    b.config.periodic();
+    HOST_CHECK(!b.config.hasPendingChanges());
+    size_t programs = Host::getFlashStatistics().programs;
+    ::printf("20 button presses: %zu words programmed in one commit (alarm settings %zu of %zu bytes)\n",
+             programs, Config::ALARM_SETTINGS_SIZE, sizeof(Config::Alarm));
+    // one record of the alarm settings and one of the file state
+    HOST_CHECK(programs > 0 && programs <= 2 * (2 + (Config::ALARM_SETTINGS_SIZE + 3) / 4));
+
+    const int8_t hour = b.config.getAlarm(0).hour;
+
+    // a restart restores the value from the backup SRAM or, if it is lost, from the flash
+    Bench restored;
+    HOST_CHECK(restored.config.restoreSnapshot());
+    HOST_CHECK(restored.config.getAlarm(0).hour == hour);
+    HOST_CHECK(restored.config.hasChanges());
+    Bench fromFlash;
+    fromFlash.config.restoreFromFlash();
+    HOST_CHECK(fromFlash.config.getAlarm(0).hour == hour);
+    HOST_CHECK(fromFlash.config.hasChanges());
+}
+
+static void testCommitOnScreenChange ()
+{
+    Host::reset();
+    Bench b;
+    Host::resetFlashStatistics();
+
+    pressHourButton(b, 3);
+    b.config.setBrightnessManValue(40);
+    HOST_CHECK(Host::getFlashStatistics().programs == 0);
+
+    // leaving the screen commits at once
+    b.config.commit();
+    HOST_CHECK(!b.config.hasPendingChanges());
+    size_t programs = Host::getFlashStatistics().programs;
+    HOST_CHECK(programs > 0);
+
+    // nothing is written twice
+    Host::advance(Config::COMMIT_DELAY);
+    b.config.periodic();
+    b.config.commit();
+    HOST_CHECK(Host::getFlashStatistics().programs == programs);
+
+    Bench fromFlash;
+    fromFlash.config.restoreFromFlash();
+    HOST_CHECK(fromFlash.config.getBrightness().manValue == 40);
+    HOST_CHECK(fromFlash.config.getAlarm(0).hour == b.config.getAlarm(0).hour);
+}
+
+/**
+ * @brief Commits button presses until the store compacted into the spare sector.
+ * @return the number of commits that stalled
+ */
+static size_t fillStore (Bench & b, size_t & commits)
+{
+    size_t stalled = 0;
+    commits = 0;
+    const bool spareErased = b.flashStore.isSpareErased();
+    const size_t erases = Host::getFlashStatistics().erases[FLASH_SECTOR_10] + Host::getFlashStatistics().erases[FLASH_SECTOR_11];
+    while (b.flashStore.isSpareErased() == spareErased &&
+           Host::getFlashStatistics().erases[FLASH_SECTOR_10] + Host::getFlashStatistics().erases[FLASH_SECTOR_11] == erases)
+    {
+        uint32_t start = Host::getTick();
+        pressHourButton(b, 1);
+        b.config.commit();
+        ++commits;
+        if (Host::getTick() - start != 300)
+        {
+            ++stalled;
+        }
+    }
+    return stalled;
+}
+
+static void testPreparedCompaction ()
+{
+    Host::reset();
+    Bench b;
+    Host::resetFlashStatistics();
+
+    // the spare sector of a new store is already erased
+    HOST_CHECK(b.flashStore.isSpareErased());
+    size_t commits = 0;
+    HOST_CHECK(fillStore(b, commits) == 0);
+    HOST_CHECK(!b.flashStore.isSpareErased());
+    ::printf("compaction after %zu commits\n", commits);
+
+    // the main loop erases the spare sector while the clock is idle ...
+    uint32_t start = Host::getTick();
+    HOST_CHECK(b.flashStore.eraseSpare() == HAL_OK);
+    HOST_CHECK(b.flashStore.isSpareErased());
+    HOST_CHECK(Host::getTick() - start >= Host::FLASH_ERASE_TIME_128K);
+
+    // ... so that the next compaction does not stall
+    Host::resetFlashStatistics();
+    HOST_CHECK(fillStore(b, commits) == 0);
+    HOST_CHECK(!b.flashStore.isSpareErased());
+    HOST_CHECK(Host::getFlashStatistics().erases[FLASH_SECTOR_10] == 0);
+    HOST_CHECK(Host::getFlashStatistics().erases[FLASH_SECTOR_11] == 0);
+
+    // without it, the compaction erases the sector itself in one stalled commit
+    HOST_CHECK(fillStore(b, commits) == 1);
+    HOST_CHECK(Host::getFlashStatistics().erases[FLASH_SECTOR_10] + Host::getFlashStatistics().erases[FLASH_SECTOR_11] == 1);
+}
+
+static void testResetBeforeCommit ()
+{
+    Host::reset();
+    Bench b;
+    Host::resetFlashStatistics();
+
+    pressHourButton(b, 3);
+    const int8_t hour = b.config.getAlarm(0).hour;
+    HOST_CHECK(Host::getFlashStatistics().programs == 0);
+
+    // a reset right after the change restores it from the backup SRAM ...
+    Bench restarted;
+    HOST_CHECK(restarted.config.restoreSnapshot());
+    HOST_CHECK(restarted.config.getAlarm(0).hour == hour);
+    HOST_CHECK(restarted.config.hasPendingChanges());
+
+    // ... and commits it into the flash later
+    Host::advance(Config::COMMIT_DELAY);
+    restarted.config.periodic();
+    HOST_CHECK(!restarted.config.hasPendingChanges());
+    HOST_CHECK(Host::getFlashStatistics().programs > 0);
+    Bench fromFlash;
+    fromFlash.config.restoreFromFlash();
+    HOST_CHECK(fromFlash.config.getAlarm(0).hour == hour);
+}
+
+/**
+ * @brief The parts of an alarm are separate records that are restored together.
+ */
+static void testAlarmRecords ()
+{
+    Host::reset();
+    Bench b;
+    b.config.setAlarmHour(1, 5);
+    b.config.commit();
+    AlarmSequence::Program sequence;
+    HOST_CHECK(AlarmSequence::parse("P10 W20-80/60", sequence));
+    HOST_CHECK(b.flashStore.write(Config::KEY_ALARM_SOUND + 1, "wake.wav", 9) == HAL_OK);
+    HOST_CHECK(b.flashStore.write(Config::KEY_ALARM_SEQUENCE + 1, &sequence, sizeof(sequence)) == HAL_OK);
+
+    Bench fromFlash;
+    fromFlash.config.restoreFromFlash();
+    const Config::Alarm & a = fromFlash.config.getAlarm(1);
+    HOST_CHECK(a.hour == 5 && a.min == b.config.getAlarm(1).min);
+    HOST_CHECK(::strcmp(a.sound, "wake.wav") == 0);
+    HOST_CHECK(a.sequence.stepsNumber == sequence.stepsNumber && a.sequence.repeat == sequence.repeat);
+}
+
+int main ()
+{
+    testCommitAfterDelay();
+    testResetBeforeCommit();
+    testAlarmRecords();
+    testCommitOnScreenChange();
+    testPreparedCompaction();
+    return HOST_RESULT();
+}
@@ -0,0 +1,153 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Microbenchmark of the configuration key lookup: the compile-time perfect
+ * hash of CfgParameter::Convert against the linear strcmp search it replaced.
+ * String comparisons are counted by a linker wrapper of strcmp.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "HostHal.h"
+#include "Config.h"
+
+static size_t strcmpCalls = 0;
+
+extern "C" {
+
+int __real_strcmp (const char * s1, const char * s2);
+
+int __wrap_strcmp (const char * s1, const char * s2)
+{
+    ++strcmpCalls;
+    return __real_strcmp(s1, s2);
+}
+
+} // extern "C"
+
+/**
+ * @brief Lookup of the original ConvertClass: strcmp against every entry.
+ */
+static bool convertLinear (const char * image, CfgParameter::Type & value)
+{
+    for (size_t i = 0; i < CfgParameter::size; ++i)
+    {
+        if (::strcmp(image, CfgParameter::strings[i]) == 0)
+        {
+            value = static_cast<CfgParameter::Type>(i);
+            return true;
+        }
+    }
+    value = static_cast<CfgParameter::Type>(0);
+    return false;
+}
+
+static bool convertHashed (const char * image, CfgParameter::Type & value)
+{
+    return CfgParameter::Convert(image, value);
+}
+
+static void testIdentity ()
+{
+    for (size_t i = 0; i < CfgParameter::size; ++i)
+    {
+        CfgParameter::Type par;
+        HOST_CHECK(CfgParameter::Convert(CfgParameter::strings[i], par));
+        HOST_CHECK(par == (CfgParameter::Type)i);
+        HOST_CHECK(::strcmp(CfgParameter::AsString(par), CfgParameter::strings[i]) == 0);
+    }
+
+    // unknown keys, including near misses of valid ones, are rejected
+    const char * unknown[] = { "", "INVALID_PARAMETER", "ALARM1_HM", "ALARMn_H", "ALARMn_HMM",
+            "alarmn_hm", "SOUND_VOLUME ", "BRIGH", "DCF_EDGE", "XDCF_EDGES" };
+    for (const char * key : unknown)
+    {
+        CfgParameter::Type par;
+        HOST_CHECK(!CfgParameter::Convert(key, par));
+        HOST_CHECK(par == (CfgParameter::Type)0);
+    }
+}
+
+typedef bool (*ConvertFunction) (const char * image, CfgParameter::Type & value);
+
+static void measure (const char * name, ConvertFunction f, const std::vector<std::string> & keys,
+        size_t rounds, double & nsPerLookup, double & strcmpPerLookup)
+{
+    size_t found = 0;
+    strcmpCalls = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        for (auto & k : keys)
+        {
+            CfgParameter::Type par;
+            found += f(k.c_str(), par)? 1 + par : 0;
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+    const double lookups = (double)rounds * keys.size();
+    nsPerLookup = std::chrono::duration<double, std::nano>(stop - start).count() / lookups;
+    strcmpPerLookup = strcmpCalls / lookups;
+    ::printf("  %-6s %6.1f ns/lookup, %5.2f strcmp/lookup (checksum %zu)\n",
+            name, nsPerLookup, strcmpPerLookup, found);
+}
+
+static void benchmark (const char * title, const std::vector<std::string> & keys)
+{
+    // both lookups shall agree on every key
+    for (auto & k : keys)
+    {
+        CfgParameter::Type p1, p2;
+        HOST_CHECK(convertLinear(k.c_str(), p1) == convertHashed(k.c_str(), p2));
+        HOST_CHECK(p1 == p2);
+    }
+
+    const size_t rounds = 200000 / keys.size();
+    double nsLinear, nsHashed, cmpLinear, cmpHashed;
+    ::printf("%s (%zu keys):\n", title, keys.size());
+    measure("linear", convertLinear, keys, rounds, nsLinear, cmpLinear);
+    measure("hashed", convertHashed, keys, rounds, nsHashed, cmpHashed);
+
+    // the hashed lookup confirms a key with at most one comparison
+    HOST_CHECK(cmpHashed <= 1.0);
+    HOST_CHECK(cmpHashed < cmpLinear);
+}
+
+int main ()
+{
+    testIdentity();
+
+    // the keys of a configuration file as they are passed to Convert, i.e. with the
+    // alarm number replaced by the placeholder
+    std::vector<std::string> fileKeys;
+    for (size_t i = 0; i < CfgParameter::size; ++i)
+    {
+        fileKeys.push_back(CfgParameter::strings[i]);
+    }
+    benchmark("valid keys", fileKeys);
+
+    std::vector<std::string> unknownKeys = { "ALARMn_SNOOZE", "BRIGH_AUTO", "DCF_TIMEOUT", "VOLUME" };
+    benchmark("unknown keys", unknownKeys);
+
+    return HOST_RESULT();
+}
@@ -0,0 +1,258 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Power-loss and wear simulation of the flash key/value store on the host
+ * flash model. The power fails at random flash operations, including the
+ * compaction and the erase of the spare sector; after each failure, a new
+ * store instance shall deliver for every key either the last completed
+ * value or the interrupted one.
+ */
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "HostHal.h"
+#include "HostFlash.h"
+#include "StmPlusPlus/FlashStore.h"
+
+using namespace StmPlusPlus;
+
+typedef std::vector<uint8_t> Value;
+typedef std::map<uint16_t, Value> Content;
+
+class Collector : public FlashStore::RecordHandler
+{
+public:
+
+    Content content;
+    size_t records = 0;
+
+    virtual void onRecord (uint16_t key, const void * data, size_t length)
+    {
+        const uint8_t * p = static_cast<const uint8_t *>(data);
+        content[key] = Value(p, p + length);
+        ++records;
+    }
+};
+
+static Content readContent (const FlashStore & store)
+{
+    Collector c;
+    store.readAll(c);
+    return c.content;
+}
+
+static Value makeValue (std::mt19937 & random, size_t maxLength)
+{
+    Value v(1 + random() % maxLength);
+    for (auto & b : v)
+    {
+        b = random();
+    }
+    return v;
+}
+
+/************************************************************************
+ * Power loss
+ ************************************************************************/
+
+// two small sectors in order to compact often
+static const FlashStore::Sector SMALL1 = { FLASH_SECTOR_2, 0x08008000, 0x4000 };
+static const FlashStore::Sector SMALL2 = { FLASH_SECTOR_3, 0x0800C000, 0x4000 };
+
+/**
+ * @brief Writes random records until the power fails. Returns false if the
+ *        power did not fail within the given number of steps.
+ */
+static bool runUntilPowerLoss (std::mt19937 & random, Content & committed, size_t steps,
+        uint16_t & pendingKey, Value & pendingValue)
+{
+    FlashStore store(SMALL1, SMALL2);
+    try
+    {
+        HOST_CHECK(store.start() == HAL_OK);
+        for (size_t i = 0; i < steps; ++i)
+        {
+            if (random() % 8 == 0 && !store.isSpareErased())
+            {
+                pendingKey = FlashStore::MAX_KEYS;
+                HOST_CHECK(store.eraseSpare() == HAL_OK);
+                HOST_CHECK(store.isSpareErased());
+                continue;
+            }
+            pendingKey = random() % FlashStore::MAX_KEYS;
+            pendingValue = makeValue(random, FlashStore::MAX_LENGTH);
+            HOST_CHECK(store.write(pendingKey, pendingValue.data(), pendingValue.size()) == HAL_OK);
+            committed[pendingKey] = pendingValue;
+        }
+    }
+    catch (const Host::PowerLoss &)
+    {
+        return true;
+    }
+    return false;
+}
+
+static bool checkRecovered (const Content & committed, uint16_t pendingKey, const Value & pendingValue)
+{
+    FlashStore store(SMALL1, SMALL2);
+    if (store.start() != HAL_OK)
+    {
+        return false;
+    }
+    Content actual = readContent(store);
+    bool ok = true;
+    for (auto & a : actual)
+    {
+        auto c = committed.find(a.first);
+        bool isCommitted = c != committed.end() && c->second == a.second;
+        bool isPending = a.first == pendingKey && a.second == pendingValue;
+        ok = ok && (isCommitted || isPending);
+    }
+    for (auto & c : committed)
+    {
+        // a committed key shall not disappear
+        ok = ok && actual.find(c.first) != actual.end();
+    }
+    return ok;
+}
+
+static void testPowerLoss ()
+{
+    const size_t TRIALS = 1000;
+    size_t failures = 0, lost = 0;
+    for (size_t trial = 0; trial < TRIALS; ++trial)
+    {
+        std::mt19937 random(trial);
+        Host::reset();
+        Content committed;
+        uint16_t pendingKey = FlashStore::MAX_KEYS;
+        Value pendingValue;
+
+        // several power losses in the life of one flash image
+        for (size_t life = 0; life < 4; ++life)
+        {
+            // every second failure hits a sector erase
+            if (life % 2 == 0)
+            {
+                Host::setPowerLoss(random() % 6000, trial);
+            }
+            else
+            {
+                Host::setPowerLoss(random() % 3, trial, true);
+            }
+            bool powerLost = runUntilPowerLoss(random, committed, 400, pendingKey, pendingValue);
+            Host::setPowerLoss(-1, 0);
+            lost += powerLost;
+            if (!checkRecovered(committed, pendingKey, pendingValue))
+            {
+                ++failures;
+                ::printf("trial %zu, life %zu: store is not consistent after the power loss\n", trial, life);
+                break;
+            }
+
+            // the interrupted value is either kept or lost: continue with the actual state
+            FlashStore store(SMALL1, SMALL2);
+            store.start();
+            Content actual = readContent(store);
+            if (pendingKey < FlashStore::MAX_KEYS && actual.count(pendingKey))
+            {
+                committed[pendingKey] = actual[pendingKey];
+            }
+        }
+    }
+    ::printf("power loss: %zu trials, %zu power losses, %zu inconsistent stores\n", TRIALS, lost, failures);
+    HOST_CHECK(failures == 0);
+    HOST_CHECK(lost > TRIALS);
+    HOST_CHECK(Host::getFlashStatistics().conflicts == 0);
+}
+
+/************************************************************************
+ * Wear
+ ************************************************************************/
+
+// the sectors of the configuration store
+static const FlashStore::Sector CONFIG1 = { FLASH_SECTOR_10, 0x080C0000, 0x20000 };
+static const FlashStore::Sector CONFIG2 = { FLASH_SECTOR_11, 0x080E0000, 0x20000 };
+
+static void testWear (bool preErase)
+{
+    const size_t WRITES = 200000;
+    // record sizes of the configuration objects
+    const size_t sizes[] = { 12, 3, 4, 2, 120, 120, 120 };
+    const uint16_t keys[] = { 0, 1, 2, 3, 16, 17, 18 };
+
+    Host::reset();
+    Host::resetFlashStatistics();
+    std::mt19937 random(1);
+    FlashStore store(CONFIG1, CONFIG2);
+    HOST_CHECK(store.start() == HAL_OK);
+    Content expected;
+    size_t stalledWrites = 0;
+    uint32_t stallTime = 0;
+    for (size_t i = 0; i < WRITES; ++i)
+    {
+        size_t k = random() % 7;
+        Value v(sizes[k]);
+        for (auto & b : v)
+        {
+            b = random();
+        }
+        uint32_t start = Host::getTick();
+        HOST_CHECK(store.write(keys[k], v.data(), v.size()) == HAL_OK);
+        if (Host::getTick() != start)
+        {
+            ++stalledWrites;
+            stallTime += Host::getTick() - start;
+        }
+        expected[keys[k]] = v;
+        if (preErase && !store.isSpareErased())
+        {
+            // the main loop erases the spare sector when the clock is idle
+            store.eraseSpare();
+        }
+    }
+    HOST_CHECK(readContent(store) == expected);
+    FlashStore restarted(CONFIG1, CONFIG2);
+    HOST_CHECK(restarted.start() == HAL_OK);
+    HOST_CHECK(readContent(restarted) == expected);
+
+    const Host::FlashStatistics & s = Host::getFlashStatistics();
+    size_t e1 = s.erases[FLASH_SECTOR_10], e2 = s.erases[FLASH_SECTOR_11];
+    ::printf("wear (%s): %zu writes, erases %zu/%zu, %.0f writes per erase, "
+            "%zu writes stalled by %u ms in total\n",
+            preErase? "spare erased in advance" : "erase in compaction",
+            WRITES, e1, e2, (double)WRITES / (e1 + e2), stalledWrites, (unsigned)stallTime);
+
+    // both sectors wear evenly, a write is only stalled if the spare is not prepared
+    HOST_CHECK(e1 + e2 > 2);
+    HOST_CHECK((e1 > e2? e1 - e2 : e2 - e1) <= 2);
+    HOST_CHECK(preErase? stalledWrites == 0 : stalledWrites > 0);
+    HOST_CHECK(s.conflicts == 0);
+}
+
+int main ()
+{
+    testWear(false);
+    testWear(true);
+    testPowerLoss();
+    return HOST_RESULT();
+}
@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Accuracy benchmark of the DCF77 bit classification against the signal-to-
+ * noise ratio: the matched filter of the firmware, which sums the raw samples
+ * of the bit window on its own locked phase, against a threshold classifier
+ * that takes the median-filtered sample in the middle of the bit window on the
+ * ideal phase of the transmitter. Both classify the same samples. Reported are
+ * the bit error rates and, for the matched filter, the share of bits below the
+ * weak confidence of the clock and the error rate of the confident bits.
+ */
+
+#include <cstdlib>
+#include <map>
+
+#include "HostHal.h"
+#include "DcfSignal.h"
+#include "DcfSimulation.h"
+
+using namespace Host;
+using namespace StmPlusPlus;
+using namespace StmPlusPlus::Devices;
+
+static const size_t RUNS = 5;
+static const uint64_t RUN_TIME = 20 * 60 * 1000000ULL;
+static const uint8_t WEAK_CONFIDENCE = 50; // DigitalClock::DCF_WEAK_CONFIDENCE
+static const time_t START = 1792292940;
+
+struct Counters
+{
+    size_t bits, misaligned;
+    size_t thresholdErrors, matchedErrors;
+    size_t weak, confidentErrors;
+};
+
+class BitBench : public DcfSimulation
+{
+public:
+
+    BitBench (DcfSignal & _signal, uint64_t startTime, uint32_t seed, Counters & _counters):
+        DcfSimulation(_signal, startTime, seed),
+        signal(_signal),
+        counters(_counters)
+    {
+        // empty
+    }
+
+    virtual void onDcfBit (int16_t secondNr, size_t errorNr, bool bit, uint8_t confidence)
+    {
+        if (secondNr < 0 || errorNr != 0)
+        {
+            return;
+        }
+        // the bit is reported at the end of its window, about 200 ms after the mark
+        const int64_t second = (signal.getTransmitterTime(getTime()) - 150) / 1000;
+        if (second % 60 != secondNr)
+        {
+            ++counters.misaligned;
+            return;
+        }
+        const int sent = DcfSignal::getBit(second * 1000);
+        auto t = threshold.find(second);
+        if (sent < 0 || t == threshold.end())
+        {
+            return;
+        }
+        ++counters.bits;
+        counters.thresholdErrors += t->second != sent;
+        counters.matchedErrors += bit != sent;
+        if (confidence < WEAK_CONFIDENCE)
+        {
+            ++counters.weak;
+        }
+        else
+        {
+            counters.confidentErrors += bit != sent;
+        }
+        threshold.erase(threshold.begin(), t);
+    }
+
+protected:
+
+    virtual void onInputSample (uint64_t time, bool sample)
+    {
+        const bool filtered = filter.processSample(sample);
+        const int64_t tx = signal.getTransmitterTime(time);
+        // the filter returns the majority of the 7 preceding samples, i.e. of 120..180 ms
+        if (tx % 1000 / 10 == 19)
+        {
+            threshold[tx / 1000] = filtered;
+        }
+    }
+
+private:
+
+    DcfSignal & signal;
+    Counters & counters;
+    DcfMedianFilter filter;
+    std::map<int64_t, bool> threshold; // decision per second of the transmitter
+};
+
+int main ()
+{
+    ::setenv("TZ", "UTC", 1);
+    static const double snrs[] = {6.0, 4.0, 2.0, 0.0, -2.0, -4.0};
+    ::printf("   SNR   flips   threshold   matched   weak bits   confident bits\n");
+    for (double snr : snrs)
+    {
+        Counters c = {0, 0, 0, 0, 0, 0};
+        for (size_t run = 0; run < RUNS; ++run)
+        {
+            const uint32_t seed = 1000 * run + 40;
+            DcfSignal signal(START, seed);
+            signal.setImpairments({snr, 0, 0.0, 0});
+            BitBench bench(signal, (uint64_t)(seed * 7919 % 60000) * 1000, seed, c);
+            bench.run(RUN_TIME);
+        }
+        DcfSignal signal(START, 0);
+        signal.setImpairments({snr, 0, 0.0, 0});
+        const double thresholdBer = (double)c.thresholdErrors / c.bits;
+        const double matchedBer = (double)c.matchedErrors / c.bits;
+        const double confidentBer = (c.bits > c.weak)? (double)c.confidentErrors / (c.bits - c.weak) : 0.0;
+        ::printf("%4.0f dB %5.1f %%   %6.2f %%   %6.2f %%   %6.1f %%    %6.2f %% errors\n",
+                 snr, 100.0 * signal.getFlipRate(), 100.0 * thresholdBer, 100.0 * matchedBer,
+                 100.0 * c.weak / c.bits, 100.0 * confidentBer);
+
+        HOST_CHECK(c.bits > RUNS * 10 * 59);
+        HOST_CHECK(c.misaligned == 0);
+        // the matched filter uses all samples of the window instead of seven
+        HOST_CHECK(matchedBer <= thresholdBer);
+        // the confidence separates the reliable bits
+        HOST_CHECK(confidentBer <= matchedBer);
+    }
+    return HOST_RESULT();
+}
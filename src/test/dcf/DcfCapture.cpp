@@ -0,0 +1,95 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <cstdio>
+
+#include "StmPlusPlus/Devices/Dcf77.h"
+#include "DcfCapture.h"
+
+using namespace StmPlusPlus::Devices;
+
+namespace Host {
+
+DcfCapture::DcfCapture ():
+    dropped(0)
+{
+    // empty
+}
+
+
+bool DcfCapture::load (const char * fileName)
+{
+    samples.clear();
+    blocks.clear();
+    dropped = 0;
+
+    FILE * f = ::fopen(fileName, "rb");
+    if (f == NULL)
+    {
+        return false;
+    }
+    DcfSampleRecorder::Block b;
+    uint16_t sequence = 0;
+    bool valid = true;
+    while (valid && ::fread(&b, sizeof(b), 1, f) == 1)
+    {
+        const DcfSampleRecorder::Header & h = b.header;
+        valid = h.magic == DcfSampleRecorder::MAGIC && h.samples <= DcfSampleRecorder::SAMPLES_PER_BLOCK;
+        if (!valid)
+        {
+            break;
+        }
+        // the sequence number of the first block is taken as it is
+        size_t missing = blocks.empty()? 0 : (uint16_t)(h.sequence - sequence) * DcfSampleRecorder::SAMPLES_PER_BLOCK;
+        missing += h.dropped;
+        samples.insert(samples.end(), missing, true);
+        dropped += missing;
+        sequence = h.sequence + 1;
+
+        blocks.push_back({samples.size(), (int64_t)h.startTime});
+        for (size_t i = 0; i < h.samples; ++i)
+        {
+            samples.push_back((b.data[i >> 3] >> (7 - (i & 7))) & 1);
+        }
+    }
+    ::fclose(f);
+    return valid && !blocks.empty();
+}
+
+
+bool DcfCapture::getSample (uint64_t us)
+{
+    const size_t n = us / SAMPLE_PERIOD;
+    return n < samples.size() && samples[n];
+}
+
+
+int64_t DcfCapture::getTransmitterTime (uint64_t us) const
+{
+    const size_t n = us / SAMPLE_PERIOD;
+    size_t i = blocks.size();
+    while (i > 1 && blocks[i - 1].firstSample > n)
+    {
+        --i;
+    }
+    const Block & b = blocks[i - 1];
+    return b.startTime + ((int64_t)us - (int64_t)b.firstSample * SAMPLE_PERIOD) / 1000;
+}
+
+} // end namespace Host
@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef DCFCAPTURE_H_
+#define DCFCAPTURE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "DcfSource.h"
+
+namespace Host {
+
+/**
+ * @brief Replay of a capture file written by DcfSampleRecorder ("DCFC" blocks).
+ *
+ * The samples of all blocks are concatenated, sample n is returned for the
+ * times from n * 10 ms on. Samples that the recorder dropped, as well as blocks
+ * missing in the sequence, are replaced by a reduced carrier so that the
+ * following samples keep their time. The transmitter time is the RTC time of
+ * the recording clock: the start time of the block plus the time since its
+ * first sample. It is only a reference if that clock was synchronized.
+ */
+class DcfCapture : public DcfSource
+{
+public:
+
+    DcfCapture ();
+
+    /**
+     * @brief Reads the given file. Fails if it is not a capture.
+     */
+    bool load (const char * fileName);
+
+    virtual bool getSample (uint64_t us);
+    virtual int64_t getTransmitterTime (uint64_t us) const;
+
+    /**
+     * @brief Returns the time behind the last sample in microseconds.
+     */
+    inline uint64_t getDuration () const
+    {
+        return (uint64_t)samples.size() * SAMPLE_PERIOD;
+    }
+
+    inline size_t getBlocks () const
+    {
+        return blocks.size();
+    }
+
+    inline size_t getDropped () const
+    {
+        return dropped;
+    }
+
+private:
+
+    struct Block
+    {
+        size_t firstSample;
+        int64_t startTime;
+    };
+
+    std::vector<bool> samples;
+    std::vector<Block> blocks;
+    size_t dropped;
+};
+
+} // end namespace Host
+
+#endif
@@ -0,0 +1,119 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Benchmark of the DCF77 decoder against the signal-to-noise ratio of the
+ * receiver output: the phase-locked decoder of the firmware against the
+ * edge-based decoder it replaced. Both get the same generated signal, sampled
+ * at the same instants, and start at a random moment of the first minutes.
+ * Reported are the runs with a correct time within the time limit, the wrong
+ * times and the mean time to the first correct time.
+ */
+
+#include <cstdlib>
+
+#include "HostHal.h"
+#include "DcfSignal.h"
+#include "DcfSimulation.h"
+#include "LegacyDcfDecoder.h"
+
+using namespace Host;
+
+static const size_t RUNS = 20;
+static const uint64_t TIME_LIMIT = 30 * 60 * 1000000ULL;
+
+struct Result
+{
+    size_t decoded, wrong;
+    double timeSum; // seconds to the first correct time
+};
+
+/**
+ * @brief Time of the first minute mark: 18.10.2026 03:09 (a Sunday)
+ */
+static const time_t START = 1792292940;
+
+static void runLegacy (const DcfSignal::Impairments & imp, uint32_t seed, uint64_t startTime, Result & r)
+{
+    DcfSignal signal(START, seed);
+    signal.setImpairments(imp);
+    LegacyDcfDecoder decoder;
+    const uint32_t samplePhase = seed % 10;
+    uint64_t t = startTime / 10000 * 10000 + samplePhase * 1000;
+    for (; t < startTime + TIME_LIMIT; t += DcfSignal::SAMPLE_PERIOD)
+    {
+        if (!decoder.processSample(signal.getSample(t)))
+        {
+            continue;
+        }
+        ::tm dayTime = decoder.getDayTime();
+        const int64_t error = (int64_t)::timegm(&dayTime) * 1000 - signal.getTransmitterTime(t);
+        if (::llabs(error) <= DcfSimulation::MAX_ERROR_MS)
+        {
+            ++r.decoded;
+            r.timeSum += (t - startTime) / 1e6;
+            return;
+        }
+        ++r.wrong;
+    }
+}
+
+static void runFirmware (const DcfSignal::Impairments & imp, uint32_t seed, uint64_t startTime, Result & r)
+{
+    DcfSignal signal(START, seed);
+    signal.setImpairments(imp);
+    DcfSimulation sim(signal, startTime, seed);
+    sim.run(startTime + TIME_LIMIT, true);
+    const DcfSimulation::Statistics & s = sim.getStatistics();
+    r.wrong += s.wrong;
+    if (s.correct > 0)
+    {
+        ++r.decoded;
+        r.timeSum += s.firstCorrect / 1e6;
+    }
+}
+
+int main ()
+{
+    ::setenv("TZ", "UTC", 1);
+    static const double snrs[] = {12.0, 6.0, 4.0, 2.0, 0.0, -2.0, -4.0};
+    ::printf("   SNR   flips   old decoder              new decoder\n");
+    for (double snr : snrs)
+    {
+        DcfSignal::Impairments imp = {snr, 0, 0.0, 0};
+        Result old = {0, 0, 0.0}, fw = {0, 0, 0.0};
+        for (size_t run = 0; run < RUNS; ++run)
+        {
+            const uint32_t seed = 1000 * run + 38;
+            const uint64_t startTime = (uint64_t)(seed * 7919 % 120000) * 1000;
+            runLegacy(imp, seed, startTime, old);
+            runFirmware(imp, seed, startTime, fw);
+        }
+        DcfSignal signal(START, 0);
+        signal.setImpairments(imp);
+        ::printf("%4.0f dB %5.1f %%   %2zu/%zu %5.0f s, %zu wrong   %2zu/%zu %5.0f s, %zu wrong\n",
+                 snr, 100.0 * signal.getFlipRate(),
+                 old.decoded, RUNS, old.decoded? old.timeSum / old.decoded : 0.0, old.wrong,
+                 fw.decoded, RUNS, fw.decoded? fw.timeSum / fw.decoded : 0.0, fw.wrong);
+
+        HOST_CHECK(fw.wrong == 0);
+        HOST_CHECK(fw.decoded >= old.decoded);
+    }
+    return HOST_RESULT();
+}
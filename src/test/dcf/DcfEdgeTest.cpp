@@ -0,0 +1,313 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Test of the edge capture of the DCF77 receiver. The edges of the generated
+ * signal are timestamped in microseconds on the 32-bit timer, which wraps during
+ * the test, and glitches shorter than the glitch time are inserted: some of them
+ * so short that the ISR reads the level after both edges.
+ *
+ * First, DcfEdgeFilter gets the edges as the ISR queues them and is polled at
+ * random main loop times: each sample shall equal the level of the signal
+ * without glitches at its grid point. Then, the edges are passed through the
+ * capture register and the flag of TIM5 to DcfEdgeCapture and the receiver,
+ * which shall decode the time like the sampling timer does. A burst of edges
+ * overflows the event queue.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "HostHal.h"
+#include "StmPlusPlus/Devices/Dcf77.h"
+#include "DcfSignal.h"
+
+using namespace StmPlusPlus;
+using namespace StmPlusPlus::Devices;
+using namespace Host;
+
+/**
+ * @brief Time of the first minute mark: 18.10.2026 03:09 (a Sunday)
+ */
+static const time_t START = 1792292940;
+
+/**
+ * @brief Timer value at the start: the counter wraps after a minute.
+ */
+static const uint32_t TIMER_START = UINT32_MAX - 60000000U;
+
+static const uint64_t RUN_TIME = 15 * 60 * 1000000ULL;
+static const uint32_t ISR_LATENCY = 5;
+
+/**
+ * @brief An edge of the receiver output. The level is the one the ISR reads.
+ */
+struct InputEdge
+{
+    uint64_t time;
+    bool level;
+    bool glitch;
+};
+
+/**
+ * @brief Returns the edges of the signal without noise, scanned at 100 us.
+ */
+static std::vector<InputEdge> makeEdges (uint32_t seed, uint32_t jitter)
+{
+    DcfSignal signal(START, seed);
+    signal.setImpairments({INFINITY, jitter, 0.0, 0});
+    std::vector<InputEdge> edges;
+    bool level = false;
+    for (uint64_t t = 0; t < RUN_TIME; t += 100)
+    {
+        if (signal.getLevel(t) != level)
+        {
+            level = !level;
+            edges.push_back({t, level, false});
+        }
+    }
+    return edges;
+}
+
+/**
+ * @brief Inserts glitches at random times at least 25 ms away from other edges.
+ *
+ * @return the number of glitches that change the level read by the ISR.
+ */
+static size_t insertGlitches (std::vector<InputEdge> & edges, size_t number, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<uint64_t> time(0, RUN_TIME - 1000000);
+    size_t visible = 0;
+    for (size_t n = 0; n < number; ++n)
+    {
+        const uint64_t t = time(random);
+        auto next = std::lower_bound(edges.begin(), edges.end(), t,
+                [](const InputEdge & e, uint64_t v) { return e.time < v; });
+        if ((next != edges.end() && next->time < t + 45000) || (next != edges.begin() && (next - 1)->time + 25000 > t))
+        {
+            continue;
+        }
+        const bool level = (next != edges.begin())? (next - 1)->level : false;
+        // every tenth glitch is over before the ISR reads the level
+        const bool fast = n % 10 == 0;
+        const uint64_t length = fast? ISR_LATENCY - 1 : 100 + random() % 19000;
+        next = edges.insert(next, {t + length, level, true});
+        edges.insert(next, {t, fast? level : !level, true});
+        visible += !fast;
+    }
+    return visible;
+}
+
+/**
+ * @brief Returns the level of the signal without glitches at the given time.
+ */
+static bool getLevel (const std::vector<InputEdge> & edges, uint64_t t)
+{
+    bool level = false;
+    for (const InputEdge & e : edges)
+    {
+        if (e.time > t)
+        {
+            break;
+        }
+        if (!e.glitch)
+        {
+            level = e.level;
+        }
+    }
+    return level;
+}
+
+static void testFilter (uint32_t seed)
+{
+    std::vector<InputEdge> edges = makeEdges(seed, 5000);
+    const size_t glitches = insertGlitches(edges, 600, seed);
+
+    DcfEdgeFilter filter;
+    const uint64_t start = 3456;
+    filter.reset(TIMER_START + start, false);
+    uint64_t nextSample = start + DcfEdgeFilter::SAMPLE_PERIOD;
+
+    std::mt19937 random(seed);
+    size_t nextEdge = 0, samples = 0, differences = 0;
+    for (uint64_t now = start; now < RUN_TIME; )
+    {
+        // the main loop is sometimes stalled by an SD card access
+        now += (random() % 100 == 0)? 60000 : 1000 + random() % 20000;
+        for (; nextEdge < edges.size() && edges[nextEdge].time <= now; ++nextEdge)
+        {
+            filter.addEdge({(uint32_t)(TIMER_START + edges[nextEdge].time), edges[nextEdge].level});
+        }
+        bool sample;
+        while (filter.getSample((uint32_t)(TIMER_START + now), sample))
+        {
+            differences += sample != getLevel(edges, nextSample);
+            nextSample += DcfEdgeFilter::SAMPLE_PERIOD;
+            ++samples;
+        }
+    }
+    ::printf("filter: %zu edges, %zu samples, %zu differences, %u of %zu glitches removed\n",
+             edges.size(), samples, differences, filter.getGlitches(), glitches);
+    HOST_CHECK(samples >= (RUN_TIME - 200000) / DcfEdgeFilter::SAMPLE_PERIOD);
+    HOST_CHECK(differences == 0);
+    HOST_CHECK(filter.getGlitches() == glitches);
+}
+
+/**
+ * @brief The receiver with edge capture on TIM5 channel 4 of pin A3, like in the clock.
+ */
+class EdgeReceiver : public DcfReceiver::EventHandler
+{
+public:
+
+    size_t correct, wrong;
+    uint64_t firstCorrect;
+    int64_t maxErrorMs; // of the minute marks of the correct times
+
+    EdgeReceiver (uint32_t seed):
+        correct(0),
+        wrong(0),
+        firstCorrect(UINT64_MAX),
+        maxErrorMs(0),
+        signal(START, seed),
+        rtc(),
+        pinInput(IOPort::A, GPIO_PIN_3, GPIO_MODE_INPUT, GPIO_NOPULL),
+        pinPower(IOPort::A, GPIO_PIN_2, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP),
+        capture(pinInput, GPIO_AF2_TIM5, Timer::TIM_5, TIM5_IRQn, TIM_CHANNEL_4),
+        receiver(rtc, pinInput, pinPower, Timer::TIM_4, TIM4_IRQn),
+        now(0),
+        wakeupPhase(seed % 1000)
+    {
+        setInput(GPIOA, GPIO_PIN_3, true);
+        TIM5->CNT = TIMER_START;
+        receiver.setEdgeCapture(&capture);
+        receiver.start({1, 0}, this);
+    }
+
+    ~EdgeReceiver ()
+    {
+        receiver.stop();
+    }
+
+    inline uint32_t getOverflows () const
+    {
+        return capture.getOverflows();
+    }
+
+    void run (const std::vector<InputEdge> & edges, uint64_t burstTime)
+    {
+        size_t nextEdge = 0;
+        while (now < RUN_TIME)
+        {
+            now += 1000;
+            rtc.onMilliSecondInterrupt();
+            for (; nextEdge < edges.size() && edges[nextEdge].time <= now; ++nextEdge)
+            {
+                onEdge(edges[nextEdge]);
+            }
+            if (now == burstTime)
+            {
+                // more edges than the queue holds, e.g. from a switching power supply
+                for (size_t i = 0; i < 2 * DcfEdgeCapture::EVENT_QUEUE_SIZE; ++i)
+                {
+                    onEdge({now - 500 + i, edges[nextEdge - 1].level == (i % 2 == 1), true});
+                }
+            }
+            TIM5->CNT = (uint32_t)(TIMER_START + now);
+            if ((now / 1000) % 1000 == wakeupPhase)
+            {
+                RTC->ISR |= RTC_FLAG_WUTF;
+                rtc.onSecondInterrupt();
+            }
+            if ((now / 1000) % 5 == 0)
+            {
+                receiver.periodic();
+            }
+        }
+    }
+
+    virtual void onDcfBit (int16_t, size_t, bool, uint8_t)
+    {
+        // empty
+    }
+
+    virtual void onDcfTimeReceived (const ::tm & dayTime, const char *)
+    {
+        ::tm t = dayTime;
+        const int64_t error = (int64_t)::timegm(&t) * 1000 - signal.getTransmitterTime(receiver.getMarkTime() * 1000);
+        if (::llabs(error) <= 500)
+        {
+            firstCorrect = std::min(firstCorrect, now);
+            maxErrorMs = std::max(maxErrorMs, (int64_t)::llabs(error));
+            ++correct;
+        }
+        else
+        {
+            ++wrong;
+        }
+    }
+
+private:
+
+    DcfSignal signal;
+    RealTimeClock rtc;
+    IOPin pinInput, pinPower;
+    DcfEdgeCapture capture;
+    DcfReceiver receiver;
+    uint64_t now;
+    uint32_t wakeupPhase;
+
+    void onEdge (const InputEdge & e)
+    {
+        // the output is low while the carrier is reduced
+        setInput(GPIOA, GPIO_PIN_3, !e.level);
+        TIM5->CNT = (uint32_t)(TIMER_START + e.time + ISR_LATENCY);
+        TIM5->CCR4 = (uint32_t)(TIMER_START + e.time);
+        TIM5->SR |= TIM_FLAG_CC4;
+        capture.onCapture();
+    }
+};
+
+static void testReceiver (uint32_t seed, size_t glitchesNumber, uint64_t burstTime)
+{
+    std::vector<InputEdge> edges = makeEdges(seed, 5000);
+    const size_t glitches = insertGlitches(edges, glitchesNumber, seed);
+    EdgeReceiver r(seed);
+    r.run(edges, burstTime);
+    ::printf("receiver: %zu glitches, %zu correct, %zu wrong, locked after %.0f s, mark error %lld ms, %u edges dropped\n",
+             glitches, r.correct, r.wrong, (r.firstCorrect != UINT64_MAX)? r.firstCorrect / 1e6 : 0.0,
+             (long long)r.maxErrorMs, r.getOverflows());
+    HOST_CHECK(r.correct >= 10 && r.wrong == 0);
+    HOST_CHECK(r.maxErrorMs <= DcfSignal::SAMPLE_PERIOD / 1000);
+    HOST_CHECK(r.getOverflows() == ((burstTime != 0)? DcfEdgeCapture::EVENT_QUEUE_SIZE : 0));
+}
+
+int main ()
+{
+    ::setenv("TZ", "UTC", 1);
+    testFilter(45);
+    testFilter(4545);
+    testReceiver(45, 0, 0);
+    testReceiver(4545, 600, 0);
+    testReceiver(454545, 600, 400 * 1000000ULL);
+    return HOST_RESULT();
+}
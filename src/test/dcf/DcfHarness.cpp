@@ -0,0 +1,293 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Host harness of the DCF77 receiver: the firmware decoder runs in virtual
+ * time on the simulated input pin and RTC (DcfSimulation) and is fed either by
+ * the signal generator or by a capture file of DcfSampleRecorder.
+ *
+ * Without arguments, the scenarios below are run several times each with
+ * different seeds and start moments, and a capture is recorded during a run and
+ * replayed. Reported are the success rate (runs with a correct time), the
+ * false-decode rate (wrong times of all received times), the time to lock
+ * (to the first correct time) and the largest error of the minute mark time
+ * the receiver reports with a correct time. With a capture file as argument, the same report
+ * is printed for the replay of that file.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "HostHal.h"
+#include "DcfSignal.h"
+#include "DcfCapture.h"
+#include "DcfSimulation.h"
+
+using namespace StmPlusPlus::Devices;
+using namespace Host;
+
+static const size_t RUNS = 10;
+static const uint64_t RUN_TIME = 20 * 60 * 1000000ULL;
+static const char * CAPTURE_FILE_NAME = "DcfHarness.cap";
+
+/**
+ * @brief Time of the first minute mark: 18.10.2026 03:09 (a Sunday)
+ */
+static const time_t START = 1792292940;
+
+/**
+ * @brief Leap seconds are inserted at the end of an hour: 04:00
+ */
+static const time_t LEAP_SECOND = START + 51 * 60;
+
+struct Scenario
+{
+    const char * name;
+    DcfSignal::Impairments impairments;
+    bool leapSecond; // inserted at the end of the hour, the runs start shortly before
+    double minSuccessRate;
+};
+
+struct Report
+{
+    size_t runs, locked, correct, wrong;
+    double lockTimeSum, lockTimeMax; // seconds
+    int64_t maxErrorMs;
+
+    void add (const DcfSimulation::Statistics & s)
+    {
+        ++runs;
+        correct += s.correct;
+        wrong += s.wrong;
+        maxErrorMs = std::max(maxErrorMs, s.maxErrorMs);
+        if (s.firstCorrect != UINT64_MAX)
+        {
+            ++locked;
+            lockTimeSum += s.firstCorrect / 1e6;
+            lockTimeMax = std::max(lockTimeMax, s.firstCorrect / 1e6);
+        }
+    }
+
+    inline double getSuccessRate () const
+    {
+        return runs? (double)locked / runs : 0.0;
+    }
+
+    inline double getFalseDecodeRate () const
+    {
+        return (correct + wrong)? (double)wrong / (correct + wrong) : 0.0;
+    }
+
+    void print (const char * name) const
+    {
+        ::printf("%-26s %3.0f %%   %5.1f %% (%zu/%zu)   %5.0f s   %5.0f s   %5lld ms\n", name,
+                 100.0 * getSuccessRate(), 100.0 * getFalseDecodeRate(), wrong, correct + wrong,
+                 locked? lockTimeSum / locked : 0.0, lockTimeMax, (long long)maxErrorMs);
+    }
+};
+
+static void printHeader ()
+{
+    ::printf("scenario                   success   false decodes     mean lock   max lock   mark error\n");
+}
+
+/**
+ * @brief Simulation that records the samples of the receiver like the firmware
+ *        and writes the blocks into a capture file.
+ */
+class Recording : public DcfSimulation
+{
+public:
+
+    Recording (DcfSource & _source, uint64_t startTime, uint32_t seed, FILE * _file):
+        DcfSimulation(_source, startTime, seed),
+        recorder(getRtc()),
+        file(_file),
+        blocks(0),
+        recordStart(UINT64_MAX)
+    {
+        // the blocks carry the RTC time: the recording starts when the clock is set
+        setClock(0);
+    }
+
+    /**
+     * @brief Returns the time of the first recorded sample, rounded down to the sample period.
+     */
+    inline uint64_t getRecordStart () const
+    {
+        return recordStart;
+    }
+
+    /**
+     * @brief Closes the last block and writes the remaining blocks.
+     */
+    size_t finish ()
+    {
+        recorder.finish();
+        write();
+        getReceiver().setRecorder(NULL);
+        return blocks;
+    }
+
+protected:
+
+    virtual void onInputSample (uint64_t time, bool)
+    {
+        if (recordStart == UINT64_MAX && isClockSet())
+        {
+            recordStart = time - time % DcfSource::SAMPLE_PERIOD;
+            getReceiver().setRecorder(&recorder);
+            recorder.start();
+        }
+        // the previous sample may have completed a block
+        write();
+    }
+
+private:
+
+    DcfSampleRecorder recorder;
+    FILE * file;
+    size_t blocks;
+    uint64_t recordStart;
+
+    void write ()
+    {
+        size_t n;
+        const uint8_t * data = recorder.getReadyData(n);
+        while (n > 0)
+        {
+            blocks += ::fwrite(data, DcfSampleRecorder::BLOCK_SIZE, n, file);
+            recorder.release(n);
+            data = recorder.getReadyData(n);
+        }
+    }
+};
+
+/**
+ * @brief Replays the capture from a cold start or with the clock set from the recording.
+ */
+static Report replay (DcfCapture & capture, uint32_t seed, bool clockSet)
+{
+    Report r = {0, 0, 0, 0, 0.0, 0.0, 0};
+    DcfSimulation sim(capture, 0, seed);
+    if (clockSet)
+    {
+        sim.setClock(0);
+    }
+    sim.run(capture.getDuration());
+    r.add(sim.getStatistics());
+    return r;
+}
+
+static void runScenarios ()
+{
+    static const Scenario scenarios[] = {
+        {"clean",                    {INFINITY, 0, 0.0, 0},     false, 1.0},
+        {"noise 4 dB",               {4.0, 0, 0.0, 0},          false, 1.0},
+        {"noise 0 dB",               {0.0, 0, 0.0, 0},          false, 0.9},
+        {"jitter 20 ms",             {INFINITY, 20000, 0.0, 0}, false, 1.0},
+        {"short dropouts",           {INFINITY, 0, 0.05, 300},  false, 1.0},
+        {"long dropouts",            {INFINITY, 0, 0.01, 5000}, false, 0.9},
+        {"leap second",              {6.0, 0, 0.0, 0},          true,  1.0},
+        {"combined with leap second",{4.0, 10000, 0.02, 500},   true,  0.9}
+    };
+    printHeader();
+    for (const Scenario & sc : scenarios)
+    {
+        Report r = {0, 0, 0, 0, 0.0, 0.0, 0};
+        for (size_t run = 0; run < RUNS; ++run)
+        {
+            const uint32_t seed = 1000 * run + 42;
+            DcfSignal signal(START, seed);
+            signal.setImpairments(sc.impairments);
+            uint64_t startTime = (uint64_t)(seed * 7919 % 120000) * 1000;
+            if (sc.leapSecond)
+            {
+                signal.setLeapSecond(LEAP_SECOND);
+                startTime += (uint64_t)(LEAP_SECOND - START - 10 * 60) * 1000000;
+            }
+            DcfSimulation sim(signal, startTime, seed);
+            sim.run(startTime + RUN_TIME);
+            r.add(sim.getStatistics());
+        }
+        r.print(sc.name);
+
+        HOST_CHECK(r.getSuccessRate() >= sc.minSuccessRate);
+        HOST_CHECK(r.wrong == 0);
+        HOST_CHECK(r.maxErrorMs <= (int64_t)(sc.impairments.jitter + DcfSignal::SAMPLE_PERIOD) / 1000);
+    }
+
+    // record a noisy signal and replay the capture
+    FILE * f = ::fopen(CAPTURE_FILE_NAME, "wb");
+    HOST_CHECK(f != NULL);
+    if (f == NULL)
+    {
+        return;
+    }
+    DcfSignal signal(START, 4242);
+    signal.setImpairments({4.0, 5000, 0.01, 300});
+    Recording recording(signal, 0, 4242, f);
+    recording.run(RUN_TIME);
+    const size_t blocks = recording.finish();
+    ::fclose(f);
+    Report recorded = {0, 0, 0, 0, 0.0, 0.0, 0};
+    recorded.add(recording.getStatistics());
+    recorded.print("recorded");
+
+    DcfCapture capture;
+    HOST_CHECK(capture.load(CAPTURE_FILE_NAME));
+    HOST_CHECK(capture.getBlocks() == blocks && capture.getDropped() == 0);
+    const uint64_t start = recording.getRecordStart();
+    HOST_CHECK(::llabs((int64_t)(start + capture.getDuration()) - (int64_t)RUN_TIME) <= DcfSignal::SAMPLE_PERIOD);
+    // the reference of the replay is the clock of the recording
+    HOST_CHECK(::llabs(capture.getTransmitterTime(RUN_TIME / 2) - signal.getTransmitterTime(start + RUN_TIME / 2)) <= 10);
+    const Report cold = replay(capture, 4242, false);
+    cold.print("replayed, cold start");
+    HOST_CHECK(cold.locked == 1 && cold.wrong == 0);
+    // the same samples at the same phase give the same times
+    const Report warm = replay(capture, 4242, true);
+    warm.print("replayed, clock set");
+    HOST_CHECK(warm.correct == recorded.correct && warm.wrong == 0);
+    HOST_CHECK(::fabs(warm.lockTimeMax + start / 1e6 - recorded.lockTimeMax) < 0.02);
+    ::remove(CAPTURE_FILE_NAME);
+}
+
+int main (int argc, char ** argv)
+{
+    ::setenv("TZ", "UTC", 1);
+    if (argc > 1)
+    {
+        DcfCapture capture;
+        if (!capture.load(argv[1]))
+        {
+            ::printf("%s is not a DCF capture\n", argv[1]);
+            return 1;
+        }
+        ::printf("%s: %zu blocks, %.0f s, %zu samples dropped\n", argv[1], capture.getBlocks(),
+                 capture.getDuration() / 1e6, capture.getDropped());
+        printHeader();
+        replay(capture, 0, false).print("replayed, cold start");
+        replay(capture, 0, true).print("replayed, clock set");
+        return 0;
+    }
+    runScenarios();
+    return HOST_RESULT();
+}
@@ -0,0 +1,276 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Test of the DCF reception policy against simulated propagation patterns.
+ * The RTC drifts by 15 ppm with a random walk and a daily temperature cycle.
+ * While the receiver is on, a time is decoded with a probability per minute
+ * that depends on the hour of the day. The adaptive policy (DcfScheduler with
+ * the correction of the DriftEstimator) is compared with the policy it
+ * replaced: a window at 03:00 until a time is received, without correction.
+ * Reported are the receiver on-time per day, the share of the time with an
+ * RTC error above DcfScheduler::MAX_ERROR and the maximum error.
+ *
+ * Finally, the learned statistics shall survive a restart in the snapshot of
+ * the configuration in the backup SRAM.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "HostHal.h"
+#include "Config.h"
+
+using namespace StmPlusPlus;
+using namespace StmPlusPlus::Devices;
+
+static const size_t RUNS = 10;
+static const long DAYS = 60;
+static const long SETTLE_DAYS = 3;
+static const time_t START = 1792281600; // 18.10.2026 00:00
+
+enum Pattern
+{
+    GOOD_NIGHTS = 0,
+    UNIFORM,
+    NOISY_NIGHTS,
+    DEAD_AT_THREE,
+    EVENINGS_ONLY,
+    PATTERNS_NUMBER
+};
+
+static const char * patternNames[PATTERNS_NUMBER] = {
+    "good nights", "uniform", "noisy nights", "dead 02-05 h", "evenings only"
+};
+
+/**
+ * @brief Probability per minute that a time is decoded at the given hour.
+ */
+static double getDecodeRate (Pattern p, int hour)
+{
+    const bool night = hour < 6 || hour >= 22;
+    switch (p)
+    {
+    case GOOD_NIGHTS:
+        return night? 0.25 : 0.05;
+    case UNIFORM:
+        return 0.12;
+    case NOISY_NIGHTS:
+        return night? 0.01 : 0.15;
+    case DEAD_AT_THREE:
+        return (hour >= 2 && hour < 5)? 0.0 : 0.15;
+    case EVENINGS_ONLY:
+        return (hour >= 18)? 0.2 : 0.0;
+    default:
+        return 0.0;
+    }
+}
+
+struct Result
+{
+    double onTime;   // minutes per day
+    double overTime; // share of the time with an error above MAX_ERROR
+    double maxError; // ms
+};
+
+/**
+ * @brief Simulates the given days minute by minute.
+ */
+static Result run (Pattern p, bool adaptive, uint32_t seed, DcfScheduler::Statistics * learned = NULL)
+{
+    std::mt19937 random(seed);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    DriftEstimator estimator;
+    DcfScheduler scheduler(estimator);
+
+    double error = 3000.0, walk = 0.0, onTime = 0.0, maxError = 0.0;
+    int32_t correction = 0;
+    bool receiving = false;
+    time_t windowStart = 0;
+    long over = 0, minutes = 0;
+    for (long m = 0; m < DAYS * 1440; ++m)
+    {
+        const time_t now = START + m * 60;
+        const int hour = (m / 60) % 24;
+        if (m % 60 == 0)
+        {
+            walk += 0.02 * normal(random);
+        }
+        const double ppm = 15.0 + walk + std::sin(2.0 * M_PI * m / 1440.0);
+        error += 60.0 * (ppm * 1.0e-3 + correction * 1.0e-6);
+        if (m >= SETTLE_DAYS * 1440)
+        {
+            ++minutes;
+            over += std::fabs(error) > DcfScheduler::MAX_ERROR;
+            maxError = std::max(maxError, std::fabs(error));
+        }
+
+        if (receiving)
+        {
+            onTime += 60.0;
+            if (uniform(random) < getDecodeRate(p, hour))
+            {
+                receiving = false;
+                if (adaptive)
+                {
+                    estimator.addFix(now, (int32_t)::lround(error + 5.0 * normal(random)), correction);
+                    correction = estimator.getCorrection();
+                    scheduler.onWindowFinished(now - windowStart, true);
+                }
+                error = 0.0;
+            }
+            else if (adaptive && scheduler.isBudgetExhausted(now))
+            {
+                receiving = false;
+                scheduler.onWindowFinished(now - windowStart, false);
+            }
+        }
+        else if (m == 0 || (adaptive? scheduler.isWindowDue(now) : (hour == 3 && m % 60 == 0)))
+        {
+            receiving = true;
+            windowStart = now;
+            if (adaptive)
+            {
+                scheduler.onWindowStarted(now);
+            }
+        }
+    }
+    if (learned != NULL)
+    {
+        *learned = scheduler.getStatistics();
+    }
+    return {onTime / 60.0 / DAYS, (double)over / minutes, maxError};
+}
+
+static void testPolicies ()
+{
+    ::printf("pattern         policy     on-time       error > %lld ms   max error\n",
+             (long long)DcfScheduler::MAX_ERROR);
+    for (int p = 0; p < PATTERNS_NUMBER; ++p)
+    {
+        Result r[2];
+        for (int adaptive = 0; adaptive < 2; ++adaptive)
+        {
+            r[adaptive] = {0.0, 0.0, 0.0};
+            for (size_t run = 0; run < RUNS; ++run)
+            {
+                const Result x = ::run((Pattern)p, adaptive, 100 + run);
+                r[adaptive].onTime += x.onTime / RUNS;
+                r[adaptive].overTime += x.overTime / RUNS;
+                r[adaptive].maxError = std::max(r[adaptive].maxError, x.maxError);
+            }
+            ::printf("%-15s %-10s %5.1f min/day   %5.1f %%           %6.0f ms\n", patternNames[p],
+                     adaptive? "adaptive" : "03:00", r[adaptive].onTime, 100.0 * r[adaptive].overTime,
+                     r[adaptive].maxError);
+        }
+        HOST_CHECK(r[1].maxError <= DcfScheduler::MAX_ERROR);
+        HOST_CHECK(r[1].onTime < r[0].onTime);
+    }
+
+    // the statistics follow the propagation
+    DcfScheduler::Statistics s;
+    run(EVENINGS_ONLY, true, 100, &s);
+    size_t best = 0;
+    for (size_t h = 0; h < DcfScheduler::HOURS_NUMBER; ++h)
+    {
+        best = (s.hours[h].successRate > s.hours[best].successRate)? h : best;
+    }
+    HOST_CHECK(best >= 18);
+}
+
+struct Bench
+{
+    IOPin pinSdPower, pinSdDetect;
+    IOPort portSd1, portSd2;
+    SdCard sdCard;
+    BackupSram backupSram;
+    FlashStore flashStore;
+    Config config;
+
+    Bench ():
+        pinSdPower(IOPort::A, GPIO_PIN_10, GPIO_MODE_OUTPUT_PP, GPIO_PULLDOWN, GPIO_SPEED_HIGH, true, false),
+        pinSdDetect(IOPort::A, GPIO_PIN_12, GPIO_MODE_INPUT, GPIO_PULLUP),
+        portSd1(IOPort::C, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP, GPIO_SPEED_FREQ_VERY_HIGH, GPIO_PIN_8, false),
+        portSd2(IOPort::D, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP, GPIO_SPEED_FREQ_VERY_HIGH, GPIO_PIN_2, false),
+        sdCard(pinSdDetect, pinSdPower, portSd1, portSd2),
+        flashStore({FLASH_SECTOR_10, 0x080C0000, 0x20000}, {FLASH_SECTOR_11, 0x080E0000, 0x20000}),
+        config(sdCard, backupSram, flashStore, "conf.txt")
+    {
+        flashStore.start();
+    }
+};
+
+static bool isEqual (const DcfScheduler::Statistics & a, const DcfScheduler::Statistics & b)
+{
+    for (size_t h = 0; h < DcfScheduler::HOURS_NUMBER; ++h)
+    {
+        if (a.hours[h].successRate != b.hours[h].successRate || a.hours[h].duration != b.hours[h].duration)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testSnapshot ()
+{
+    Host::reset();
+    DriftEstimator estimator;
+    DcfScheduler scheduler(estimator);
+    DcfScheduler::Statistics learned;
+    run(DEAD_AT_THREE, true, 100, &learned);
+
+    // without a snapshot, the defaults of the scheduler are used
+    Bench b;
+    HOST_CHECK(!b.config.restoreSnapshot());
+    HOST_CHECK(isEqual(b.config.getDcfStatistics(), scheduler.getStatistics()));
+
+    b.config.setDcfStatistics(learned);
+    {
+        Bench restarted;
+        HOST_CHECK(restarted.config.restoreSnapshot());
+        HOST_CHECK(isEqual(restarted.config.getDcfStatistics(), learned));
+    }
+
+    // the statistics do not commit a pending change of the configuration
+    const int8_t hour = b.config.getAlarm(0).hour;
+    b.config.setAlarmHour(0, (hour + 1) % 24);
+    learned.hours[3].successRate = 7;
+    b.config.setDcfStatistics(learned);
+    HOST_CHECK(b.config.hasPendingChanges());
+    {
+        Bench restarted;
+        HOST_CHECK(restarted.config.restoreSnapshot());
+        HOST_CHECK(isEqual(restarted.config.getDcfStatistics(), learned));
+        HOST_CHECK(restarted.config.getAlarm(0).hour == (hour + 1) % 24);
+        HOST_CHECK(restarted.config.hasPendingChanges());
+        scheduler.setStatistics(restarted.config.getDcfStatistics());
+        HOST_CHECK(isEqual(scheduler.getStatistics(), learned));
+    }
+    ::printf("statistics restored from the backup SRAM\n");
+}
+
+int main ()
+{
+    testPolicies();
+    testSnapshot();
+    return HOST_RESULT();
+}
@@ -0,0 +1,226 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <cmath>
+
+#include "DcfSignal.h"
+
+namespace Host {
+
+DcfSignal::DcfSignal (time_t _start, uint32_t seed):
+    start(_start),
+    random(seed),
+    impairments{INFINITY, 0, 0.0, 0},
+    noiseSigma(0.0),
+    leapSecond(0),
+    summerTime(false),
+    secondStart(0),
+    minuteMark(_start),
+    second(0),
+    secondsInMinute(60),
+    pulseStart(0),
+    pulseEnd(0),
+    dropoutEnd(0),
+    dropoutLevel(false)
+{
+    startMinute();
+    startSecond();
+}
+
+
+void DcfSignal::setImpairments (const Impairments & i)
+{
+    impairments = i;
+    noiseSigma = std::isinf(i.snrDb)? 0.0 : std::pow(10.0, -i.snrDb / 20.0);
+}
+
+
+void DcfSignal::setLeapSecond (time_t minuteMark)
+{
+    leapSecond = minuteMark;
+    // the current minute may already be the one with the leap second
+    startMinute();
+}
+
+
+bool DcfSignal::getLevel (uint64_t us)
+{
+    while (us >= secondStart + 1000000)
+    {
+        secondStart += 1000000;
+        if (++second == secondsInMinute)
+        {
+            minuteMark += 60;
+            second = 0;
+            startMinute();
+        }
+        startSecond();
+    }
+    if (us < dropoutEnd)
+    {
+        return dropoutLevel;
+    }
+    return us >= pulseStart && us < pulseEnd;
+}
+
+
+bool DcfSignal::getSample (uint64_t us)
+{
+    const double envelope = getLevel(us)? 1.0 : -1.0;
+    if (noiseSigma == 0.0)
+    {
+        return envelope > 0.0;
+    }
+    std::normal_distribution<double> noise(0.0, noiseSigma);
+    return envelope + noise(random) > 0.0;
+}
+
+
+int64_t DcfSignal::getTransmitterTime (uint64_t us) const
+{
+    int64_t ms = (int64_t)start * 1000 + (int64_t)(us / 1000);
+    // the inserted second repeats the last second of the minute
+    if (leapSecond != 0 && ms >= (int64_t)leapSecond * 1000)
+    {
+        ms -= 1000;
+    }
+    return ms;
+}
+
+
+double DcfSignal::getFlipRate () const
+{
+    return (noiseSigma == 0.0)? 0.0 : 0.5 * std::erfc(1.0 / (noiseSigma * std::sqrt(2.0)));
+}
+
+
+int DcfSignal::getBit (int64_t transmitterTime)
+{
+    const time_t sec = transmitterTime / 1000;
+    const size_t second = sec % 60;
+    if (second >= BITS_PER_MIN)
+    {
+        return -1;
+    }
+    // the frame contains the time of the next minute mark
+    const time_t next = sec - second + 60;
+    ::tm t;
+    ::gmtime_r(&next, &t);
+    uint8_t bits[BITS_PER_MIN];
+    encodeFrame(t, false, false, bits);
+    return bits[second];
+}
+
+
+void DcfSignal::encodeFrame (const ::tm & t, bool summerTime, bool leapSecondAnnounced, uint8_t * bits)
+{
+    static const int weights[8] = {1, 2, 4, 8, 10, 20, 40, 80};
+    struct Field
+    {
+        size_t first, length;
+        int value;
+    };
+    const Field fields[] = {
+        {21, 7, t.tm_min},
+        {29, 6, t.tm_hour},
+        {36, 6, t.tm_mday},
+        {42, 3, (t.tm_wday == 0)? 7 : t.tm_wday},
+        {45, 5, t.tm_mon + 1},
+        {50, 8, t.tm_year % 100}
+    };
+    for (size_t i = 0; i < BITS_PER_MIN; ++i)
+    {
+        bits[i] = 0;
+    }
+    bits[17] = summerTime;
+    bits[18] = !summerTime;
+    bits[19] = leapSecondAnnounced;
+    bits[20] = 1;
+    for (const Field & f : fields)
+    {
+        int v = f.value;
+        for (int i = f.length - 1; i >= 0; --i)
+        {
+            if (v >= weights[i])
+            {
+                bits[f.first + i] = 1;
+                v -= weights[i];
+            }
+        }
+    }
+    // even parity of the minute, the hour and the date
+    const size_t parity[3][2] = {{21, 28}, {29, 35}, {36, 58}};
+    for (const auto & p : parity)
+    {
+        uint8_t sum = 0;
+        for (size_t i = p[0]; i < p[1]; ++i)
+        {
+            sum ^= bits[i];
+        }
+        bits[p[1]] = sum;
+    }
+}
+
+
+void DcfSignal::startMinute ()
+{
+    const time_t next = minuteMark + 60;
+    ::tm t;
+    ::gmtime_r(&next, &t);
+    const bool announced = leapSecond != 0 && next <= leapSecond && next > leapSecond - 3600;
+    encodeFrame(t, summerTime, announced, bits);
+    secondsInMinute = (leapSecond != 0 && next == leapSecond)? 61 : 60;
+}
+
+
+void DcfSignal::startSecond ()
+{
+    uint32_t length = 0;
+    if (second < BITS_PER_MIN)
+    {
+        length = bits[second]? 200000 : 100000;
+    }
+    else if (second == BITS_PER_MIN && secondsInMinute == 61)
+    {
+        // the inserted second follows a zero bit
+        length = 100000;
+    }
+    pulseStart = secondStart + getJitter();
+    pulseEnd = (length == 0)? 0 : secondStart + length + getJitter();
+
+    std::bernoulli_distribution dropout(impairments.dropoutRate);
+    if (impairments.dropoutRate > 0.0 && secondStart >= dropoutEnd && dropout(random))
+    {
+        dropoutEnd = secondStart + (uint64_t)impairments.dropoutLength * 1000;
+        dropoutLevel = random() & 1;
+    }
+}
+
+
+int32_t DcfSignal::getJitter ()
+{
+    if (impairments.jitter == 0)
+    {
+        return 0;
+    }
+    std::uniform_int_distribution<int32_t> jitter(-(int32_t)impairments.jitter, impairments.jitter);
+    return jitter(random);
+}
+
+} // end namespace Host
@@ -0,0 +1,130 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef DCFSIGNAL_H_
+#define DCFSIGNAL_H_
+
+#include <cstdint>
+#include <ctime>
+#include <random>
+
+#include "DcfSource.h"
+
+namespace Host {
+
+/**
+ * @brief Generator of the DCF77 receiver output.
+ *
+ * The transmitter starts at a minute mark of the given local time and sends a
+ * frame per minute: a carrier reduction of 100 ms (bit 0) or 200 ms (bit 1) at
+ * the start of each second except the last one, whose missing mark announces
+ * the next minute. A frame contains the time of the next minute mark.
+ *
+ * The output is impaired like that of a real receiver:
+ *   - white gaussian noise on the demodulated envelope, given as signal-to-noise
+ *     ratio per 10 ms sample, i.e. random flips of the comparator output
+ *   - jitter of each edge
+ *   - dropouts, i.e. the output is stuck for a while
+ * A leap second can be inserted: the frames of the hour before announce it,
+ * and the minute before the given minute mark gets a 61st second.
+ *
+ * Times are given in microseconds since the start and shall not decrease.
+ */
+class DcfSignal : public DcfSource
+{
+public:
+
+    static const size_t BITS_PER_MIN = 59;
+
+    struct Impairments
+    {
+        double snrDb;           // of the envelope per sample, INFINITY for a clean signal
+        uint32_t jitter;        // maximum shift of an edge in microseconds
+        double dropoutRate;     // probability per second that a dropout starts
+        uint32_t dropoutLength; // in milliseconds
+    };
+
+    DcfSignal (time_t _start, uint32_t seed);
+
+    void setImpairments (const Impairments & i);
+
+    /**
+     * @brief Inserts a leap second before the given minute mark.
+     */
+    void setLeapSecond (time_t minuteMark);
+
+    inline void setSummerTime (bool s)
+    {
+        summerTime = s;
+    }
+
+    /**
+     * @brief Returns the output without noise: true if the carrier is reduced.
+     */
+    bool getLevel (uint64_t us);
+
+    /**
+     * @brief Returns the comparator output at the given time, i.e. the level with noise.
+     */
+    virtual bool getSample (uint64_t us);
+
+    virtual int64_t getTransmitterTime (uint64_t us) const;
+
+    /**
+     * @brief Returns the probability that noise flips a sample.
+     */
+    double getFlipRate () const;
+
+    /**
+     * @brief Returns the bit sent in the given second of the transmitter time
+     *        (without leap seconds) or -1 for the second without mark.
+     */
+    static int getBit (int64_t transmitterTime);
+
+    /**
+     * @brief Encodes the frame of the given minute: one value (0 or 1) per bit.
+     */
+    static void encodeFrame (const ::tm & t, bool summerTime, bool leapSecondAnnounced, uint8_t * bits);
+
+private:
+
+    const time_t start;
+    std::mt19937 random;
+    Impairments impairments;
+    double noiseSigma;
+    time_t leapSecond;
+    bool summerTime;
+
+    // the second that is generated
+    uint64_t secondStart;
+    time_t minuteMark; // local time of the minute mark that started the current minute
+    size_t second, secondsInMinute;
+    uint8_t bits[BITS_PER_MIN];
+    uint64_t pulseStart, pulseEnd;
+    uint64_t dropoutEnd;
+    bool dropoutLevel;
+
+    void startMinute ();
+    void startSecond ();
+    int32_t getJitter ();
+};
+
+} // end namespace Host
+
+#endif
@@ -0,0 +1,128 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "HostHal.h"
+#include "DcfSimulation.h"
+
+using namespace StmPlusPlus;
+using namespace StmPlusPlus::Devices;
+
+namespace Host {
+
+DcfSimulation::DcfSimulation (DcfSource & _source, uint64_t startTime, uint32_t seed):
+    source(_source),
+    rtc(),
+    pinInput(IOPort::A, GPIO_PIN_3, GPIO_MODE_INPUT, GPIO_NOPULL),
+    pinPower(IOPort::A, GPIO_PIN_2, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP),
+    receiver(rtc, pinInput, pinPower, Timer::TIM_4, TIM4_IRQn),
+    now(startTime / 1000 * 1000),
+    start(now),
+    samplePhase(seed % 10),
+    wakeupPhase((seed / 10) % 1000),
+    clockPending(false),
+    clockError(0),
+    statistics{0, 0, UINT64_MAX, 0}
+{
+    receiver.start({1, 0}, this);
+}
+
+
+DcfSimulation::~DcfSimulation ()
+{
+    receiver.stop();
+}
+
+
+void DcfSimulation::setClock (int32_t errorMs)
+{
+    clockPending = true;
+    clockError = errorMs;
+}
+
+
+void DcfSimulation::run (uint64_t until, bool untilCorrect)
+{
+    while (now < until && !(untilCorrect && statistics.correct > 0))
+    {
+        now += 1000;
+        const uint32_t ms = now / 1000;
+        rtc.onMilliSecondInterrupt();
+        if (ms % (DcfSource::SAMPLE_PERIOD / 1000) == samplePhase)
+        {
+            // the receiver output is low while the carrier is reduced
+            const bool sample = source.getSample(now);
+            setInput(GPIOA, GPIO_PIN_3, !sample);
+            onInputSample(now, sample);
+            receiver.onSample();
+        }
+        if (ms % 1000 == wakeupPhase)
+        {
+            RTC->ISR |= RTC_FLAG_WUTF;
+            rtc.onSecondInterrupt();
+            if (clockPending)
+            {
+                const int64_t t = source.getTransmitterTime(now) + clockError;
+                rtc.setTimeSec(t / 1000, t % 1000);
+                clockPending = false;
+            }
+        }
+        if (ms % LOOP_PERIOD == 0)
+        {
+            receiver.periodic();
+        }
+    }
+}
+
+
+void DcfSimulation::onDcfBit (int16_t, size_t, bool, uint8_t)
+{
+    // empty
+}
+
+
+void DcfSimulation::onInputSample (uint64_t, bool)
+{
+    // empty
+}
+
+
+void DcfSimulation::onDcfTimeReceived (const ::tm & dayTime, const char *)
+{
+    // the monotonic time of the RTC counts the milliseconds since the start
+    ::tm t = dayTime;
+    const int64_t error = (int64_t)::timegm(&t) * 1000 - source.getTransmitterTime(start + receiver.getMarkTime() * 1000);
+    if (::llabs(error) <= MAX_ERROR_MS)
+    {
+        ++statistics.correct;
+        if (statistics.firstCorrect == UINT64_MAX)
+        {
+            statistics.firstCorrect = now - start;
+        }
+        statistics.maxErrorMs = std::max(statistics.maxErrorMs, (int64_t)::llabs(error));
+    }
+    else
+    {
+        ++statistics.wrong;
+    }
+}
+
+} // end namespace Host
@@ -0,0 +1,126 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef DCFSIMULATION_H_
+#define DCFSIMULATION_H_
+
+#include <cstdint>
+
+#include "StmPlusPlus/Devices/Dcf77.h"
+#include "DcfSource.h"
+
+namespace Host {
+
+/**
+ * @brief Virtual-time model of the DCF77 receiver in the clock.
+ *
+ * Each virtual millisecond calls the SysTick handler of the RTC. The sampling
+ * timer reads the generated or recorded signal from the input pin every 10 ms, the RTC
+ * wakeup timer fires once a second with its own phase and the main loop calls
+ * DcfReceiver::periodic() every few milliseconds. The received times are
+ * compared with the transmitter time.
+ */
+class DcfSimulation : public StmPlusPlus::Devices::DcfReceiver::EventHandler
+{
+public:
+
+    static const uint32_t LOOP_PERIOD = 5;
+
+    /**
+     * @brief A received time is correct if it matches the transmitter time within this error.
+     */
+    static const int64_t MAX_ERROR_MS = 500;
+
+    struct Statistics
+    {
+        size_t correct, wrong;
+        uint64_t firstCorrect; // microseconds from the start of the receiver, UINT64_MAX if none
+        int64_t maxErrorMs;    // of the minute marks of the correct times
+    };
+
+    /**
+     * @brief The receiver is started at the given time of the source.
+     */
+    DcfSimulation (DcfSource & _source, uint64_t startTime, uint32_t seed);
+    virtual ~DcfSimulation ();
+
+    /**
+     * @brief Sets the RTC to the transmitter time plus the given error, as after a
+     *        previous reception. The RTC counts the milliseconds since its wakeup
+     *        interrupt, i.e. it is set right after the next one.
+     */
+    void setClock (int32_t errorMs);
+
+    inline bool isClockSet () const
+    {
+        return !clockPending;
+    }
+
+    /**
+     * @brief Runs until the given time of the source or, if requested, until the first correct time.
+     */
+    void run (uint64_t until, bool untilCorrect = false);
+
+    inline uint64_t getTime () const
+    {
+        return now;
+    }
+
+    inline const Statistics & getStatistics () const
+    {
+        return statistics;
+    }
+
+    inline StmPlusPlus::Devices::DcfReceiver & getReceiver ()
+    {
+        return receiver;
+    }
+
+    inline StmPlusPlus::RealTimeClock & getRtc ()
+    {
+        return rtc;
+    }
+
+    virtual void onDcfBit (int16_t secondNr, size_t errorNr, bool bit, uint8_t confidence);
+    virtual void onDcfTimeReceived (const ::tm & dayTime, const char * dayTimeStr);
+
+protected:
+
+    /**
+     * @brief Called with each sample of the input pin, true if the carrier is reduced.
+     */
+    virtual void onInputSample (uint64_t time, bool sample);
+
+    DcfSource & source;
+
+private:
+
+    StmPlusPlus::RealTimeClock rtc;
+    StmPlusPlus::IOPin pinInput, pinPower;
+    StmPlusPlus::Devices::DcfReceiver receiver;
+    uint64_t now, start;
+    uint32_t samplePhase, wakeupPhase;
+    bool clockPending;
+    int32_t clockError;
+    Statistics statistics;
+};
+
+} // end namespace Host
+
+#endif
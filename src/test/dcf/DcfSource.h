@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef DCFSOURCE_H_
+#define DCFSOURCE_H_
+
+#include <cstdint>
+
+namespace Host {
+
+/**
+ * @brief Source of the DCF77 receiver output for the virtual-time simulation:
+ *        a generated signal or a recorded capture.
+ *
+ * Times are given in microseconds since the start and shall not decrease.
+ */
+class DcfSource
+{
+public:
+
+    /**
+     * @brief Period of the sampling timer in microseconds.
+     */
+    static const uint32_t SAMPLE_PERIOD = 10000;
+
+    virtual ~DcfSource () { /* empty */ }
+
+    /**
+     * @brief Returns the comparator output at the given time: true if the carrier is reduced.
+     */
+    virtual bool getSample (uint64_t us) = 0;
+
+    /**
+     * @brief Returns the local time of the transmitter in milliseconds, i.e. the
+     *        time a perfectly set clock shows at the given moment.
+     */
+    virtual int64_t getTransmitterTime (uint64_t us) const = 0;
+};
+
+} // end namespace Host
+
+#endif
@@ -0,0 +1,159 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+
+#include "LegacyDcfDecoder.h"
+
+namespace Host {
+
+LegacyDcfDecoder::LegacyDcfDecoder ():
+    filter(),
+    secondNr(-1),
+    sampleNr(SIZE_MAX),
+    errorNr(0),
+    now(0),
+    prevSample(filter.getDefault()),
+    highStart(0),
+    highEnd(0),
+    ptrRec(&dataBits1[0]),
+    ptrProc(&dataBits2[0]),
+    dayTime()
+{
+    std::fill(dataBits1, dataBits1 + BITS_PER_MIN, 0);
+    std::fill(dataBits2, dataBits2 + BITS_PER_MIN, 0);
+}
+
+
+bool LegacyDcfDecoder::processSample (bool rawSample)
+{
+    const size_t ms = 1000 / SAMPLE_PER_SEC;
+    bool dataBitsAvailable = false;
+    bool newSample = filter.processSample(rawSample);
+    if (!prevSample && newSample)
+    {
+        size_t highDuration = 0, lowDuration = 0;
+        if (highEnd > highStart)
+        {
+            highDuration = (highEnd - highStart) * ms;
+        }
+        if (now > highEnd)
+        {
+            lowDuration = (now - highEnd) * ms;
+        }
+        bool bit = highDuration >= 150;
+
+        bool sampleValid = false;
+        if (sampleNr >= SAMPLE_PER_SEC - SAMPLE_TOLERANCE)
+        {
+            if (lowDuration > 1500)
+            {
+                ++secondNr;
+                if (secondNr == BITS_PER_MIN - 1)
+                {
+                    dataBitsAvailable = true;
+                }
+                secondNr = BITS_PER_MIN - 1;
+                sampleValid = true;
+            }
+            else if (sampleNr <= SAMPLE_PER_SEC + SAMPLE_TOLERANCE)
+            {
+                ++secondNr;
+                if (secondNr > BITS_PER_MIN - 1)
+                {
+                    secondNr = 0;
+                }
+                sampleValid = true;
+            }
+            sampleNr = 0;
+        }
+
+        if (sampleValid)
+        {
+            errorNr = 0;
+        }
+        else
+        {
+            ++errorNr;
+            secondNr = -1;
+        }
+
+        if (errorNr == 0 && secondNr >= 0)
+        {
+            ptrRec[secondNr] = bit;
+            if (dataBitsAvailable)
+            {
+                std::swap(ptrRec, ptrProc);
+            }
+        }
+        highStart = now;
+    }
+    else if (prevSample && !newSample)
+    {
+        highEnd = now;
+    }
+    ++sampleNr;
+    ++now;
+    prevSample = newSample;
+    return dataBitsAvailable && decodeTime(ptrProc, 21);
+}
+
+
+bool LegacyDcfDecoder::isCheckSumValid (const uint8_t * bits, size_t i1, size_t i2)
+{
+    uint8_t sum = 0;
+    for (size_t i = i1; i < i2; ++i)
+    {
+        sum += bits[i];
+    }
+    return sum % 2 == bits[i2];
+}
+
+
+int LegacyDcfDecoder::getData (const uint8_t * bits, size_t i1, size_t i2)
+{
+    static const int coeff[8] = {1, 2, 4, 8, 10, 20, 40, 80};
+    int data = 0;
+    for (size_t i = i1; i < i2; ++i)
+    {
+        data += coeff[i - i1] * bits[i];
+    }
+    return data;
+}
+
+
+bool LegacyDcfDecoder::decodeTime (const uint8_t * bits, size_t start)
+{
+    if (!isCheckSumValid(bits, start, start + 7) ||
+        !isCheckSumValid(bits, start + 8, start + 14) ||
+        !isCheckSumValid(bits, start + 15, start + 37))
+    {
+        return false;
+    }
+    dayTime = ::tm();
+    dayTime.tm_min = getData(bits, start, start + 7);
+    dayTime.tm_hour = getData(bits, start + 8, start + 14);
+    dayTime.tm_mday = getData(bits, start + 15, start + 21);
+    dayTime.tm_mon = getData(bits, start + 24, start + 29) - 1;
+    dayTime.tm_year = getData(bits, start + 29, start + 37) + 100;
+    return true;
+}
+
+} // end namespace Host
@@ -0,0 +1,80 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef LEGACYDCFDECODER_H_
+#define LEGACYDCFDECODER_H_
+
+#include <ctime>
+
+#include "StmPlusPlus/Devices/Dcf77.h"
+
+namespace Host {
+
+/**
+ * @brief The DCF77 decoder of the firmware before the phase detector, kept as a
+ *        reference for the benchmarks.
+ *
+ * Each rising edge of the median-filtered samples starts a second: the edge is
+ * accepted if it follows the previous one after 100 +/- 3 samples, and a gap of
+ * more than 1.5 s marks the end of the minute. The bit of the previous second
+ * is decided by the pulse length. A frame is decoded by its parity bits only.
+ */
+class LegacyDcfDecoder
+{
+public:
+
+    static const size_t SAMPLE_PER_SEC = 100;
+    static const size_t SAMPLE_TOLERANCE = 3;
+    static const int16_t BITS_PER_MIN = 59;
+
+    LegacyDcfDecoder ();
+
+    /**
+     * @brief Processes a 100 Hz sample: true if the carrier is reduced.
+     * @return True if a time was decoded with this sample. It refers to the
+     *         minute mark just detected.
+     */
+    bool processSample (bool rawSample);
+
+    inline const ::tm & getDayTime () const
+    {
+        return dayTime;
+    }
+
+private:
+
+    StmPlusPlus::Devices::DcfMedianFilter filter;
+    int16_t secondNr;
+    size_t sampleNr, errorNr, now;
+    bool prevSample;
+    size_t highStart, highEnd; // in samples
+    uint8_t dataBits1[BITS_PER_MIN];
+    uint8_t * ptrRec;
+    uint8_t dataBits2[BITS_PER_MIN];
+    uint8_t * ptrProc;
+    ::tm dayTime;
+
+    bool decodeTime (const uint8_t * bits, size_t start);
+    static bool isCheckSumValid (const uint8_t * bits, size_t i1, size_t i2);
+    static int getData (const uint8_t * bits, size_t i1, size_t i2);
+};
+
+} // end namespace Host
+
+#endif
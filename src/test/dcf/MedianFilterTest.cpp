@@ -0,0 +1,189 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Test of the bit-packed median filter against a naive sorted-window median
+ * and the shifting array filter it replaced, together with the cost per sample
+ * of each. The cycles are read from the time stamp counter of the host, i.e.
+ * they only compare the implementations and are no target figures; the test
+ * only fails on a different output.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "HostHal.h"
+#include "StmPlusPlus/Devices/Dcf77.h"
+
+using namespace StmPlusPlus::Devices;
+
+static const size_t SAMPLES = 1000000;
+
+/**
+ * @brief Median of the sorted window preceding the new sample.
+ */
+template <size_t window> class SortedMedian
+{
+public:
+
+    bool processSample (bool val)
+    {
+        bool ret = false;
+        if (samples.size() == window)
+        {
+            std::vector<bool> sorted(samples.begin(), samples.end());
+            std::sort(sorted.begin(), sorted.end());
+            ret = sorted[window / 2];
+            samples.pop_front();
+        }
+        samples.push_back(val);
+        return ret;
+    }
+
+private:
+
+    std::deque<bool> samples;
+};
+
+/**
+ * @brief The array filter of the firmware before the shift register.
+ */
+template <size_t window> class ArrayFilter
+{
+public:
+
+    bool processSample (bool val)
+    {
+        if (currSample < window)
+        {
+            samples[currSample++] = val;
+            return false;
+        }
+        size_t nrTrue = 0;
+        for (bool s : samples)
+        {
+            nrTrue += s;
+        }
+        for (size_t i = 0; i < window - 1; ++i)
+        {
+            samples[i] = samples[i + 1];
+        }
+        samples[window - 1] = val;
+        return 2 * nrTrue > window;
+    }
+
+private:
+
+    bool samples[window] = {};
+    size_t currSample = 0;
+};
+
+/**
+ * @brief Random samples in bursts of different densities, like a noisy receiver output.
+ */
+static std::vector<bool> makeSamples (size_t n)
+{
+    std::vector<bool> s(n);
+    ::srandom(41);
+    int density = 50;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i % 100 == 0)
+        {
+            density = random() % 101;
+        }
+        s[i] = random() % 100 < density;
+    }
+    return s;
+}
+
+template <size_t window> static void checkWindow (const std::vector<bool> & samples)
+{
+    MedianFilter<window> filter;
+    SortedMedian<window> sorted;
+    ArrayFilter<window> array;
+    size_t differences = 0;
+    for (bool s : samples)
+    {
+        const bool f = filter.processSample(s);
+        differences += (f != sorted.processSample(s)) + (f != array.processSample(s));
+    }
+    ::printf("window %2zu: %zu differences in %zu samples\n", window, differences, samples.size());
+    HOST_CHECK(differences == 0);
+}
+
+static inline uint64_t readCycles ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Returns the cycles per sample, the minimum of several repetitions.
+ */
+template <class Filter> static double measure (const std::vector<bool> & samples, size_t n)
+{
+    double best = 1e30;
+    for (int rep = 0; rep < 5; ++rep)
+    {
+        Filter filter;
+        volatile size_t sum = 0;
+        const uint64_t start = readCycles();
+        for (size_t i = 0; i < n; ++i)
+        {
+            sum = sum + filter.processSample(samples[i]);
+        }
+        best = std::min(best, (double)(readCycles() - start) / n);
+    }
+    return best;
+}
+
+int main ()
+{
+    const std::vector<bool> samples = makeSamples(SAMPLES);
+    checkWindow<1>(samples);
+    checkWindow<3>(samples);
+    checkWindow<7>(samples);
+    checkWindow<15>(samples);
+    checkWindow<31>(samples);
+
+    const double packed7 = measure<MedianFilter<7>>(samples, SAMPLES);
+    const double packed31 = measure<MedianFilter<31>>(samples, SAMPLES);
+    const double array7 = measure<ArrayFilter<7>>(samples, SAMPLES);
+    const double array31 = measure<ArrayFilter<31>>(samples, SAMPLES);
+    const double sorted7 = measure<SortedMedian<7>>(samples, SAMPLES / 10);
+    const double sorted31 = measure<SortedMedian<31>>(samples, SAMPLES / 10);
+    ::printf("cycles per sample    window 7   window 31\n");
+    ::printf("  shift register     %8.1f    %8.1f\n", packed7, packed31);
+    ::printf("  array filter       %8.1f    %8.1f\n", array7, array31);
+    ::printf("  sorted window      %8.1f    %8.1f\n", sorted7, sorted31);
+
+    // the figures depend on the load of the host: only the outputs are checked
+    return HOST_RESULT();
+}
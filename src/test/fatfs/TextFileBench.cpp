@@ -0,0 +1,361 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Disk-image benchmark of the buffered text file reader and writer against
+ * the line-by-line FatFS string functions that Config used before. Both run
+ * on the same FAT image in host memory. The FatFS API calls are counted by
+ * linker wrappers, the sector transfers by the RAM disk driver.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "HostHal.h"
+#include "RamDisk.h"
+#include "StmPlusPlus/TextFile.h"
+
+using namespace StmPlusPlus;
+
+/************************************************************************
+ * FatFS call counters
+ ************************************************************************/
+
+struct ApiCalls
+{
+    size_t read, write, gets, printf;
+    size_t getsReads; // f_gets reads the file byte by byte inside FatFS
+};
+
+static ApiCalls apiCalls;
+
+extern "C" {
+
+FRESULT __real_f_read (FIL * fp, void * buff, UINT btr, UINT * br);
+FRESULT __real_f_write (FIL * fp, const void * buff, UINT btw, UINT * bw);
+TCHAR * __real_f_gets (TCHAR * buff, int len, FIL * fp);
+
+FRESULT __wrap_f_read (FIL * fp, void * buff, UINT btr, UINT * br)
+{
+    ++apiCalls.read;
+    return __real_f_read(fp, buff, btr, br);
+}
+
+FRESULT __wrap_f_write (FIL * fp, const void * buff, UINT btw, UINT * bw)
+{
+    ++apiCalls.write;
+    return __real_f_write(fp, buff, btw, bw);
+}
+
+TCHAR * __wrap_f_gets (TCHAR * buff, int len, FIL * fp)
+{
+    ++apiCalls.gets;
+    return __real_f_gets(buff, len, fp);
+}
+
+} // extern "C"
+
+/************************************************************************
+ * Old and new implementations
+ ************************************************************************/
+
+static const size_t MAX_LINE_LENGTH = 128;
+static const char SEPARATOR = '=';
+
+typedef std::vector<std::pair<std::string, std::string>> Parameters;
+
+static std::string makeName (size_t i)
+{
+    static const char * names[] = { "ALARM%u_ACTIVE", "ALARM%u_HM", "ALARM%u_DAYS", "ALARM%u_SOUND" };
+    char name[32];
+    ::snprintf(name, sizeof(name), names[i % 4], (unsigned)(i / 4 + 1));
+    return name;
+}
+
+static std::string makeValue (size_t i)
+{
+    static const char * values[] = { "1", "0630", "12345", "alarm.wav" };
+    return values[i % 4];
+}
+
+/**
+ * @brief Writer of the original Config::writeFile: one f_printf per parameter.
+ */
+static FRESULT writeOld (const char * path, size_t parameters)
+{
+    FIL file;
+    FRESULT code = f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (code != FR_OK)
+    {
+        return code;
+    }
+    for (size_t i = 0; i < parameters; ++i)
+    {
+        ++apiCalls.printf;
+        f_printf(&file, "%s %c %s\n", makeName(i).c_str(), SEPARATOR, makeValue(i).c_str());
+    }
+    return f_close(&file);
+}
+
+static FRESULT writeNew (const char * path, size_t parameters)
+{
+    FIL file;
+    FRESULT code = f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (code != FR_OK)
+    {
+        return code;
+    }
+    TextFileWriter out(file);
+    for (size_t i = 0; i < parameters; ++i)
+    {
+        out.printf("%s %c %s\n", makeName(i).c_str(), SEPARATOR, makeValue(i).c_str());
+    }
+    code = out.flush();
+    f_close(&file);
+    return code;
+}
+
+/**
+ * @brief Reader of the original Config::readFile: f_gets and a copy of every
+ *        character into name and value.
+ */
+static FRESULT readOld (const char * path, Parameters & pars)
+{
+    FIL file;
+    FRESULT code = f_open(&file, path, FA_READ);
+    if (code != FR_OK)
+    {
+        return code;
+    }
+    char buff[MAX_LINE_LENGTH + 1];
+    char name[MAX_LINE_LENGTH + 1];
+    char value[MAX_LINE_LENGTH + 1];
+    while (f_gets(buff, MAX_LINE_LENGTH, &file) != 0)
+    {
+        // the CR of the line end is read as well and dropped
+        apiCalls.getsReads += ::strlen(buff) + (::strchr(buff, '\n') != NULL);
+        ::memset(name, 0, sizeof(name));
+        ::memset(value, 0, sizeof(value));
+        char * ptr = &name[0];
+        for (auto & c : buff)
+        {
+            if (c == 0)
+            {
+                break;
+            }
+            if (::isspace(c))
+            {
+                continue;
+            }
+            if (c == SEPARATOR)
+            {
+                ptr = &value[0];
+                continue;
+            }
+            *ptr = c;
+            ++ptr;
+        }
+        if (name[0] != 0 && value[0] != 0)
+        {
+            pars.push_back(std::make_pair(name, value));
+        }
+    }
+    return f_close(&file);
+}
+
+static char * trim (char * str)
+{
+    while (::isspace(*str))
+    {
+        ++str;
+    }
+    char * end = str + ::strlen(str);
+    while (end > str && ::isspace(*(end - 1)))
+    {
+        --end;
+    }
+    *end = 0;
+    return str;
+}
+
+/**
+ * @brief Reader of the current Config::readFile.
+ */
+static FRESULT readNew (const char * path, Parameters & pars)
+{
+    FIL file;
+    FRESULT code = f_open(&file, path, FA_READ);
+    if (code != FR_OK)
+    {
+        return code;
+    }
+    TextFileReader in(file);
+    char * line;
+    while ((line = in.readLine()) != NULL)
+    {
+        char * value = ::strchr(line, SEPARATOR);
+        if (value == NULL)
+        {
+            continue;
+        }
+        *value++ = 0;
+        char * name = trim(line);
+        value = trim(value);
+        if (name[0] != 0 && value[0] != 0)
+        {
+            pars.push_back(std::make_pair(name, value));
+        }
+    }
+    f_close(&file);
+    return in.getResult();
+}
+
+/************************************************************************
+ * Benchmark
+ ************************************************************************/
+
+struct Result
+{
+    ApiCalls api;
+    Host::RamDisk::Statistics disk;
+    double time;
+};
+
+template <typename Function> static Result measure (Host::RamDisk & disk, Function f)
+{
+    apiCalls = ApiCalls();
+    disk.resetStatistics();
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto stop = std::chrono::steady_clock::now();
+    Result r;
+    r.api = apiCalls;
+    r.disk = disk.getStatistics();
+    r.time = std::chrono::duration<double, std::micro>(stop - start).count();
+    return r;
+}
+
+static void print (const char * name, const Result & r)
+{
+    ::printf("  %-4s f_read %5zu (+%5zu in f_gets), f_write %5zu, f_gets %5zu, f_printf %5zu, "
+            "disk read %4zu, disk write %4zu, unaligned %zu, %8.1f us\n",
+            name, r.api.read, r.api.getsReads, r.api.write, r.api.gets, r.api.printf,
+            r.disk.readCalls, r.disk.writeCalls, r.disk.unalignedCalls, r.time);
+}
+
+static void benchmark (size_t parameters)
+{
+    Host::RamDisk disk(8192);
+    HOST_CHECK(disk.format() == FR_OK);
+
+    Result wOld = measure(disk, [=] () { HOST_CHECK(writeOld("old.txt", parameters) == FR_OK); });
+    Result wNew = measure(disk, [=] () { HOST_CHECK(writeNew("new.txt", parameters) == FR_OK); });
+
+    // both writers shall produce the same lines; f_printf terminates them with CR LF
+    FILINFO infoOld, infoNew;
+    HOST_CHECK(f_stat("old.txt", &infoOld) == FR_OK && f_stat("new.txt", &infoNew) == FR_OK);
+    HOST_CHECK(infoOld.fsize == infoNew.fsize + parameters);
+    const size_t sectors = (infoNew.fsize + Host::RamDisk::SECTOR_SIZE - 1) / Host::RamDisk::SECTOR_SIZE;
+
+    Parameters pOld, pNew;
+    Result rOld = measure(disk, [&] () { HOST_CHECK(readOld("old.txt", pOld) == FR_OK); });
+    Result rNew = measure(disk, [&] () { HOST_CHECK(readNew("new.txt", pNew) == FR_OK); });
+
+    ::printf("%zu parameters, %u bytes:\n", parameters, (unsigned)infoNew.fsize);
+    ::printf(" write\n");
+    print("old", wOld);
+    print("new", wNew);
+    ::printf(" read\n");
+    print("old", rOld);
+    print("new", rNew);
+
+    // both readers shall see the same parameters
+    HOST_CHECK(pOld.size() == parameters);
+    HOST_CHECK(pOld == pNew);
+
+    // the buffered implementations need one FatFS call per sector
+    HOST_CHECK(wNew.api.write == sectors);
+    HOST_CHECK(rNew.api.read == infoNew.fsize / Host::RamDisk::SECTOR_SIZE + 1);
+    HOST_CHECK(rNew.api.gets == 0 && wNew.api.printf == 0);
+    HOST_CHECK(wNew.api.write < wOld.api.printf);
+    HOST_CHECK(rNew.api.read < rOld.api.gets);
+    HOST_CHECK(rNew.disk.readCalls <= rOld.disk.readCalls);
+    HOST_CHECK(wNew.disk.writeCalls <= wOld.disk.writeCalls);
+
+    // the sectors are transferred directly from and into the buffers by the SDIO DMA
+    HOST_CHECK(rNew.disk.unalignedCalls == 0 && wNew.disk.unalignedCalls == 0);
+}
+
+/************************************************************************
+ * Line splitting of the reader
+ ************************************************************************/
+
+static std::vector<std::string> readLines (Host::RamDisk & disk, const std::string & content)
+{
+    HOST_CHECK(disk.writeFile("lines.txt", content.data(), content.size()) == FR_OK);
+    std::vector<std::string> lines;
+    FIL file;
+    HOST_CHECK(f_open(&file, "lines.txt", FA_READ) == FR_OK);
+    TextFileReader in(file);
+    char * line;
+    while ((line = in.readLine()) != NULL)
+    {
+        lines.push_back(line);
+    }
+    HOST_CHECK(in.getResult() == FR_OK);
+    f_close(&file);
+    return lines;
+}
+
+static void testReader ()
+{
+    Host::RamDisk disk(8192);
+    HOST_CHECK(disk.format() == FR_OK);
+
+    HOST_CHECK(readLines(disk, "").empty());
+    HOST_CHECK(readLines(disk, "a\nb") == std::vector<std::string>({ "a", "b" }));
+    HOST_CHECK(readLines(disk, "a\r\n\r\nb\r\n") == std::vector<std::string>({ "a", "", "b" }));
+
+    // a line that crosses the sector boundary is joined
+    std::string first(500, 'x'), second(100, 'y');
+    HOST_CHECK(readLines(disk, first + "\n" + second + "\n") == std::vector<std::string>({ first, second }));
+
+    // a line longer than a sector is split after a sector
+    std::string longLine(1300, 'z');
+    std::vector<std::string> parts = readLines(disk, longLine + "\nend\n");
+    HOST_CHECK(parts.size() == 4);
+    HOST_CHECK(parts.size() == 4 && parts[0].size() == TextFileReader::SECTOR_SIZE && parts[3] == "end");
+    size_t total = 0;
+    for (auto & p : parts)
+    {
+        total += p.size();
+    }
+    HOST_CHECK(total == longLine.size() + 3);
+}
+
+int main ()
+{
+    testReader();
+    // the current configuration file and a long file like the holiday calendar
+    benchmark(16);
+    benchmark(2000);
+    return HOST_RESULT();
+}
@@ -0,0 +1,157 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <cstring>
+#include <random>
+
+#include "HostHal.h"
+#include "HostFlash.h"
+
+namespace Host {
+
+static const struct
+{
+    uint32_t address;
+    uint32_t size;
+} SECTORS[FLASH_SECTOR_TOTAL] = {
+    { 0x08000000, 0x4000 }, { 0x08004000, 0x4000 }, { 0x08008000, 0x4000 }, { 0x0800C000, 0x4000 },
+    { 0x08010000, 0x10000 },
+    { 0x08020000, 0x20000 }, { 0x08040000, 0x20000 }, { 0x08060000, 0x20000 },
+    { 0x08080000, 0x20000 }, { 0x080A0000, 0x20000 }, { 0x080C0000, 0x20000 }, { 0x080E0000, 0x20000 }
+};
+
+static FlashStatistics statistics;
+static long powerLoss = -1;
+static bool powerLossOnErase = false;
+static std::mt19937 random;
+
+void setPowerLoss (long operation, uint32_t seed, bool erasesOnly)
+{
+    powerLoss = operation;
+    powerLossOnErase = erasesOnly;
+    random.seed(seed);
+}
+
+const FlashStatistics & getFlashStatistics ()
+{
+    return statistics;
+}
+
+void resetFlashStatistics ()
+{
+    ::memset(&statistics, 0, sizeof(statistics));
+}
+
+/**
+ * @brief Returns true if the power fails during the current operation.
+ */
+static bool isPowerLost (bool erase)
+{
+    if (powerLoss < 0 || (powerLossOnErase && !erase))
+    {
+        return false;
+    }
+    return powerLoss-- == 0;
+}
+
+} // end namespace Host
+
+/************************************************************************
+ * HAL fakes
+ ************************************************************************/
+
+extern "C" {
+
+HAL_StatusTypeDef HAL_FLASH_Unlock (void)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock (void)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program (uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+    if (TypeProgram != FLASH_TYPEPROGRAM_WORD || (Address & 3) != 0 ||
+        Address < FLASH_BASE || Address >= FLASH_BASE + 0x100000)
+    {
+        return HAL_ERROR;
+    }
+    volatile uint32_t * word = reinterpret_cast<volatile uint32_t *>(Address);
+    uint32_t value = (uint32_t)Data;
+    ++Host::statistics.programs;
+    if ((*word & value) != value)
+    {
+        ++Host::statistics.conflicts;
+    }
+    if (Host::isPowerLost(false))
+    {
+        // only a part of the bits is cleared
+        *word &= value | Host::random();
+        throw Host::PowerLoss();
+    }
+    *word &= value;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase (FLASH_EraseInitTypeDef * pEraseInit, uint32_t * SectorError)
+{
+    *SectorError = 0xFFFFFFFF;
+    if (pEraseInit->TypeErase != FLASH_TYPEERASE_SECTORS ||
+        pEraseInit->Sector + pEraseInit->NbSectors > FLASH_SECTOR_TOTAL)
+    {
+        return HAL_ERROR;
+    }
+    for (uint32_t s = pEraseInit->Sector; s < pEraseInit->Sector + pEraseInit->NbSectors; ++s)
+    {
+        volatile uint32_t * words = reinterpret_cast<volatile uint32_t *>(Host::SECTORS[s].address);
+        const size_t size = Host::SECTORS[s].size / sizeof(uint32_t);
+        ++Host::statistics.erases[s];
+        if (Host::isPowerLost(true))
+        {
+            // each word is either erased, kept or partially erased
+            for (size_t i = 0; i < size; ++i)
+            {
+                switch (Host::random() % 3)
+                {
+                case 0:
+                    words[i] = 0xFFFFFFFF;
+                    break;
+                case 1:
+                    break;
+                default:
+                    words[i] |= Host::random();
+                    break;
+                }
+            }
+            *SectorError = s;
+            throw Host::PowerLoss();
+        }
+        for (size_t i = 0; i < size; ++i)
+        {
+            words[i] = 0xFFFFFFFF;
+        }
+        Host::advance(Host::FLASH_ERASE_TIME_128K * Host::SECTORS[s].size / 0x20000);
+    }
+    return HAL_OK;
+}
+
+} // extern "C"
@@ -0,0 +1,65 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef HOSTFLASH_H_
+#define HOSTFLASH_H_
+
+#include "stm32f4xx.h"
+
+/**
+ * @brief Host model of the STM32F405 flash for the HAL_FLASH fakes.
+ *
+ * Programming only clears bits, an erase sets a whole sector to 0xFF and
+ * advances the virtual time by the sector erase time. A power loss can be
+ * injected after a given number of flash operations: the interrupted
+ * operation leaves partially cleared or set bits and a PowerLoss exception
+ * unwinds the firmware.
+ */
+namespace Host {
+
+struct PowerLoss
+{
+    // empty
+};
+
+struct FlashStatistics
+{
+    size_t programs;      // programmed words
+    size_t conflicts;     // programmed words that would need to set bits
+    size_t erases[FLASH_SECTOR_TOTAL];
+};
+
+/**
+ * @brief Typical erase time (in milliseconds) of a 128 KB sector.
+ */
+static const uint32_t FLASH_ERASE_TIME_128K = 1000;
+
+/**
+ * @brief Lets the power fail during the given flash operation (program of a word
+ *        or erase of a sector) counted from now. A negative value disables it.
+ *        If erasesOnly is set, only sector erases are counted.
+ */
+void setPowerLoss (long operation, uint32_t seed, bool erasesOnly = false);
+
+const FlashStatistics & getFlashStatistics ();
+void resetFlashStatistics ();
+
+} // end namespace Host
+
+#endif
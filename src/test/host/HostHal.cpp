@@ -0,0 +1,331 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "HostHal.h"
+
+/************************************************************************
+ * Memory map
+ ************************************************************************/
+
+uint32_t hostPrimask = 0;
+
+namespace Host {
+
+int failures = 0;
+
+static const struct Region
+{
+    uintptr_t base;
+    size_t size;
+    uint8_t fill;
+} REGIONS[] = {
+    { FLASH_BASE, 0x100000, 0xFF },          // 1 MB flash, erased
+    { PERIPH_BASE, 0x10070000, 0x00 },       // APB, AHB1, bit-band alias and AHB2
+    { SCS_BASE & 0xFFFF0000, 0x10000, 0x00 } // system control space
+};
+
+static uint32_t tick = 0;
+static TickHandler tickHandler = NULL;
+static PinListener pinListener = NULL;
+
+static void mapRegions ()
+{
+    for (const Region & r : REGIONS)
+    {
+        void * p = ::mmap((void *)r.base, r.size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (p != (void *)r.base)
+        {
+            ::printf("Can not map host memory at 0x%lx\n", (unsigned long)r.base);
+            ::exit(2);
+        }
+        // anonymous mappings are zero-filled, so only the flash needs a pattern
+        if (r.fill != 0)
+        {
+            ::memset(p, r.fill, r.size);
+        }
+    }
+}
+
+// the memory shall be mapped before constructors of static firmware objects access registers
+__attribute__((constructor(101))) static void initHost ()
+{
+    mapRegions();
+}
+
+void reset ()
+{
+    for (const Region & r : REGIONS)
+    {
+        ::munmap((void *)r.base, r.size);
+    }
+    mapRegions();
+    tick = 0;
+    tickHandler = NULL;
+    pinListener = NULL;
+    hostPrimask = 0;
+}
+
+uint32_t getTick ()
+{
+    return tick;
+}
+
+void advance (uint32_t ms)
+{
+    for (uint32_t i = 0; i < ms; ++i)
+    {
+        ++tick;
+        if (tickHandler != NULL)
+        {
+            tickHandler();
+        }
+    }
+}
+
+void setTickHandler (TickHandler handler)
+{
+    tickHandler = handler;
+}
+
+void setInput (GPIO_TypeDef * port, uint16_t pin, bool level)
+{
+    if (level)
+    {
+        port->IDR |= pin;
+    }
+    else
+    {
+        port->IDR &= ~(uint32_t)pin;
+    }
+}
+
+bool getOutput (GPIO_TypeDef * port, uint16_t pin)
+{
+    return (port->ODR & pin) != 0;
+}
+
+void setPinListener (PinListener listener)
+{
+    pinListener = listener;
+}
+
+} // end namespace Host
+
+/************************************************************************
+ * HAL fakes
+ ************************************************************************/
+
+extern "C" {
+
+uint32_t HAL_GetTick (void)
+{
+    return Host::tick;
+}
+
+void HAL_IncTick (void)
+{
+    ++Host::tick;
+}
+
+void HAL_Delay (__IO uint32_t Delay)
+{
+    Host::advance(Delay);
+}
+
+void HAL_NVIC_SetPriority (IRQn_Type, uint32_t, uint32_t)
+{
+    // empty
+}
+
+void HAL_NVIC_EnableIRQ (IRQn_Type)
+{
+    // empty
+}
+
+void HAL_NVIC_DisableIRQ (IRQn_Type)
+{
+    // empty
+}
+
+void HAL_GPIO_Init (GPIO_TypeDef *, GPIO_InitTypeDef *)
+{
+    // empty
+}
+
+void HAL_GPIO_DeInit (GPIO_TypeDef *, uint32_t)
+{
+    // empty
+}
+
+GPIO_PinState HAL_GPIO_ReadPin (GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin)
+{
+    return (GPIOx->IDR & GPIO_Pin)? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin (GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    if (PinState == GPIO_PIN_SET)
+    {
+        GPIOx->ODR |= GPIO_Pin;
+    }
+    else
+    {
+        GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+    }
+    if (Host::pinListener != NULL)
+    {
+        Host::pinListener(GPIOx, GPIO_Pin, PinState == GPIO_PIN_SET);
+    }
+}
+
+void HAL_GPIO_TogglePin (GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin)
+{
+    HAL_GPIO_WritePin(GPIOx, GPIO_Pin, (GPIOx->ODR & GPIO_Pin)? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
+// the timers and the RTC only exist as registers; their interrupts are called by the tests
+
+HAL_StatusTypeDef HAL_TIM_Base_Init (TIM_HandleTypeDef *)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_DeInit (TIM_HandleTypeDef *)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT (TIM_HandleTypeDef *)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT (TIM_HandleTypeDef *)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_Init (TIM_HandleTypeDef *)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_DeInit (TIM_HandleTypeDef *)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel (TIM_HandleTypeDef *, TIM_IC_InitTypeDef *, uint32_t)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_Start_IT (TIM_HandleTypeDef *, uint32_t)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_Stop_IT (TIM_HandleTypeDef *, uint32_t)
+{
+    return HAL_OK;
+}
+
+uint32_t HAL_TIM_ReadCapturedValue (TIM_HandleTypeDef * htim, uint32_t Channel)
+{
+    switch (Channel)
+    {
+    case TIM_CHANNEL_1:
+        return htim->Instance->CCR1;
+    case TIM_CHANNEL_2:
+        return htim->Instance->CCR2;
+    case TIM_CHANNEL_3:
+        return htim->Instance->CCR3;
+    default:
+        return htim->Instance->CCR4;
+    }
+}
+
+HAL_StatusTypeDef HAL_RTC_Init (RTC_HandleTypeDef *)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_DeInit (RTC_HandleTypeDef *)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_SetTime (RTC_HandleTypeDef *, RTC_TimeTypeDef *, uint32_t)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_SetDate (RTC_HandleTypeDef *, RTC_DateTypeDef *, uint32_t)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTCEx_SetWakeUpTimer_IT (RTC_HandleTypeDef *, uint32_t, uint32_t)
+{
+    return HAL_OK;
+}
+
+uint32_t HAL_RTCEx_DeactivateWakeUpTimer (RTC_HandleTypeDef *)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit (UART_HandleTypeDef *, uint8_t * pData, uint16_t Size, uint32_t)
+{
+    // the debug output of a started UsartLogger goes to the console
+    ::fwrite(pData, 1, Size, stdout);
+    return HAL_OK;
+}
+
+char * __itoa (int value, char * str, int base)
+{
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char buffer[34];
+    size_t n = 0;
+    unsigned int v = (value < 0 && base == 10)? -(unsigned int)value : (unsigned int)value;
+    do
+    {
+        buffer[n++] = digits[v % base];
+        v /= base;
+    }
+    while (v != 0);
+    char * p = str;
+    if (value < 0 && base == 10)
+    {
+        *p++ = '-';
+    }
+    while (n > 0)
+    {
+        *p++ = buffer[--n];
+    }
+    *p = 0;
+    return str;
+}
+
+} // extern "C"
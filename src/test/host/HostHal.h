@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef HOSTHAL_H_
+#define HOSTHAL_H_
+
+#include <cstdio>
+
+#include "stm32f4xx.h"
+
+/**
+ * @brief Host model of the MCU used by the tests.
+ *
+ * The peripheral, core and flash address ranges are mapped as plain memory at
+ * their real addresses, so register macros of CMSIS and HAL can be used as is.
+ * The HAL functions called by the firmware are replaced by the fakes in
+ * HostHal.cpp that work on this memory and on a virtual millisecond tick.
+ */
+namespace Host {
+
+/**
+ * @brief Callback called on every write of an output pin.
+ */
+typedef void (*PinListener) (GPIO_TypeDef * port, uint16_t pin, bool level);
+
+/**
+ * @brief Callback called on every virtual millisecond, i.e. the SysTick handler.
+ */
+typedef void (*TickHandler) ();
+
+/**
+ * @brief Clears all peripheral registers, erases the flash and resets the virtual time.
+ */
+void reset ();
+
+/**
+ * @brief Returns the virtual HAL tick.
+ */
+uint32_t getTick ();
+
+/**
+ * @brief Advances the virtual time by the given number of milliseconds. For every
+ *        millisecond, the HAL tick is incremented and the tick handler is called.
+ */
+void advance (uint32_t ms);
+
+void setTickHandler (TickHandler handler);
+
+/**
+ * @brief Drives an input pin, i.e. the IDR register of the port.
+ */
+void setInput (GPIO_TypeDef * port, uint16_t pin, bool level);
+
+/**
+ * @brief Returns the level of an output pin, i.e. the ODR register of the port.
+ */
+bool getOutput (GPIO_TypeDef * port, uint16_t pin);
+
+void setPinListener (PinListener listener);
+
+/**
+ * @brief Number of failed checks in the current test program.
+ */
+extern int failures;
+
+} // end namespace Host
+
+/**
+ * @brief Checks a condition, reports its location and counts the failure.
+ */
+#define HOST_CHECK(cond) {\
+    if (!(cond))\
+    {\
+        ::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+        ++Host::failures;\
+    }\
+}
+
+#define HOST_RESULT() (Host::failures == 0? 0 : 1)
+
+#endif
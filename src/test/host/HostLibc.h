@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef HOSTLIBC_H_
+#define HOSTLIBC_H_
+
+/*
+ * Declarations of newlib extensions that the firmware uses and the host C
+ * library does not provide. Forced into every firmware translation unit.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+char * __itoa (int value, char * str, int base);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <cstring>
+
+#include "RamDisk.h"
+
+using namespace Host;
+
+RamDisk * RamDisk::instance = NULL;
+
+Diskio_drvTypeDef RamDisk::driver = {
+    RamDisk::initialize,
+    RamDisk::status,
+    RamDisk::read,
+    RamDisk::write,
+    RamDisk::ioctl
+};
+
+RamDisk::RamDisk (size_t sectors):
+    image(sectors * SECTOR_SIZE, 0),
+    statistics()
+{
+    instance = this;
+    path[0] = 0;
+    FATFS_LinkDriver(&driver, path);
+}
+
+RamDisk::~RamDisk ()
+{
+    f_mount(NULL, path, 0);
+    FATFS_UnLinkDriver(path);
+    instance = NULL;
+}
+
+FRESULT RamDisk::format ()
+{
+    FRESULT code = f_mount(&fs, path, 0);
+    if (code == FR_OK)
+    {
+        code = f_mkfs(path, 1, 0);
+    }
+    if (code == FR_OK)
+    {
+        code = f_mount(&fs, path, 1);
+    }
+    resetStatistics();
+    return code;
+}
+
+FRESULT RamDisk::writeFile (const char * name, const void * data, size_t size)
+{
+    FIL file;
+    FRESULT code = f_open(&file, name, FA_WRITE | FA_CREATE_ALWAYS);
+    if (code != FR_OK)
+    {
+        return code;
+    }
+    UINT bytesWritten = 0;
+    code = f_write(&file, data, size, &bytesWritten);
+    f_close(&file);
+    return (code == FR_OK && bytesWritten != size)? FR_DENIED : code;
+}
+
+DSTATUS RamDisk::initialize (BYTE)
+{
+    return RES_OK;
+}
+
+DSTATUS RamDisk::status (BYTE)
+{
+    return RES_OK;
+}
+
+DRESULT RamDisk::read (BYTE, BYTE * buff, DWORD sector, UINT count)
+{
+    if ((sector + count) * SECTOR_SIZE > instance->image.size())
+    {
+        return RES_PARERR;
+    }
+    ::memcpy(buff, &instance->image[sector * SECTOR_SIZE], count * SECTOR_SIZE);
+    ++instance->statistics.readCalls;
+    if (((uintptr_t)buff & 0x3) != 0)
+    {
+        ++instance->statistics.unalignedCalls;
+    }
+    instance->statistics.readSectors += count;
+    return RES_OK;
+}
+
+DRESULT RamDisk::write (BYTE, const BYTE * buff, DWORD sector, UINT count)
+{
+    if ((sector + count) * SECTOR_SIZE > instance->image.size())
+    {
+        return RES_PARERR;
+    }
+    ::memcpy(&instance->image[sector * SECTOR_SIZE], buff, count * SECTOR_SIZE);
+    ++instance->statistics.writeCalls;
+    if (((uintptr_t)buff & 0x3) != 0)
+    {
+        ++instance->statistics.unalignedCalls;
+    }
+    instance->statistics.writeSectors += count;
+    return RES_OK;
+}
+
+DRESULT RamDisk::ioctl (BYTE, BYTE cmd, void * buff)
+{
+    switch (cmd)
+    {
+    case CTRL_SYNC:
+        return RES_OK;
+    case GET_SECTOR_COUNT:
+        *(DWORD *)buff = instance->image.size() / SECTOR_SIZE;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *(WORD *)buff = SECTOR_SIZE;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *(DWORD *)buff = 1;
+        return RES_OK;
+    default:
+        return RES_PARERR;
+    }
+}
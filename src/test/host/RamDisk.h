@@ -0,0 +1,91 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef RAMDISK_H_
+#define RAMDISK_H_
+
+#include <vector>
+
+#include "FatFS/ff_gen_drv.h"
+
+namespace Host {
+
+/**
+ * @brief FatFS drive on a disk image in host memory.
+ *
+ * The drive is linked as the only logical drive, formatted and mounted. It
+ * counts the sector operations, i.e. the transfers that cost SDIO time on
+ * the target.
+ */
+class RamDisk
+{
+public:
+
+    static const size_t SECTOR_SIZE = 512;
+
+    struct Statistics
+    {
+        size_t readCalls, readSectors;
+        size_t writeCalls, writeSectors;
+        size_t unalignedCalls; // buffers the SDIO DMA can not transfer (not word-aligned)
+    };
+
+    RamDisk (size_t sectors);
+    ~RamDisk ();
+
+    /**
+     * @brief Creates a FAT file system on the image and mounts it.
+     */
+    FRESULT format ();
+
+    inline const Statistics & getStatistics () const
+    {
+        return statistics;
+    }
+
+    inline void resetStatistics ()
+    {
+        statistics = Statistics();
+    }
+
+    /**
+     * @brief Creates a file with the given content.
+     */
+    FRESULT writeFile (const char * path, const void * data, size_t size);
+
+private:
+
+    static RamDisk * instance;
+    static Diskio_drvTypeDef driver;
+
+    std::vector<uint8_t> image;
+    Statistics statistics;
+    FATFS fs;
+    char path[4];
+
+    static DSTATUS initialize (BYTE lun);
+    static DSTATUS status (BYTE lun);
+    static DRESULT read (BYTE lun, BYTE * buff, DWORD sector, UINT count);
+    static DRESULT write (BYTE lun, const BYTE * buff, DWORD sector, UINT count);
+    static DRESULT ioctl (BYTE lun, BYTE cmd, void * buff);
+};
+
+} // end namespace Host
+
+#endif
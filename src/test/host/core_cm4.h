@@ -0,0 +1,109 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef HOST_CORE_CM4_H_
+#define HOST_CORE_CM4_H_
+
+/*
+ * Host replacement of the Cortex-M4 core header. The device header includes
+ * "core_cm4.h" from the include path, so this file is found before the CMSIS
+ * one. It replaces the assembler intrinsics of cmsis_gcc.h by host functions
+ * and then includes the original header for the register definitions.
+ */
+
+#include <stdint.h>
+
+#define __CMSIS_GCC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Interrupt mask of the simulated core, see HostHal.h */
+extern uint32_t hostPrimask;
+
+static inline void __enable_irq (void)
+{
+    hostPrimask = 0;
+}
+
+static inline void __disable_irq (void)
+{
+    hostPrimask = 1;
+}
+
+static inline uint32_t __get_PRIMASK (void)
+{
+    return hostPrimask;
+}
+
+static inline void __set_PRIMASK (uint32_t priMask)
+{
+    hostPrimask = priMask;
+}
+
+static inline void __NOP (void)
+{
+    // empty
+}
+
+static inline void __WFI (void)
+{
+    // empty
+}
+
+static inline void __ISB (void)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __DSB (void)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __DMB (void)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t __REV (uint32_t value)
+{
+    return __builtin_bswap32(value);
+}
+
+static inline uint32_t __RBIT (uint32_t value)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < 32; ++i)
+    {
+        result = (result << 1) | ((value >> i) & 1U);
+    }
+    return result;
+}
+
+#define __CLZ (uint8_t)__builtin_clz
+
+#ifdef __cplusplus
+}
+#endif
+
+#include "../../CMSIS/core/core_cm4.h"
+
+#endif
@@ -0,0 +1,183 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Test of the drift estimation from DCF fixes. The RTC runs with a known drift
+ * and gets a fix every few hours with gaussian noise. As in the clock, the RTC
+ * is set at each fix, i.e. it keeps the error of that fix, and the correction of
+ * the estimator is applied until the next fix. The correction shall converge to
+ * the negated drift within its standard error. The chains are broken by a manual
+ * time change (interrupt() and an arbitrary error) and by an outlier; the
+ * correction shall be kept until the new chain spans DriftEstimator::MIN_SPAN.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+#include "HostHal.h"
+#include "DriftEstimator.h"
+
+static const time_t START = 1792292940;
+static const time_t FIX_INTERVAL = 3 * 3600;
+static const double FIX_NOISE = 10.0; // in ms
+
+struct Counters
+{
+    size_t estimates, withinError, within3Errors;
+};
+
+/**
+ * @brief The RTC with a drift in ppb, a positive drift means that it is fast.
+ */
+class Bench
+{
+public:
+
+    Bench (uint32_t seed, int32_t _drift):
+        random(seed),
+        noise(0.0, FIX_NOISE),
+        drift(_drift),
+        time(START),
+        applied(0),
+        lastFixError(0.0)
+    {
+        // empty
+    }
+
+    /**
+     * @brief Runs until the next fix and passes it to the estimator.
+     *
+     * @param errorOffset is added to the error, e.g. a manual time change.
+     */
+    bool fix (int32_t errorOffset = 0)
+    {
+        time += FIX_INTERVAL;
+        // the RTC was set with the error of the previous fix
+        const double fixError = noise(random);
+        const double error = (double)(drift + applied) * FIX_INTERVAL / 1.0e6 + fixError - lastFixError + errorOffset;
+        lastFixError = fixError;
+        const bool accepted = estimator.addFix(time, (int32_t)::lround(error), applied);
+        applied = estimator.getCorrection();
+        return accepted;
+    }
+
+    void check (Counters & c)
+    {
+        if (!estimator.isValid())
+        {
+            return;
+        }
+        const int32_t deviation = ::abs(estimator.getCorrection() + drift);
+        ++c.estimates;
+        c.withinError += deviation <= estimator.getCorrectionError();
+        c.within3Errors += deviation <= 3 * estimator.getCorrectionError();
+    }
+
+    DriftEstimator estimator;
+    std::mt19937 random;
+    std::normal_distribution<double> noise;
+    int32_t drift;
+    time_t time;
+    int32_t applied;
+    double lastFixError;
+};
+
+static void testConvergence (int32_t drift, Counters & c)
+{
+    Bench b(drift + 46, drift);
+    HOST_CHECK(b.estimator.getCorrection() == 0 && !b.estimator.isValid());
+    // the correction is taken when the chain spans MIN_SPAN
+    for (time_t t = 0; t < DriftEstimator::MIN_SPAN; t += FIX_INTERVAL)
+    {
+        b.fix();
+        HOST_CHECK(!b.estimator.isValid());
+    }
+    b.fix();
+    HOST_CHECK(b.estimator.isValid());
+    for (size_t i = 0; i < 40; ++i)
+    {
+        HOST_CHECK(b.fix());
+        b.check(c);
+    }
+    ::printf("drift %7d ppb: correction %7d ppb, error %4d ppb\n",
+             drift, b.estimator.getCorrection(), b.estimator.getCorrectionError());
+    HOST_CHECK(::abs(b.estimator.getCorrection() + drift) <= 3 * b.estimator.getCorrectionError());
+    // a full chain of fixes
+    HOST_CHECK(b.estimator.getCorrectionError() < 500);
+}
+
+static void testInterrupt (Counters & c)
+{
+    Bench b(4646, 30000);
+    for (size_t i = 0; i < 20; ++i)
+    {
+        b.fix();
+    }
+    const int32_t correction = b.estimator.getCorrection();
+    HOST_CHECK(::abs(correction + b.drift) <= 3 * b.estimator.getCorrectionError());
+
+    // the temperature changed the drift within the assumed wander, and the time
+    // is set manually by a minute
+    b.drift = 31500;
+    b.estimator.interrupt();
+    HOST_CHECK(b.estimator.getPredictedError(b.time) == DriftEstimator::UNKNOWN_ERROR);
+    HOST_CHECK(!b.fix(60000));
+    HOST_CHECK(b.estimator.getCorrection() == correction);
+    for (time_t t = FIX_INTERVAL; t < DriftEstimator::MIN_SPAN; t += FIX_INTERVAL)
+    {
+        HOST_CHECK(b.fix());
+        HOST_CHECK(b.estimator.getCorrection() == correction);
+    }
+    for (size_t i = 0; i < 20; ++i)
+    {
+        HOST_CHECK(b.fix());
+        b.check(c);
+    }
+    ::printf("after interrupt: correction %7d ppb, error %4d ppb\n",
+             b.estimator.getCorrection(), b.estimator.getCorrectionError());
+    HOST_CHECK(::abs(b.estimator.getCorrection() + b.drift) <= 3 * b.estimator.getCorrectionError());
+
+    // an outlier, e.g. a wrong DCF time, restarts the chain as well
+    const int32_t before = b.estimator.getCorrection();
+    HOST_CHECK(!b.fix(2000));
+    HOST_CHECK(b.estimator.getCorrection() == before);
+    for (size_t i = 0; i < 10; ++i)
+    {
+        HOST_CHECK(b.fix());
+        b.check(c);
+    }
+    HOST_CHECK(::abs(b.estimator.getCorrection() + b.drift) <= 3 * b.estimator.getCorrectionError());
+}
+
+int main ()
+{
+    Counters c = {0, 0, 0};
+    static const int32_t drifts[] = {-150000, -20000, -500, 0, 3000, 35000, 120000};
+    for (int32_t drift : drifts)
+    {
+        testConvergence(drift, c);
+    }
+    testInterrupt(c);
+    ::printf("%zu estimates: %.0f %% within the standard error, %.0f %% within three times\n",
+             c.estimates, 100.0 * c.withinError / c.estimates, 100.0 * c.within3Errors / c.estimates);
+    HOST_CHECK(c.withinError >= c.estimates * 9 / 10);
+    HOST_CHECK(c.within3Errors == c.estimates);
+    return HOST_RESULT();
+}
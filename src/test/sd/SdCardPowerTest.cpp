@@ -0,0 +1,302 @@
+/*******************************************************************************
+ * stm32DigitalClock - a digital clock based on STM32F405 MCU
+ * *****************************************************************************
+ * Copyright (C) 2016-2017 Mikhail Kulesh
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/*
+ * Host test of the non-blocking SD card power-up sequence. The SDIO command
+ * path is replaced by a card model that leaves its busy state a configurable
+ * time after its supply was switched on.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "HostHal.h"
+#include "StmPlusPlus/Devices/SdCard.h"
+
+using namespace StmPlusPlus;
+using namespace StmPlusPlus::Devices;
+
+/************************************************************************
+ * Card model
+ ************************************************************************/
+
+#define SD_OP_COND_HIGH_CAPACITY ((uint32_t)0x40000000U)
+#define SD_OP_COND_POWER_UP_DONE ((uint32_t)0x80000000U)
+
+static const uint32_t NEVER = 0xFFFFFFFF;
+
+struct FakeCard
+{
+    bool present;          // the card answers commands at all
+    bool version2;         // the card answers CMD8
+    uint32_t readyTime;    // time after power-on when ACMD41 reports ready
+    bool powered;
+    uint32_t powerOnTick;
+    bool sdioPowered;
+    bool appCommand;
+    uint32_t response;
+    uint32_t commands;
+    uint32_t firstCommandTick;
+    uint32_t opCondArgument;
+};
+
+static FakeCard card;
+
+static void onPinWritten (GPIO_TypeDef * port, uint16_t pin, bool level)
+{
+    if (port == GPIOA && pin == GPIO_PIN_10 && level != card.powered)
+    {
+        card.powered = level;
+        card.powerOnTick = Host::getTick();
+    }
+}
+
+extern "C" {
+
+HAL_StatusTypeDef SDIO_Init (SDIO_TypeDef *, SDIO_InitTypeDef)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef SDIO_PowerState_ON (SDIO_TypeDef *)
+{
+    card.sdioPowered = true;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef SDIO_PowerState_OFF (SDIO_TypeDef *)
+{
+    card.sdioPowered = false;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef SDIO_SendCommand (SDIO_TypeDef * SDIOx, SDIO_CmdInitTypeDef * cmd)
+{
+    if (card.commands++ == 0)
+    {
+        card.firstCommandTick = Host::getTick();
+    }
+    if (cmd->Response == SDIO_RESPONSE_NO)
+    {
+        SDIOx->STA = SDIO_FLAG_CMDSENT;
+        return HAL_OK;
+    }
+    if (!card.present || !card.powered || !card.sdioPowered)
+    {
+        SDIOx->STA = SDIO_FLAG_CTIMEOUT;
+        return HAL_OK;
+    }
+
+    bool appCommand = card.appCommand;
+    card.appCommand = false;
+    switch (cmd->CmdIndex)
+    {
+    case SD_CMD_HS_SEND_EXT_CSD:
+        SDIOx->STA = card.version2? SDIO_FLAG_CMDREND : SDIO_FLAG_CTIMEOUT;
+        break;
+    case SD_CMD_APP_CMD:
+        card.appCommand = true;
+        SDIOx->STA = SDIO_FLAG_CMDREND;
+        break;
+    case SD_CMD_SD_APP_OP_COND:
+        if (!appCommand)
+        {
+            SDIOx->STA = SDIO_FLAG_CTIMEOUT;
+            break;
+        }
+        card.opCondArgument = cmd->Argument;
+        card.response = 0x00FF8000;
+        if (card.readyTime != NEVER && Host::getTick() - card.powerOnTick >= card.readyTime)
+        {
+            card.response |= SD_OP_COND_POWER_UP_DONE;
+        }
+        // R3 has no CRC, the controller reports a CRC failure
+        SDIOx->STA = SDIO_FLAG_CCRCFAIL;
+        break;
+    default:
+        SDIOx->STA = SDIO_FLAG_CTIMEOUT;
+        break;
+    }
+    return HAL_OK;
+}
+
+uint32_t SDIO_GetResponse (uint32_t)
+{
+    return card.response;
+}
+
+} // extern "C"
+
+/************************************************************************
+ * Test bench
+ ************************************************************************/
+
+struct Bench
+{
+    IOPin pinSdPower, pinSdDetect;
+    IOPort portSd1, portSd2;
+    SdCard sdCard;
+
+    Bench ():
+        pinSdPower(IOPort::A, GPIO_PIN_10, GPIO_MODE_OUTPUT_PP, GPIO_PULLDOWN, GPIO_SPEED_HIGH, true, false),
+        pinSdDetect(IOPort::A, GPIO_PIN_12, GPIO_MODE_INPUT, GPIO_PULLUP),
+        portSd1(IOPort::C, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP, GPIO_SPEED_FREQ_VERY_HIGH,
+                GPIO_PIN_8|GPIO_PIN_9|GPIO_PIN_10|GPIO_PIN_11|GPIO_PIN_12, false),
+        portSd2(IOPort::D, GPIO_MODE_OUTPUT_PP, GPIO_PULLUP, GPIO_SPEED_FREQ_VERY_HIGH, GPIO_PIN_2, false),
+        sdCard(pinSdDetect, pinSdPower, portSd1, portSd2)
+    {
+        // empty
+    }
+
+    /**
+     * @brief Runs the main loop until the sequence leaves RAMP_UP and PROBE or the
+     *        time limit is reached. Returns the time of the final state.
+     */
+    uint32_t runPowerUp (uint32_t limit, uint32_t loopPeriod)
+    {
+        uint32_t start = Host::getTick();
+        while (Host::getTick() - start < limit)
+        {
+            SdCard::PowerState s = sdCard.periodic();
+            if (s != SdCard::PowerState::RAMP_UP && s != SdCard::PowerState::PROBE)
+            {
+                break;
+            }
+            Host::advance(loopPeriod);
+        }
+        return Host::getTick() - start;
+    }
+};
+
+static void resetHost (bool present, bool version2, uint32_t readyTime)
+{
+    Host::reset();
+    Host::setPinListener(onPinWritten);
+    // the detect pin is pulled low by an inserted card
+    Host::setInput(GPIOA, GPIO_PIN_12, !present);
+    ::memset(&card, 0, sizeof(card));
+    card.present = present;
+    card.version2 = version2;
+    card.readyTime = readyTime;
+}
+
+static void testReadyTimes ()
+{
+    const uint32_t readyTimes[] = { 0, 1, 7, 35, 120, 480, 990 };
+    const uint32_t loopPeriods[] = { 1, 3, 10 };
+    for (uint32_t readyTime : readyTimes)
+    {
+        for (uint32_t loopPeriod : loopPeriods)
+        {
+            resetHost(true, true, readyTime);
+            Bench b;
+            HOST_CHECK(b.sdCard.isCardInserted());
+            HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::OFF);
+
+            b.sdCard.powerOn();
+            HOST_CHECK(card.powered);
+            HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::RAMP_UP);
+
+            uint32_t elapsed = b.runPowerUp(2 * SdCard::POWER_UP_TIMEOUT, loopPeriod);
+            HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::READY);
+            // no command before the supply ramped up, the card is taken as soon as it is ready
+            HOST_CHECK(card.firstCommandTick >= SdCard::POWER_RAMP_TIME);
+            HOST_CHECK(elapsed >= readyTime);
+            HOST_CHECK(elapsed <= std::max(readyTime, SdCard::POWER_RAMP_TIME) + 2 * loopPeriod);
+            HOST_CHECK((card.opCondArgument & SD_OP_COND_HIGH_CAPACITY) != 0);
+            ::printf("ready time %4u ms, loop period %2u ms: ready after %4u ms, %u commands\n",
+                    (unsigned)readyTime, (unsigned)loopPeriod, (unsigned)elapsed, (unsigned)card.commands);
+
+            // a further call keeps the state and sends no commands
+            uint32_t commands = card.commands;
+            b.sdCard.periodic();
+            HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::READY);
+            HOST_CHECK(card.commands == commands);
+        }
+    }
+}
+
+static void testVersion1Card ()
+{
+    resetHost(true, false, 50);
+    Bench b;
+    b.sdCard.powerOn();
+    b.runPowerUp(2 * SdCard::POWER_UP_TIMEOUT, 1);
+    HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::READY);
+    // a card that does not answer CMD8 shall not be asked for high capacity support
+    HOST_CHECK((card.opCondArgument & SD_OP_COND_HIGH_CAPACITY) == 0);
+}
+
+static void testTimeout ()
+{
+    const bool present[] = { true, false };
+    for (bool p : present)
+    {
+        resetHost(p, true, NEVER);
+        Bench b;
+        b.sdCard.powerOn();
+        uint32_t elapsed = b.runPowerUp(2 * SdCard::POWER_UP_TIMEOUT, 1);
+        HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::FAILED);
+        HOST_CHECK(elapsed >= SdCard::POWER_UP_TIMEOUT && elapsed <= SdCard::POWER_UP_TIMEOUT + 1);
+        // the probe clock is switched off after the failure
+        HOST_CHECK(!card.sdioPowered);
+
+        // the failed state is kept until the card is powered off
+        Host::advance(10);
+        HOST_CHECK(b.sdCard.periodic() == SdCard::PowerState::FAILED);
+        b.sdCard.powerOff();
+        HOST_CHECK(!card.powered);
+        HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::OFF);
+    }
+}
+
+static void testPowerOffDuringProbe ()
+{
+    resetHost(true, true, 300);
+    Bench b;
+    b.sdCard.powerOn();
+    b.runPowerUp(100, 1);
+    HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::PROBE);
+    HOST_CHECK(card.sdioPowered);
+
+    b.sdCard.powerOff();
+    HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::OFF);
+    HOST_CHECK(!card.sdioPowered);
+    HOST_CHECK(!card.powered);
+
+    // a new sequence starts from the beginning and measures the time from the new power-on
+    Host::advance(1000);
+    b.sdCard.powerOn();
+    uint32_t elapsed = b.runPowerUp(2 * SdCard::POWER_UP_TIMEOUT, 1);
+    HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::READY);
+    HOST_CHECK(elapsed >= 300 && elapsed <= 302);
+
+    // repeated power-on of a ready card does not restart the sequence
+    b.sdCard.powerOn();
+    HOST_CHECK(b.sdCard.getPowerState() == SdCard::PowerState::READY);
+}
+
+int main ()
+{
+    testReadyTimes();
+    testVersion1Card();
+    testTimeout();
+    testPowerOffDuringProbe();
+    return HOST_RESULT();
+}